@@ -0,0 +1,70 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <dwarf/dmq/authentication.h>
+
+namespace {
+
+    dwarf::RawBuffer make_raw(const std::string &s) {
+        return dwarf::RawBuffer(reinterpret_cast<const unsigned char *>(s.data()), s.size());
+    }
+
+    const std::string header = "{\"date\":\"2024-01-01T00:00:00.000000Z\",\"msg_id\":\"0123456789abcdef0123456789abcdef\","
+                               "\"msg_type\":\"execute_request\",\"session\":\"0123456789abcdef\",\"username\":\"user\","
+                               "\"version\":\"5.3\"}";
+
+    // range(0): size of the content frame in bytes
+    void bm_sign(benchmark::State &state, const std::string &scheme) {
+        auto auth = dwarf::make_authentication(scheme, "0123456789abcdef0123456789abcdef");
+        std::string content(static_cast<std::size_t>(state.range(0)), 'x');
+        std::string empty = "{}";
+        std::vector<char> signature(auth->signature_size());
+        for (auto _: state) {
+            auth->sign_into(signature.data(), make_raw(header), make_raw(header), make_raw(empty), make_raw(content),
+                            dwarf::raw_buffer_sequence());
+            benchmark::DoNotOptimize(signature.data());
+        }
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(2 * header.size() + content.size()));
+    }
+
+    void bm_verify(benchmark::State &state, const std::string &scheme) {
+        auto auth = dwarf::make_authentication(scheme, "0123456789abcdef0123456789abcdef");
+        std::string content(static_cast<std::size_t>(state.range(0)), 'x');
+        std::string empty = "{}";
+        std::string signature = auth->sign(make_raw(header), make_raw(header), make_raw(empty), make_raw(content));
+        for (auto _: state) {
+            bool ok = auth->verify(make_raw(signature), make_raw(header), make_raw(header), make_raw(empty),
+                                   make_raw(content));
+            benchmark::DoNotOptimize(ok);
+        }
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(2 * header.size() + content.size()));
+    }
+}
+
+#define DWARF_AUTH_BENCHMARK(name, scheme)                                          \
+    BENCHMARK_CAPTURE(bm_sign, name, scheme)->Arg(64)->Arg(4096)->Arg(1 << 20);     \
+    BENCHMARK_CAPTURE(bm_verify, name, scheme)->Arg(64)->Arg(4096)->Arg(1 << 20);   \
+    BENCHMARK_CAPTURE(bm_sign, name##_threads, scheme)->Arg(64)->Threads(4);        \
+    BENCHMARK_CAPTURE(bm_verify, name##_threads, scheme)->Arg(64)->Threads(4)
+
+DWARF_AUTH_BENCHMARK(hmac_md5, "hmac-md5");
+DWARF_AUTH_BENCHMARK(hmac_sha1, "hmac-sha1");
+DWARF_AUTH_BENCHMARK(hmac_sha256, "hmac-sha256");
+DWARF_AUTH_BENCHMARK(hmac_sha512, "hmac-sha512");
@@ -0,0 +1,108 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <memory>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include <collie/nlohmann/json.hpp>
+
+#include <dwarf/zmq/zmq_addon.hpp>
+#include <dwarf/core/history_manager.h>
+#include <dwarf/core/kernel_core.h>
+#include <dwarf/core/logger_impl.h>
+#include <dwarf/dmq/authentication.h>
+#include <dwarf/dmq/zmq_serializer.h>
+
+#include "tests/core/mock_interpreter.h"
+#include "tests/core/mock_server.h"
+
+namespace nl = nlohmann;
+
+namespace {
+
+    // KernelCore over the in-memory server of the tests: measures the
+    // dispatch of a request to the interpreter and the building of the
+    // reply and iopub messages, without any socket.
+    struct dispatch_fixture {
+        dispatch_fixture()
+                : p_history(dwarf::make_in_memory_history_manager()),
+                  m_core("kernel", "user", "session", &m_logger, &m_server, &m_interpreter,
+                         p_history.get(), nullptr, nl::json::error_handler_t::strict) {
+            m_interpreter.configure();
+        }
+
+        void drain() {
+            while (m_server.shell_size() != 0) {
+                m_server.read_shell();
+            }
+            while (m_server.iopub_size() != 0) {
+                m_server.read_iopub();
+            }
+        }
+
+        dwarf::LoggerNolog m_logger;
+        dwarf::xmock_server m_server;
+        dwarf::MockInterpreter m_interpreter;
+        std::unique_ptr<dwarf::HistoryManager> p_history;
+        dwarf::KernelCore m_core;
+    };
+
+    // Goes through the wire format so that the request holds its raw
+    // frames, as it would when received by a real server.
+    dwarf::Message make_request(const dwarf::Authentication &auth, const std::string &msg_type,
+                                const nl::json &content) {
+        dwarf::Message msg(dwarf::Message::guid_list{dwarf::binary_buffer(std::string("client"))},
+                           dwarf::make_header(msg_type, "user", "session"),
+                           nl::json::object(),
+                           nl::json::object(),
+                           content,
+                           dwarf::buffer_sequence());
+        zmq::multipart_t wire_msg = dwarf::xzmq_serializer::serialize(std::move(msg), auth);
+        return dwarf::xzmq_serializer::deserialize(wire_msg, auth);
+    }
+
+    void bm_dispatch(benchmark::State &state, const std::string &msg_type, const nl::json &content) {
+        dispatch_fixture fixture;
+        auto auth = dwarf::make_authentication("none", "");
+        for (auto _: state) {
+            state.PauseTiming();
+            dwarf::Message request = make_request(*auth, msg_type, content);
+            state.ResumeTiming();
+            fixture.m_server.receive_shell(std::move(request));
+            state.PauseTiming();
+            fixture.drain();
+            state.ResumeTiming();
+        }
+    }
+
+    const nl::json execute_content = {
+            {"code",             "1 + 1"},
+            {"silent",           false},
+            {"store_history",    false},
+            {"user_expressions", nl::json::object()},
+            {"allow_stdin",      false}
+    };
+
+    const nl::json complete_content = {
+            {"code",       "a.te"},
+            {"cursor_pos", 4}
+    };
+}
+
+BENCHMARK_CAPTURE(bm_dispatch, kernel_info_request, "kernel_info_request", nl::json::object());
+BENCHMARK_CAPTURE(bm_dispatch, execute_request, "execute_request", execute_content);
+BENCHMARK_CAPTURE(bm_dispatch, complete_request, "complete_request", complete_content);
@@ -0,0 +1,172 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <collie/nlohmann/json.hpp>
+
+#include <dwarf/zmq/zmq.hpp>
+#include <dwarf/zmq/zmq_addon.hpp>
+#include <dwarf/core/kernel_configuration.h>
+#include <dwarf/core/message.h>
+#include <dwarf/dmq/authentication.h>
+#include <dwarf/dmq/middleware.h>
+#include <dwarf/dmq/publisher.h>
+#include <dwarf/dmq/zmq_serializer.h>
+
+namespace nl = nlohmann;
+
+namespace {
+
+    dwarf::PubMessage make_stream_msg(const std::string &text) {
+        nl::json content;
+        content["name"] = "stdout";
+        content["text"] = text;
+        return dwarf::PubMessage("kernel_core.0123456789abcdef.stream",
+                                 dwarf::make_header("stream", "user", "0123456789abcdef"),
+                                 dwarf::make_header("execute_request", "user", "0123456789abcdef"),
+                                 nl::json::object(),
+                                 std::move(content),
+                                 dwarf::buffer_sequence());
+    }
+
+    // Publisher thread and a subscriber connected on the loopback, mimicking
+    // the path of ServerZmq::publish_impl in each mode.
+    class iopub_fixture {
+    public:
+
+        explicit iopub_fixture(dwarf::iopub_mode mode)
+                : m_mode(mode), m_publisher(m_context, "tcp", "127.0.0.1", ""),
+                  m_relay(m_context, zmq::socket_type::pub), m_subscriber(m_context, zmq::socket_type::sub),
+                  p_auth(dwarf::make_authentication("hmac-sha256", "0123456789abcdef0123456789abcdef")) {
+            if (m_mode == dwarf::iopub_mode::QUEUED) {
+                m_publisher.enable_queue(1024, [this](dwarf::PubMessage msg) {
+                    return dwarf::xzmq_serializer::serialize_iopub(std::move(msg), *p_auth);
+                });
+            }
+            m_thread = std::thread(&dwarf::Publisher::run, &m_publisher);
+
+            m_relay.set(zmq::sockopt::linger, 0);
+            m_relay.connect(dwarf::get_publisher_end_point());
+            m_subscriber.set(zmq::sockopt::subscribe, "");
+            m_subscriber.connect(dwarf::get_end_point("tcp", "127.0.0.1", m_publisher.get_port()));
+
+            // Wait for both subscriptions to be effective
+            zmq::multipart_t received;
+            while (true) {
+                publish(make_stream_msg("sync"));
+                if (received.recv(m_subscriber, ZMQ_DONTWAIT)) {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            drain();
+        }
+
+        ~iopub_fixture() {
+            zmq::socket_t controller(m_context, zmq::socket_type::req);
+            controller.connect(dwarf::get_controller_end_point("publisher"));
+            zmq::message_t stop_msg("stop", 4);
+            zmq::message_t response;
+            controller.send(stop_msg, zmq::send_flags::none);
+            (void) controller.recv(response);
+            m_thread.join();
+        }
+
+        void publish(dwarf::PubMessage msg) {
+            if (m_mode == dwarf::iopub_mode::QUEUED) {
+                m_publisher.enqueue(std::move(msg));
+                return;
+            }
+            zmq::multipart_t wire_msg = dwarf::xzmq_serializer::serialize_iopub(std::move(msg), *p_auth);
+            if (m_mode == dwarf::iopub_mode::DIRECT) {
+                m_publisher.publish(wire_msg);
+            } else {
+                wire_msg.send(m_relay);
+            }
+        }
+
+        void receive() {
+            zmq::multipart_t received;
+            received.recv(m_subscriber);
+        }
+
+        void drain() {
+            zmq::multipart_t received;
+            while (received.recv(m_subscriber, ZMQ_DONTWAIT)) {
+                received.clear();
+            }
+        }
+
+    private:
+
+        dwarf::iopub_mode m_mode;
+        zmq::context_t m_context;
+        dwarf::Publisher m_publisher;
+        zmq::socket_t m_relay;
+        zmq::socket_t m_subscriber;
+        std::unique_ptr<dwarf::Authentication> p_auth;
+        std::thread m_thread;
+    };
+
+    // Latency from the publishing thread to a subscriber on the loopback.
+    // range(0): size of the text in bytes
+    void bm_iopub_latency(benchmark::State &state, dwarf::iopub_mode mode) {
+        iopub_fixture fixture(mode);
+        std::string text(static_cast<std::size_t>(state.range(0)), 'x');
+        for (auto _: state) {
+            fixture.publish(make_stream_msg(text));
+            fixture.receive();
+        }
+    }
+
+    // Time spent in the publishing thread, i.e. stolen from the interpreter,
+    // when publishing bursts of 64 messages.
+    void bm_iopub_publish_cost(benchmark::State &state, dwarf::iopub_mode mode) {
+        iopub_fixture fixture(mode);
+        std::string text(static_cast<std::size_t>(state.range(0)), 'x');
+        std::vector<dwarf::PubMessage> burst(64);
+        for (auto _: state) {
+            for (auto &msg: burst) {
+                msg = make_stream_msg(text);
+            }
+            auto start = std::chrono::steady_clock::now();
+            for (auto &msg: burst) {
+                fixture.publish(std::move(msg));
+            }
+            auto stop = std::chrono::steady_clock::now();
+            state.SetIterationTime(std::chrono::duration<double>(stop - start).count());
+            for (int i = 0; i < 64; ++i) {
+                fixture.receive();
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * 64);
+    }
+}
+
+BENCHMARK_CAPTURE(bm_iopub_latency, relay, dwarf::iopub_mode::RELAY)->Arg(32)->Arg(4096)->UseRealTime();
+BENCHMARK_CAPTURE(bm_iopub_latency, direct, dwarf::iopub_mode::DIRECT)->Arg(32)->Arg(4096)->UseRealTime();
+BENCHMARK_CAPTURE(bm_iopub_latency, queued, dwarf::iopub_mode::QUEUED)->Arg(32)->Arg(4096)->UseRealTime();
+
+BENCHMARK_CAPTURE(bm_iopub_publish_cost, relay, dwarf::iopub_mode::RELAY)->Arg(32)->Arg(4096)->UseManualTime();
+BENCHMARK_CAPTURE(bm_iopub_publish_cost, direct, dwarf::iopub_mode::DIRECT)->Arg(32)->Arg(4096)->UseManualTime();
+BENCHMARK_CAPTURE(bm_iopub_publish_cost, queued, dwarf::iopub_mode::QUEUED)->Arg(32)->Arg(4096)->UseManualTime();
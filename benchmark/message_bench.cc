@@ -0,0 +1,57 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include <collie/nlohmann/json.hpp>
+
+#include <dwarf/core/guid.h>
+#include <dwarf/core/message.h>
+
+namespace nl = nlohmann;
+
+namespace {
+
+    void bm_new_guid(benchmark::State &state) {
+        for (auto _: state) {
+            dwarf::Guid guid = dwarf::new_guid();
+            benchmark::DoNotOptimize(guid);
+        }
+    }
+
+    void bm_make_header(benchmark::State &state) {
+        const std::string session = "0123456789abcdef0123456789abcdef";
+        for (auto _: state) {
+            nl::json header = dwarf::make_header("execute_reply", "user", session);
+            benchmark::DoNotOptimize(header);
+        }
+    }
+
+    void bm_iso8601_now(benchmark::State &state) {
+        std::string date;
+        for (auto _: state) {
+            date.clear();
+            dwarf::append_iso8601_now(date);
+            benchmark::DoNotOptimize(date.data());
+        }
+    }
+}
+
+BENCHMARK(bm_new_guid);
+BENCHMARK(bm_new_guid)->Threads(4);
+BENCHMARK(bm_make_header);
+BENCHMARK(bm_iso8601_now);
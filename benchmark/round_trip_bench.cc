@@ -0,0 +1,157 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <benchmark/benchmark.h>
+
+#include <collie/nlohmann/json.hpp>
+
+#include <dwarf/zmq/zmq.hpp>
+#include <dwarf/zmq/zmq_addon.hpp>
+#include <dwarf/core/context.h>
+#include <dwarf/core/kernel.h>
+#include <dwarf/core/kernel_configuration.h>
+#include <dwarf/core/message.h>
+#include <dwarf/dmq/authentication.h>
+#include <dwarf/dmq/middleware.h>
+#include <dwarf/dmq/server_shell_main.h>
+#include <dwarf/dmq/server_zmq.h>
+#include <dwarf/dmq/zmq_serializer.h>
+
+#include "tests/core/mock_interpreter.h"
+
+namespace nl = nlohmann;
+
+namespace {
+
+    const std::string key = "0123456789abcdef0123456789abcdef";
+
+    dwarf::Configuration make_configuration(const std::string &transport) {
+        dwarf::Configuration config;
+        config.m_transport = transport;
+        config.m_signature_scheme = "hmac-sha256";
+        config.m_key = key;
+        if (transport == "inproc") {
+            config.m_ip = "dwarf_bench";
+            config.m_control_port = "control";
+            config.m_shell_port = "shell";
+            config.m_stdin_port = "stdin";
+            config.m_iopub_port = "iopub";
+            config.m_hb_port = "hb";
+        }
+        return config;
+    }
+
+    // Kernel running the mock interpreter on its own thread, and DEALER
+    // sockets connected to its shell and control channels. The sockets
+    // share the context of the kernel, as required by inproc.
+    class kernel_fixture {
+    public:
+
+        kernel_fixture(const std::string &transport, dwarf::Kernel::server_builder builder)
+                : p_auth(dwarf::make_authentication("hmac-sha256", key)) {
+            dwarf::Configuration config = make_configuration(transport);
+            auto context = dwarf::make_context<zmq::context_t>();
+            zmq::context_t &zmq_context = context->m_context;
+            p_kernel.reset(new dwarf::Kernel(config,
+                                             "user",
+                                             std::move(context),
+                                             std::make_unique<dwarf::MockInterpreter>(),
+                                             builder));
+            // The ports of the configuration are only updated for tcp,
+            // get_socket_port expects a tcp end point
+            if (transport == "tcp") {
+                config = p_kernel->get_config();
+            }
+            p_shell.reset(new zmq::socket_t(zmq_context, zmq::socket_type::dealer));
+            p_control.reset(new zmq::socket_t(zmq_context, zmq::socket_type::dealer));
+            p_shell->set(zmq::sockopt::linger, 0);
+            p_control->set(zmq::sockopt::linger, 0);
+            p_shell->connect(dwarf::get_end_point(config.m_transport, config.m_ip, config.m_shell_port));
+            p_control->connect(dwarf::get_end_point(config.m_transport, config.m_ip, config.m_control_port));
+            m_thread = std::thread([this]() { p_kernel->start(); });
+        }
+
+        ~kernel_fixture() {
+            zmq::multipart_t request = make_request("shutdown_request", {{"restart", false}});
+            request.send(*p_control);
+            zmq::multipart_t reply;
+            reply.recv(*p_control);
+            m_thread.join();
+            // The sockets must be closed before the context of the kernel
+            p_shell.reset();
+            p_control.reset();
+            p_kernel.reset();
+        }
+
+        zmq::multipart_t make_request(const std::string &msg_type, const nl::json &content) const {
+            dwarf::Message msg(dwarf::Message::guid_list(),
+                               dwarf::make_header(msg_type, "user", "session"),
+                               nl::json::object(),
+                               nl::json::object(),
+                               content,
+                               dwarf::buffer_sequence());
+            return dwarf::xzmq_serializer::serialize(std::move(msg), *p_auth);
+        }
+
+        void round_trip(const zmq::multipart_t &request) {
+            zmq::multipart_t wire_msg = request.clone();
+            wire_msg.send(*p_shell);
+            zmq::multipart_t reply;
+            reply.recv(*p_shell);
+        }
+
+    private:
+
+        std::unique_ptr<dwarf::Authentication> p_auth;
+        std::unique_ptr<dwarf::Kernel> p_kernel;
+        std::unique_ptr<zmq::socket_t> p_shell;
+        std::unique_ptr<zmq::socket_t> p_control;
+        std::thread m_thread;
+    };
+
+    // Latency of an execute_request, from the client sending it to the
+    // client receiving the execute_reply. range(0): size of the code
+    void bm_execute_round_trip(benchmark::State &state, const std::string &transport,
+                               dwarf::Kernel::server_builder builder) {
+        kernel_fixture fixture(transport, builder);
+        // Waits for the kernel to be started
+        fixture.round_trip(fixture.make_request("kernel_info_request", nl::json::object()));
+
+        nl::json content;
+        content["code"] = std::string(static_cast<std::size_t>(state.range(0)), 'x');
+        content["silent"] = false;
+        content["store_history"] = false;
+        content["user_expressions"] = nl::json::object();
+        content["allow_stdin"] = false;
+        zmq::multipart_t request = fixture.make_request("execute_request", content);
+        for (auto _: state) {
+            fixture.round_trip(request);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+}
+
+BENCHMARK_CAPTURE(bm_execute_round_trip, zmq_inproc, "inproc", dwarf::make_xserver_zmq)
+        ->Arg(32)->Arg(64 * 1024)->UseRealTime();
+BENCHMARK_CAPTURE(bm_execute_round_trip, zmq_tcp, "tcp", dwarf::make_xserver_zmq)
+        ->Arg(32)->Arg(64 * 1024)->UseRealTime();
+BENCHMARK_CAPTURE(bm_execute_round_trip, split_inproc, "inproc", dwarf::make_xserver_shell_main)
+        ->Arg(32)->Arg(64 * 1024)->UseRealTime();
+BENCHMARK_CAPTURE(bm_execute_round_trip, split_tcp, "tcp", dwarf::make_xserver_shell_main)
+        ->Arg(32)->Arg(64 * 1024)->UseRealTime();
@@ -0,0 +1,104 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include <collie/nlohmann/json.hpp>
+
+#include <dwarf/zmq/zmq_addon.hpp>
+#include <dwarf/core/message.h>
+#include <dwarf/dmq/authentication.h>
+#include <dwarf/dmq/zmq_serializer.h>
+
+namespace nl = nlohmann;
+
+namespace {
+
+    const std::string key = "0123456789abcdef0123456789abcdef";
+
+    // range(0): size of the code in bytes, range(1): number of binary
+    // buffers of 4 KiB
+    dwarf::Message make_execute_request(const benchmark::State &state) {
+        nl::json content;
+        content["code"] = std::string(static_cast<std::size_t>(state.range(0)), 'x');
+        content["silent"] = false;
+        content["store_history"] = true;
+        content["user_expressions"] = nl::json::object();
+        content["allow_stdin"] = false;
+        dwarf::buffer_sequence buffers;
+        for (int64_t i = 0; i < state.range(1); ++i) {
+            buffers.push_back(dwarf::binary_buffer(std::string(4096, 'b')));
+        }
+        return dwarf::Message(dwarf::Message::guid_list{dwarf::binary_buffer(std::string("client"))},
+                              dwarf::make_header("execute_request", "user", "0123456789abcdef"),
+                              dwarf::make_header("execute_request", "user", "0123456789abcdef"),
+                              nl::json::object(),
+                              std::move(content),
+                              std::move(buffers));
+    }
+
+    int64_t wire_size(const zmq::multipart_t &wire_msg) {
+        int64_t size = 0;
+        for (const zmq::message_t &frame: wire_msg) {
+            size += static_cast<int64_t>(frame.size());
+        }
+        return size;
+    }
+
+    // The message is rebuilt at each iteration since serialize consumes it
+    void bm_serialize(benchmark::State &state) {
+        auto auth = dwarf::make_authentication("hmac-sha256", key);
+        int64_t bytes = 0;
+        for (auto _: state) {
+            state.PauseTiming();
+            dwarf::Message msg = make_execute_request(state);
+            state.ResumeTiming();
+            zmq::multipart_t wire_msg = dwarf::xzmq_serializer::serialize(std::move(msg), *auth);
+            bytes = wire_size(wire_msg);
+            benchmark::DoNotOptimize(wire_msg);
+        }
+        state.SetBytesProcessed(state.iterations() * bytes);
+    }
+
+    // The frames are copied at each iteration since deserialize consumes them
+    void bm_deserialize(benchmark::State &state, dwarf::decoding_policy policy) {
+        auto auth = dwarf::make_authentication("hmac-sha256", key);
+        zmq::multipart_t wire_msg = dwarf::xzmq_serializer::serialize(make_execute_request(state), *auth);
+        for (auto _: state) {
+            state.PauseTiming();
+            zmq::multipart_t received = wire_msg.clone();
+            state.ResumeTiming();
+            dwarf::Message msg = dwarf::xzmq_serializer::deserialize(received, *auth, policy);
+            benchmark::DoNotOptimize(msg);
+        }
+        state.SetBytesProcessed(state.iterations() * wire_size(wire_msg));
+    }
+
+    void serializer_args(benchmark::internal::Benchmark *bench) {
+        for (int64_t code_size: {64, 4096, 1 << 20}) {
+            for (int64_t buffer_count: {0, 1, 8}) {
+                bench->Args({code_size, buffer_count});
+            }
+        }
+    }
+}
+
+BENCHMARK(bm_serialize)->Apply(serializer_args);
+BENCHMARK_CAPTURE(bm_deserialize, eager, dwarf::decoding_policy::EAGER)->Apply(serializer_args);
+BENCHMARK_CAPTURE(bm_deserialize, lazy, dwarf::decoding_policy::LAZY)->Apply(serializer_args);
@@ -0,0 +1,335 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// Replays the requests of a wire capture, see Configuration::m_capture_path,
+// against a running kernel and reports the latency of the replies:
+//
+//     wire_replay <capture> <connection_file> [--fast] [--timeout <ms>]
+//
+// The shell and control requests are sent at the pace of the capture, or
+// back to back with --fast. The input requests of the kernel are answered
+// with the captured input replies, in order. The requests are signed again
+// with the key of the connection file, so the capture can be replayed
+// against any kernel.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <collie/nlohmann/json.hpp>
+
+#include <dwarf/zmq/zmq.hpp>
+#include <dwarf/zmq/zmq_addon.hpp>
+#include <dwarf/core/kernel_configuration.h>
+#include <dwarf/core/metrics.h>
+#include <dwarf/dmq/authentication.h>
+#include <dwarf/dmq/middleware.h>
+#include <dwarf/dmq/wire_capture.h>
+#include <dwarf/dmq/zmq_serializer.h>
+
+namespace nl = nlohmann;
+
+namespace {
+
+    using clock_type = std::chrono::steady_clock;
+
+    const std::string DELIMITER = "<IDS|MSG>";
+
+    struct request_entry {
+        dwarf::metric_socket m_socket;
+        std::uint64_t m_timestamp;
+        zmq::multipart_t m_wire_msg;
+        std::string m_msg_id;
+        std::string m_msg_type;
+    };
+
+    struct pending_request {
+        std::string m_msg_type;
+        clock_type::time_point m_sent;
+    };
+
+    dwarf::RawBuffer to_raw(const zmq::message_t &frame) {
+        return dwarf::RawBuffer(frame.data<const unsigned char>(), frame.size());
+    }
+
+    // Drops the routing identities of the original client, the DEALER
+    // sockets of the replay are routed by the kernel, and signs the
+    // message with the key of the replayed kernel. Returns false when the
+    // record is not a Jupyter message.
+    bool prepare_request(const dwarf::wire_record &record,
+                         const dwarf::Authentication &auth,
+                         zmq::multipart_t &wire_msg) {
+        std::size_t delimiter = 0;
+        while (delimiter < record.m_frames.size() && record.m_frames[delimiter] != DELIMITER) {
+            ++delimiter;
+        }
+        // delimiter, signature, header, parent_header, metadata, content
+        if (delimiter + 6 > record.m_frames.size()) {
+            return false;
+        }
+        wire_msg.clear();
+        for (std::size_t i = delimiter; i < record.m_frames.size(); ++i) {
+            wire_msg.addstr(record.m_frames[i]);
+        }
+        dwarf::raw_buffer_sequence buffers;
+        for (std::size_t i = 6; i < wire_msg.size(); ++i) {
+            buffers.push_back(to_raw(wire_msg[i]));
+        }
+        std::string signature = auth.sign(to_raw(wire_msg[2]), to_raw(wire_msg[3]),
+                                          to_raw(wire_msg[4]), to_raw(wire_msg[5]), buffers);
+        wire_msg[1].rebuild(signature.data(), signature.size());
+        return true;
+    }
+
+    std::string peek_msg_type(const zmq::multipart_t &wire_msg) {
+        const char *data = wire_msg[2].data<const char>();
+        nl::json header = nl::json::parse(data, data + wire_msg[2].size(), nullptr, false);
+        if (header.is_object()) {
+            auto iter = header.find("msg_type");
+            if (iter != header.end() && iter->is_string()) {
+                return iter->get<std::string>();
+            }
+        }
+        return std::string();
+    }
+
+    bool ends_with(const std::string &str, const std::string &suffix) {
+        return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    // Upper bound of the bucket holding the quantile q, in nanoseconds
+    std::uint64_t quantile(const dwarf::LatencyHistogram &histogram, double q) {
+        std::uint64_t total = histogram.total();
+        if (total == 0) {
+            return 0;
+        }
+        std::uint64_t rank = static_cast<std::uint64_t>(q * static_cast<double>(total - 1)) + 1;
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < dwarf::LatencyHistogram::bucket_count; ++i) {
+            seen += histogram.count(i);
+            if (seen >= rank) {
+                return i + 1 < dwarf::LatencyHistogram::bucket_count
+                       ? std::min(dwarf::LatencyHistogram::lower_bound(i + 1) - 1, histogram.max())
+                       : histogram.max();
+            }
+        }
+        return histogram.max();
+    }
+
+    class wire_replay {
+    public:
+
+        wire_replay(const dwarf::Configuration &config, bool fast)
+                : p_auth(dwarf::make_authentication(config.m_signature_scheme, config.m_key, config.m_sign_buffers)),
+                  m_shell(m_context, zmq::socket_type::dealer), m_control(m_context, zmq::socket_type::dealer),
+                  m_stdin(m_context, zmq::socket_type::dealer), m_fast(fast), m_unanswered_input(0) {
+            // The kernel sends its input requests to the identity of the
+            // shell request, the stdin socket must share it
+            const std::string identity = "wire_replay";
+            for (zmq::socket_t *socket: {&m_shell, &m_control, &m_stdin}) {
+                socket->set(zmq::sockopt::routing_id, identity);
+                socket->set(zmq::sockopt::linger, 0);
+            }
+            m_shell.connect(dwarf::get_end_point(config.m_transport, config.m_ip, config.m_shell_port));
+            m_control.connect(dwarf::get_end_point(config.m_transport, config.m_ip, config.m_control_port));
+            m_stdin.connect(dwarf::get_end_point(config.m_transport, config.m_ip, config.m_stdin_port));
+        }
+
+        void load(const std::string &path) {
+            dwarf::WireCaptureReader reader(path);
+            dwarf::wire_record record;
+            while (reader.next(record)) {
+                if (record.m_direction != dwarf::metric_direction::RECEIVED ||
+                    record.m_socket == dwarf::metric_socket::IOPUB) {
+                    continue;
+                }
+                zmq::multipart_t wire_msg;
+                if (!prepare_request(record, *p_auth, wire_msg)) {
+                    continue;
+                }
+                if (record.m_socket == dwarf::metric_socket::STDIN) {
+                    m_input_replies.push_back(std::move(wire_msg));
+                    continue;
+                }
+                request_entry entry;
+                entry.m_socket = record.m_socket;
+                entry.m_timestamp = record.m_timestamp;
+                std::string parent_id;
+                dwarf::xzmq_serializer::peek_ids(wire_msg, entry.m_msg_id, parent_id);
+                entry.m_msg_type = peek_msg_type(wire_msg);
+                entry.m_wire_msg = std::move(wire_msg);
+                m_requests.push_back(std::move(entry));
+            }
+        }
+
+        void run(std::chrono::milliseconds timeout) {
+            if (m_requests.empty()) {
+                return;
+            }
+            clock_type::time_point start = clock_type::now();
+            std::uint64_t first_timestamp = m_requests.front().m_timestamp;
+            for (request_entry &entry: m_requests) {
+                if (!m_fast) {
+                    auto due = start + std::chrono::nanoseconds(entry.m_timestamp - first_timestamp);
+                    while (clock_type::now() < due) {
+                        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(due - clock_type::now());
+                        receive(std::max(left, std::chrono::milliseconds(0)));
+                    }
+                }
+                send(entry);
+                receive(std::chrono::milliseconds(0));
+            }
+            clock_type::time_point deadline = clock_type::now() + timeout;
+            while (!m_pending.empty() && clock_type::now() < deadline) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock_type::now());
+                receive(std::max(left, std::chrono::milliseconds(1)));
+            }
+        }
+
+        void report(std::ostream &out) const {
+            out << std::left << std::setw(24) << "msg_type" << std::right
+                << std::setw(8) << "count"
+                << std::setw(12) << "p50 (us)"
+                << std::setw(12) << "p90 (us)"
+                << std::setw(12) << "p99 (us)"
+                << std::setw(12) << "max (us)" << std::endl;
+            for (const auto &latency: m_latencies) {
+                const dwarf::LatencyHistogram &histogram = *latency.second;
+                out << std::left << std::setw(24) << latency.first << std::right
+                    << std::setw(8) << histogram.total()
+                    << std::setw(12) << quantile(histogram, 0.5) / 1000
+                    << std::setw(12) << quantile(histogram, 0.9) / 1000
+                    << std::setw(12) << quantile(histogram, 0.99) / 1000
+                    << std::setw(12) << histogram.max() / 1000 << std::endl;
+            }
+            out << m_requests.size() << " requests replayed, " << m_pending.size() << " without reply";
+            if (m_unanswered_input != 0) {
+                out << ", " << m_unanswered_input << " input requests without captured reply";
+            }
+            out << std::endl;
+        }
+
+    private:
+
+        void send(request_entry &entry) {
+            // Only the requests get a reply, comm messages do not
+            if (ends_with(entry.m_msg_type, "_request")) {
+                m_pending[entry.m_msg_id] = pending_request{entry.m_msg_type, clock_type::now()};
+            }
+            zmq::socket_t &socket = entry.m_socket == dwarf::metric_socket::CONTROL ? m_control : m_shell;
+            entry.m_wire_msg.send(socket);
+        }
+
+        void receive(std::chrono::milliseconds timeout) {
+            zmq::pollitem_t items[] = {
+                    {m_shell,   0, ZMQ_POLLIN, 0},
+                    {m_control, 0, ZMQ_POLLIN, 0},
+                    {m_stdin,   0, ZMQ_POLLIN, 0}
+            };
+            zmq::poll(&items[0], 3, timeout);
+            clock_type::time_point now = clock_type::now();
+            for (std::size_t i = 0; i < 2; ++i) {
+                if (items[i].revents & ZMQ_POLLIN) {
+                    zmq::socket_t &socket = i == 0 ? m_shell : m_control;
+                    zmq::multipart_t wire_msg;
+                    while (wire_msg.recv(socket, ZMQ_DONTWAIT)) {
+                        on_reply(wire_msg, now);
+                        wire_msg.clear();
+                    }
+                }
+            }
+            if (items[2].revents & ZMQ_POLLIN) {
+                zmq::multipart_t wire_msg;
+                while (wire_msg.recv(m_stdin, ZMQ_DONTWAIT)) {
+                    if (m_input_replies.empty()) {
+                        ++m_unanswered_input;
+                    } else {
+                        m_input_replies.front().send(m_stdin);
+                        m_input_replies.pop_front();
+                    }
+                    wire_msg.clear();
+                }
+            }
+        }
+
+        void on_reply(const zmq::multipart_t &wire_msg, clock_type::time_point now) {
+            std::string msg_id, parent_id;
+            dwarf::xzmq_serializer::peek_ids(wire_msg, msg_id, parent_id);
+            auto iter = m_pending.find(parent_id);
+            if (iter == m_pending.end()) {
+                return;
+            }
+            auto &histogram = m_latencies[iter->second.m_msg_type];
+            if (histogram == nullptr) {
+                histogram.reset(new dwarf::LatencyHistogram());
+            }
+            histogram->record(static_cast<std::uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(now - iter->second.m_sent).count()));
+            m_pending.erase(iter);
+        }
+
+        zmq::context_t m_context;
+        std::unique_ptr<dwarf::Authentication> p_auth;
+        zmq::socket_t m_shell;
+        zmq::socket_t m_control;
+        zmq::socket_t m_stdin;
+        bool m_fast;
+        std::size_t m_unanswered_input;
+        std::vector<request_entry> m_requests;
+        std::deque<zmq::multipart_t> m_input_replies;
+        std::map<std::string, pending_request> m_pending;
+        std::map<std::string, std::unique_ptr<dwarf::LatencyHistogram>> m_latencies;
+    };
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " <capture> <connection_file> [--fast] [--timeout <ms>]" << std::endl;
+        return 1;
+    }
+    bool fast = false;
+    std::chrono::milliseconds timeout(10000);
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--fast") {
+            fast = true;
+        } else if (arg == "--timeout" && i + 1 < argc) {
+            timeout = std::chrono::milliseconds(std::atol(argv[++i]));
+        } else {
+            std::cerr << "unknown argument " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    try {
+        wire_replay replay(dwarf::load_configuration(argv[2]), fast);
+        replay.load(argv[1]);
+        replay.run(timeout);
+        replay.report(std::cout);
+    }
+    catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
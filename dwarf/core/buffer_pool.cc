@@ -0,0 +1,104 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <dwarf/core/buffer_pool.h>
+
+namespace dwarf {
+    namespace {
+        constexpr std::size_t INITIAL_EXPECTED_SIZE = 256;
+        // Released buffers this much larger than the expected size give their memory back
+        constexpr std::size_t SHRINK_FACTOR = 4;
+        constexpr std::size_t MAX_FREE_BUFFERS = 64;
+    }
+
+    BufferPool::BufferPool()
+            : m_free(), p_released(nullptr), m_expected_size(INITIAL_EXPECTED_SIZE) {
+    }
+
+    BufferPool::~BufferPool() {
+        collect_released();
+        for (PooledBuffer *buffer: m_free) {
+            delete buffer;
+        }
+    }
+
+    BufferPool &BufferPool::local() {
+        thread_local std::shared_ptr<BufferPool> pool(new BufferPool());
+        return *pool;
+    }
+
+    PooledBuffer *BufferPool::acquire() {
+        collect_released();
+
+        PooledBuffer *buffer = nullptr;
+        if (m_free.empty()) {
+            buffer = new PooledBuffer();
+        } else {
+            buffer = m_free.back();
+            m_free.pop_back();
+        }
+
+        buffer->m_data.clear();
+        if (buffer->m_data.capacity() < m_expected_size) {
+            buffer->m_data.reserve(m_expected_size);
+        }
+        buffer->p_pool = shared_from_this();
+        return buffer;
+    }
+
+    void BufferPool::release(PooledBuffer *buffer) noexcept {
+        // The pool may be destroyed when this reference goes away,
+        // after the buffer has been handed back to it.
+        std::shared_ptr<BufferPool> pool = std::move(buffer->p_pool);
+        pool->push_released(buffer);
+    }
+
+    std::size_t BufferPool::expected_size() const noexcept {
+        return m_expected_size;
+    }
+
+    void BufferPool::push_released(PooledBuffer *buffer) noexcept {
+        PooledBuffer *head = p_released.load(std::memory_order_relaxed);
+        do {
+            buffer->p_next = head;
+        } while (!p_released.compare_exchange_weak(head, buffer,
+                                                   std::memory_order_release,
+                                                   std::memory_order_relaxed));
+    }
+
+    void BufferPool::collect_released() {
+        PooledBuffer *buffer = p_released.exchange(nullptr, std::memory_order_acquire);
+        while (buffer != nullptr) {
+            PooledBuffer *next = buffer->p_next;
+            buffer->p_next = nullptr;
+
+            std::size_t size = buffer->m_data.size();
+            m_expected_size = m_expected_size - m_expected_size / 8 + size / 8;
+            if (m_expected_size < INITIAL_EXPECTED_SIZE) {
+                m_expected_size = INITIAL_EXPECTED_SIZE;
+            }
+
+            if (m_free.size() >= MAX_FREE_BUFFERS) {
+                delete buffer;
+            } else {
+                if (buffer->m_data.capacity() > SHRINK_FACTOR * m_expected_size) {
+                    std::vector<char>().swap(buffer->m_data);
+                }
+                m_free.push_back(buffer);
+            }
+            buffer = next;
+        }
+    }
+}
@@ -0,0 +1,100 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <dwarf/core/config.h>
+
+namespace dwarf {
+
+    class BufferPool;
+
+    /**
+     * @class PooledBuffer
+     * @brief Growable scratch buffer borrowed from a BufferPool.
+     */
+    class DWARF_API PooledBuffer {
+    public:
+
+        std::vector<char> &data() noexcept;
+
+    private:
+
+        PooledBuffer() = default;
+
+        std::vector<char> m_data;
+        PooledBuffer *p_next = nullptr;
+        // Keeps the pool alive while the buffer is borrowed
+        std::shared_ptr<BufferPool> p_pool;
+
+        friend class BufferPool;
+    };
+
+    /**
+     * @class BufferPool
+     * @brief Per-thread pool of scratch buffers.
+     *
+     * Buffers are acquired by the thread owning the pool and can be released
+     * from any thread, e.g. from the free callback of a zmq message: released
+     * buffers go through a lock-free stack that the owner drains upon its next
+     * acquisition. New buffers are reserved to a moving average of the sizes
+     * recently released to the pool.
+     */
+    class DWARF_API BufferPool : public std::enable_shared_from_this<BufferPool> {
+    public:
+
+        ~BufferPool();
+
+        BufferPool(const BufferPool &) = delete;
+
+        BufferPool &operator=(const BufferPool &) = delete;
+
+        // Pool of the calling thread
+        static BufferPool &local();
+
+        // Must be called from the thread owning the pool
+        PooledBuffer *acquire();
+
+        // Can be called from any thread
+        static void release(PooledBuffer *buffer) noexcept;
+
+        std::size_t expected_size() const noexcept;
+
+    private:
+
+        BufferPool();
+
+        void push_released(PooledBuffer *buffer) noexcept;
+
+        void collect_released();
+
+        std::vector<PooledBuffer *> m_free;
+        std::atomic<PooledBuffer *> p_released;
+        std::size_t m_expected_size;
+    };
+
+    /*******************************
+     * PooledBuffer implementation *
+     *******************************/
+
+    inline std::vector<char> &PooledBuffer::data() noexcept {
+        return m_data;
+    }
+}
@@ -0,0 +1,66 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <atomic>
+
+namespace dwarf {
+
+    /**
+     * @class CancellationToken
+     * @brief Flag set by an interrupt and polled by the code being executed.
+     */
+    class CancellationToken {
+    public:
+
+        CancellationToken() noexcept;
+
+        CancellationToken(const CancellationToken &) = delete;
+
+        CancellationToken &operator=(const CancellationToken &) = delete;
+
+        bool is_cancelled() const noexcept;
+
+        // Can be called from any thread
+        void cancel() noexcept;
+
+        void reset() noexcept;
+
+    private:
+
+        std::atomic<bool> m_cancelled;
+    };
+
+    /************************************
+     * CancellationToken implementation *
+     ************************************/
+
+    inline CancellationToken::CancellationToken() noexcept
+            : m_cancelled(false) {
+    }
+
+    inline bool CancellationToken::is_cancelled() const noexcept {
+        return m_cancelled.load(std::memory_order_acquire);
+    }
+
+    inline void CancellationToken::cancel() noexcept {
+        m_cancelled.store(true, std::memory_order_release);
+    }
+
+    inline void CancellationToken::reset() noexcept {
+        m_cancelled.store(false, std::memory_order_release);
+    }
+}
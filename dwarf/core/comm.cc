@@ -35,6 +35,27 @@ namespace dwarf {
         p_kernel = kernel;
     }
 
+    CommManager::CommManager(const CommManager &rhs)
+            : m_targets(rhs.m_targets), p_kernel(rhs.p_kernel) {
+        std::lock_guard<std::mutex> lock(rhs.m_comms_mutex);
+        m_comms = rhs.m_comms;
+    }
+
+    CommManager &CommManager::operator=(const CommManager &rhs) {
+        if (this != &rhs) {
+            std::map<Guid, Comm *> comms;
+            {
+                std::lock_guard<std::mutex> lock(rhs.m_comms_mutex);
+                comms = rhs.m_comms;
+            }
+            std::lock_guard<std::mutex> lock(m_comms_mutex);
+            m_comms = std::move(comms);
+            m_targets = rhs.m_targets;
+            p_kernel = rhs.p_kernel;
+        }
+        return *this;
+    }
+
     nl::json CommManager::get_metadata() const {
         // TODO: handle duplication
         nl::json metadata;
@@ -52,13 +73,32 @@ namespace dwarf {
     }
 
     void CommManager::register_comm(Guid id, Comm *comm) {
+        std::lock_guard<std::mutex> lock(m_comms_mutex);
         m_comms[id] = comm;
     }
 
     void CommManager::unregister_comm(Guid id) {
+        std::lock_guard<std::mutex> lock(m_comms_mutex);
         m_comms.erase(id);
     }
 
+    nl::json CommManager::comm_info(const std::string &target_name) const {
+        auto comms = nl::json::object();
+        std::lock_guard<std::mutex> lock(m_comms_mutex);
+        for (const auto &comm: m_comms) {
+            const std::string &name = comm.second->target().name();
+            if (target_name.empty() || name == target_name) {
+                nl::json info;
+                info["target_name"] = name;
+                comms[comm.first] = std::move(info);
+            }
+        }
+        nl::json reply;
+        reply["comms"] = std::move(comms);
+        reply["status"] = "ok";
+        return reply;
+    }
+
     void CommManager::comm_open(Message request) {
         const nl::json &content = request.content();
         std::string target_name = content["target_name"];
@@ -82,23 +122,35 @@ namespace dwarf {
     void CommManager::comm_close(Message request) {
         const nl::json &content = request.content();
         Guid id = content["comm_id"];
-        auto position = m_comms.find(id);
-        if (position == m_comms.end()) {
-            throw std::runtime_error("No such comm registered: " + std::string(id));
-        } else {
-            position->second->handle_close(std::move(request));
+        std::shared_ptr<const Comm::handler_type> handler;
+        {
+            std::lock_guard<std::mutex> lock(m_comms_mutex);
+            auto position = m_comms.find(id);
+            if (position == m_comms.end()) {
+                throw std::runtime_error("No such comm registered: " + std::string(id));
+            }
+            handler = position->second->p_close_handler;
+            m_comms.erase(position);
+        }
+        if (handler && *handler) {
+            (*handler)(std::move(request));
         }
-        m_comms.erase(id);
     }
 
     void CommManager::comm_msg(Message request) {
         const nl::json &content = request.content();
         Guid id = content["comm_id"];
-        auto position = m_comms.find(id);
-        if (position == m_comms.end()) {
-            throw std::runtime_error("No such comm registered: " + std::string(id));
-        } else {
-            position->second->handle_message(std::move(request));
+        std::shared_ptr<const Comm::handler_type> handler;
+        {
+            std::lock_guard<std::mutex> lock(m_comms_mutex);
+            auto position = m_comms.find(id);
+            if (position == m_comms.end()) {
+                throw std::runtime_error("No such comm registered: " + std::string(id));
+            }
+            handler = position->second->p_message_handler;
+        }
+        if (handler && *handler) {
+            (*handler)(std::move(request));
         }
     }
 }
@@ -19,6 +19,8 @@
 #include <functional>
 #include <list>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <utility>
 
@@ -148,8 +150,9 @@ namespace dwarf {
                                buffer_sequence,
                                const std::string &target_name) const;
 
-        handler_type m_close_handler;
-        handler_type m_message_handler;
+        // Shared with CommManager, which calls them after releasing its lock
+        std::shared_ptr<const handler_type> p_close_handler;
+        std::shared_ptr<const handler_type> p_message_handler;
         Target *p_target;
         Guid m_id;
         bool m_moved_from;
@@ -170,6 +173,10 @@ namespace dwarf {
 
         CommManager(KernelCore *kernel = nullptr);
 
+        CommManager(const CommManager &rhs);
+
+        CommManager &operator=(const CommManager &rhs);
+
         using target_function_type = Target::function_type;
 
         void register_comm_target(const std::string &target_name,
@@ -191,6 +198,11 @@ namespace dwarf {
 
         Target *target(const std::string &target_name);
 
+        // Content of a comm_info_reply listing the comms of the given target,
+        // or all of them if target_name is empty. Unlike comms(), it can be
+        // called while comms are opened or closed on another thread.
+        nl::json comm_info(const std::string &target_name) const;
+
     private:
 
         friend class Target;
@@ -204,6 +216,11 @@ namespace dwarf {
         std::map<Guid, Comm *> m_comms;
         std::map<std::string, Target> m_targets;
         KernelCore *p_kernel;
+        // Guards every access to m_comms. It is never held while a handler
+        // runs: comm_msg and comm_close take a reference to the handler of
+        // the comm under the lock, which keeps it alive even if the comm is
+        // destroyed on another thread meanwhile.
+        mutable std::mutex m_comms_mutex;
     };
 
     /**************************
@@ -257,14 +274,14 @@ namespace dwarf {
     }
 
     inline void Comm::handle_close(Message message) {
-        if (m_close_handler) {
-            m_close_handler(std::move(message));
+        if (p_close_handler && *p_close_handler) {
+            (*p_close_handler)(std::move(message));
         }
     }
 
     inline void Comm::handle_message(Message message) {
-        if (m_message_handler) {
-            m_message_handler(std::move(message));
+        if (p_message_handler && *p_message_handler) {
+            (*p_message_handler)(std::move(message));
         }
     }
 
@@ -292,7 +309,7 @@ namespace dwarf {
     }
 
     inline Comm::Comm(Comm &&comm)
-            : m_close_handler(std::move(comm.m_close_handler)), m_message_handler(std::move(comm.m_message_handler)),
+            : p_close_handler(std::move(comm.p_close_handler)), p_message_handler(std::move(comm.p_message_handler)),
               p_target(std::move(comm.p_target)), m_id(std::move(comm.m_id)), m_moved_from(false) {
         comm.m_moved_from = true;
         p_target->register_comm(m_id,
@@ -305,8 +322,8 @@ namespace dwarf {
     }
 
     inline Comm &Comm::operator=(Comm &&comm) {
-        m_close_handler = std::move(comm.m_close_handler);
-        m_message_handler = std::move(comm.m_message_handler);
+        p_close_handler = std::move(comm.p_close_handler);
+        p_message_handler = std::move(comm.p_message_handler);
         p_target = std::move(comm.p_target);
         p_target->unregister_comm(m_id);
         m_id = std::move(comm.m_id);
@@ -364,12 +381,12 @@ namespace dwarf {
 
     template<class T>
     inline void Comm::on_message(T &&handler) {
-        m_message_handler = std::forward<T>(handler);
+        p_message_handler = std::make_shared<const handler_type>(std::forward<T>(handler));
     }
 
     template<class T>
     inline void Comm::on_close(T &&handler) {
-        m_close_handler = std::forward<T>(handler);
+        p_close_handler = std::make_shared<const handler_type>(std::forward<T>(handler));
     }
 
     /********************************
@@ -0,0 +1,112 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <cstdint>
+#include <random>
+#include <utility>
+
+#include <collie/nlohmann/json.hpp>
+
+#include <dwarf/core/header_factory.h>
+
+namespace nl = nlohmann;
+
+namespace dwarf {
+    namespace {
+        const char DATE_PREFIX[] = "{\"date\":\"";
+        const char MSG_ID_PREFIX[] = "\",\"msg_id\":\"";
+        const char MSG_TYPE_PREFIX[] = "\",\"msg_type\":";
+        constexpr std::size_t DATE_SIZE = 27;
+        constexpr std::size_t MSG_ID_SIZE = 32;
+
+        void append_json_string(std::string &out, const std::string &value) {
+            for (char c: value) {
+                if (c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20 || static_cast<unsigned char>(c) >= 0x7f) {
+                    out += nl::json(value).dump();
+                    return;
+                }
+            }
+            out += '"';
+            out += value;
+            out += '"';
+        }
+
+        void append_hex(std::string &out, std::uint64_t value) {
+            static const char digits[] = "0123456789abcdef";
+            char hex[16];
+            for (int i = 15; i >= 0; --i) {
+                hex[i] = digits[value & 0x0f];
+                value >>= 4;
+            }
+            out.append(hex, 16);
+        }
+
+        struct message_id_generator {
+            message_id_generator()
+                    : m_counter(0) {
+                std::random_device device;
+                m_prefix = (static_cast<std::uint64_t>(device()) << 32) ^ device();
+            }
+
+            void append(std::string &out) {
+                append_hex(out, m_prefix);
+                append_hex(out, m_counter++);
+            }
+
+            std::uint64_t m_prefix;
+            std::uint64_t m_counter;
+        };
+
+        void append_message_id(std::string &out) {
+            thread_local message_id_generator generator;
+            generator.append(out);
+        }
+    }
+
+    HeaderFactory::HeaderFactory(const std::string &user_name, const std::string &session_id) {
+        m_tail = ",\"session\":";
+        m_tail += nl::json(session_id).dump();
+        m_tail += ",\"username\":";
+        m_tail += nl::json(user_name).dump();
+        m_tail += ",\"version\":";
+        m_tail += nl::json(get_protocol_version()).dump();
+        m_tail += '}';
+    }
+
+    binary_buffer HeaderFactory::make_raw_header(const std::string &msg_type) const {
+        std::string header;
+        header.reserve(sizeof(DATE_PREFIX) + DATE_SIZE + sizeof(MSG_ID_PREFIX) + MSG_ID_SIZE
+                       + sizeof(MSG_TYPE_PREFIX) + msg_type.size() + 2 + m_tail.size());
+        header += DATE_PREFIX;
+        append_iso8601_now(header);
+        header += MSG_ID_PREFIX;
+        append_message_id(header);
+        header += MSG_TYPE_PREFIX;
+        append_json_string(header, msg_type);
+        header += m_tail;
+        return binary_buffer(std::move(header));
+    }
+
+    LazyJson HeaderFactory::make_header(const std::string &msg_type) const {
+        return LazyJson(make_raw_header(msg_type), decoding_policy::LAZY);
+    }
+
+    std::string new_message_id() {
+        std::string res;
+        res.reserve(MSG_ID_SIZE);
+        append_message_id(res);
+        return res;
+    }
+}
@@ -0,0 +1,51 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <string>
+
+#include <dwarf/core/config.h>
+#include <dwarf/core/message.h>
+
+namespace dwarf {
+
+    /**
+     * @class HeaderFactory
+     * @brief Builds the serialized headers of the messages sent by a kernel.
+     *
+     * The fields that never change for a kernel (username, session, version)
+     * are escaped once; building a header only formats the date, the msg_id
+     * and the msg_type. The result is identical to the dump of make_header,
+     * except that msg_ids come from a per-thread generator instead of uuids.
+     */
+    class DWARF_API HeaderFactory {
+    public:
+
+        HeaderFactory(const std::string &user_name, const std::string &session_id);
+
+        binary_buffer make_raw_header(const std::string &msg_type) const;
+
+        LazyJson make_header(const std::string &msg_type) const;
+
+    private:
+
+        // ,"session":...,"username":...,"version":...}
+        std::string m_tail;
+    };
+
+    // Unique message id: a random per-thread prefix followed by a counter
+    DWARF_API std::string new_message_id();
+}
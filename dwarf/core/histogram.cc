@@ -0,0 +1,76 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <dwarf/core/histogram.h>
+
+namespace dwarf {
+    constexpr std::size_t Histogram::bucket_count;
+
+    Histogram::Histogram() noexcept
+            : m_sum(0) {
+        for (auto &count: m_counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void Histogram::record(std::uint64_t value) noexcept {
+        auto &count = m_counts[bucket(value)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        m_sum.store(m_sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    std::uint64_t Histogram::count(std::size_t bucket) const noexcept {
+        return m_counts[bucket].load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t Histogram::total() const noexcept {
+        std::uint64_t res = 0;
+        for (const auto &count: m_counts) {
+            res += count.load(std::memory_order_relaxed);
+        }
+        return res;
+    }
+
+    std::uint64_t Histogram::sum() const noexcept {
+        return m_sum.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t Histogram::lower_bound(std::size_t bucket) noexcept {
+        return bucket == 0 ? 0 : std::uint64_t(1) << (bucket - 1);
+    }
+
+    std::size_t Histogram::bucket(std::uint64_t value) noexcept {
+        std::size_t res = 0;
+        while (value != 0 && res + 1 < bucket_count) {
+            value >>= 1;
+            ++res;
+        }
+        return res;
+    }
+
+    std::string Histogram::to_string() const {
+        std::string res;
+        for (std::size_t i = 0; i < bucket_count; ++i) {
+            std::uint64_t c = count(i);
+            if (c != 0) {
+                if (!res.empty()) {
+                    res += ' ';
+                }
+                res += std::to_string(lower_bound(i)) + ':' + std::to_string(c);
+            }
+        }
+        return res;
+    }
+}
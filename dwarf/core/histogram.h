@@ -0,0 +1,69 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <dwarf/core/config.h>
+
+namespace dwarf {
+
+    /**
+     * @class Histogram
+     * @brief Distribution of non negative values over power of two buckets.
+     *
+     * Bucket 0 counts zeros, bucket i counts the values in [2^(i-1), 2^i)
+     * and the last bucket everything above. Recording is wait-free and
+     * meant for a single writer; counts can be read from any thread.
+     */
+    class DWARF_API Histogram {
+    public:
+
+        static constexpr std::size_t bucket_count = 16;
+
+        Histogram() noexcept;
+
+        Histogram(const Histogram &) = delete;
+
+        Histogram &operator=(const Histogram &) = delete;
+
+        void record(std::uint64_t value) noexcept;
+
+        std::uint64_t count(std::size_t bucket) const noexcept;
+
+        // Number of recorded values
+        std::uint64_t total() const noexcept;
+
+        std::uint64_t sum() const noexcept;
+
+        // Smallest value counted by the bucket
+        static std::uint64_t lower_bound(std::size_t bucket) noexcept;
+
+        static std::size_t bucket(std::uint64_t value) noexcept;
+
+        // Non empty buckets as "lower_bound:count" pairs
+        std::string to_string() const;
+
+    private:
+
+        std::array<std::atomic<std::uint64_t>, bucket_count> m_counts;
+        std::atomic<std::uint64_t> m_sum;
+    };
+}
@@ -14,19 +14,32 @@
 //
 
 
+#include <algorithm>
 #include <string>
 #include <utility>
 #include <vector>
 
+#ifndef _WIN32
+#include <pthread.h>
+#include <signal.h>
+#endif
+
 #include <collie/nlohmann/json.hpp>
 
 #include <dwarf/core/interpreter.h>
+#include <dwarf/core/metrics.h>
+#include <dwarf/core/tracer.h>
 
 namespace nl = nlohmann;
 
 namespace dwarf {
+    namespace {
+        // Token of the execution running on the current thread, if any
+        thread_local const CancellationToken *p_current_cancellation = nullptr;
+    }
+
     Interpreter::Interpreter()
-            : m_execution_count(0) {
+            : m_execution_count(0), m_interrupt_signal(0) {
     }
 
     void Interpreter::configure() {
@@ -38,17 +51,30 @@ namespace dwarf {
                                           bool store_history,
                                           nl::json user_expressions,
                                           bool allow_stdin) {
-        if (!silent) {
-            ++m_execution_count;
-            publish_execution_input(code, m_execution_count);
+        // Subshells may execute several requests at the same time
+        int execution_count = silent ? m_execution_count.load() : ++m_execution_count;
+
+        // Registered before execute_input is published, so that an interrupt
+        // sent upon its reception reaches the execution.
+        execution exec;
+        begin_execution(exec);
+        nl::json reply;
+        try {
+            if (!silent) {
+                publish_execution_input(code, execution_count);
+            }
+            reply = execute_request_impl(
+                    execution_count, code, silent,
+                    store_history, user_expressions, allow_stdin
+            );
         }
+        catch (...) {
+            end_execution(exec);
+            throw;
+        }
+        end_execution(exec);
 
-        nl::json reply = execute_request_impl(
-                m_execution_count, code, silent,
-                store_history, user_expressions, allow_stdin
-        );
-
-        reply["execution_count"] = m_execution_count;
+        reply["execution_count"] = execution_count;
         return reply;
     }
 
@@ -72,10 +98,63 @@ namespace dwarf {
         shutdown_request_impl();
     }
 
+    void Interpreter::interrupt() {
+        std::lock_guard<std::mutex> lock(m_execution_mutex);
+        for (execution *exec: m_executions) {
+            exec->m_cancellation.cancel();
+#ifndef _WIN32
+            if (m_interrupt_signal != 0) {
+                pthread_kill(exec->m_thread, m_interrupt_signal);
+            }
+#endif
+        }
+    }
+
+    const CancellationToken &Interpreter::cancellation_token() const noexcept {
+        return p_current_cancellation != nullptr ? *p_current_cancellation : m_cancellation;
+    }
+
+    bool Interpreter::is_interrupted() const noexcept {
+        return cancellation_token().is_cancelled();
+    }
+
+    void Interpreter::set_interrupt_signal(int signum) {
+        std::lock_guard<std::mutex> lock(m_execution_mutex);
+        m_interrupt_signal = signum;
+    }
+
+    void Interpreter::begin_execution(execution &exec) {
+#ifndef _WIN32
+        exec.m_thread = pthread_self();
+#endif
+        exec.p_previous = p_current_cancellation;
+        p_current_cancellation = &exec.m_cancellation;
+        std::lock_guard<std::mutex> lock(m_execution_mutex);
+        m_executions.push_back(&exec);
+    }
+
+    void Interpreter::end_execution(execution &exec) {
+        {
+            std::lock_guard<std::mutex> lock(m_execution_mutex);
+            m_executions.erase(std::find(m_executions.begin(), m_executions.end(), &exec));
+        }
+        p_current_cancellation = exec.p_previous;
+    }
+
     nl::json Interpreter::internal_request(const nl::json &message) {
+        if (is_metrics_request(message)) {
+            return metrics_reply(message);
+        }
+        if (is_trace_request(message)) {
+            return trace_reply(message);
+        }
         return internal_request_impl(message);
     }
 
+    bool Interpreter::supports_concurrent_requests() const {
+        return supports_concurrent_requests_impl();
+    }
+
     void Interpreter::register_publisher(const publisher_type &publisher) {
         m_publisher = publisher;
     }
@@ -89,23 +168,29 @@ namespace dwarf {
         }
     }
 
-    void Interpreter::display_data(nl::json data, nl::json metadata, nl::json transient) {
+    void Interpreter::display_data(nl::json data,
+                                   nl::json metadata,
+                                   nl::json transient,
+                                   buffer_sequence buffers) {
         if (m_publisher) {
             m_publisher(
                     "display_data",
                     nl::json::object(),
                     build_display_content(std::move(data), std::move(metadata), std::move(transient)),
-                    buffer_sequence());
+                    std::move(buffers));
         }
     }
 
-    void Interpreter::update_display_data(nl::json data, nl::json metadata, nl::json transient) {
+    void Interpreter::update_display_data(nl::json data,
+                                          nl::json metadata,
+                                          nl::json transient,
+                                          buffer_sequence buffers) {
         if (m_publisher) {
             m_publisher(
                     "update_display_data",
                     nl::json::object(),
                     build_display_content(std::move(data), std::move(metadata), std::move(transient)),
-                    buffer_sequence());
+                    std::move(buffers));
         }
     }
 
@@ -211,6 +296,10 @@ namespace dwarf {
         return res;
     }
 
+    bool Interpreter::supports_concurrent_requests_impl() const {
+        return false;
+    }
+
     nl::json Interpreter::build_display_content(nl::json data, nl::json metadata, nl::json transient) {
         nl::json res;
         res["data"] = std::move(data);
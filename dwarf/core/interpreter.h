@@ -16,10 +16,14 @@
 
 #pragma once
 
+#include <atomic>
 #include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include <dwarf/core/cancellation_token.h>
 #include <dwarf/core/comm.h>
 #include <dwarf/core/config.h>
 #include <dwarf/core/control_messenger.h>
@@ -65,8 +69,29 @@ namespace dwarf {
 
         void shutdown_request();
 
+        // Asks the executions in progress to stop: sets their cancellation
+        // tokens, and raises the interrupt signal on their threads if one was
+        // set. Executions started afterwards are not affected. Can be called
+        // from any thread.
+        void interrupt();
+
+        // Token of the execution running on the calling thread, polled by
+        // execute_request_impl. Each execution has its own token.
+        const CancellationToken &cancellation_token() const noexcept;
+
+        bool is_interrupted() const noexcept;
+
+        // {"dwarf_request": "metrics"} and {"dwarf_request": "trace"} are
+        // answered by the kernel with the content of the metrics registry
+        // and of the tracer, see Metrics and Tracer, other messages are
+        // forwarded to internal_request_impl.
         nl::json internal_request(const nl::json &message);
 
+        // When true, complete, inspect, is_complete and kernel_info requests
+        // may be handled on other threads while a cell is executing, and
+        // subshells can be created to execute several cells at once.
+        bool supports_concurrent_requests() const;
+
         // publish(msg_type, metadata, content)
         using publisher_type = std::function<void(const std::string &, nl::json, nl::json, buffer_sequence)>;
 
@@ -74,9 +99,15 @@ namespace dwarf {
 
         void publish_stream(const std::string &name, const std::string &text);
 
-        void display_data(nl::json data, nl::json metadata, nl::json transient);
+        void display_data(nl::json data,
+                          nl::json metadata,
+                          nl::json transient,
+                          buffer_sequence buffers = buffer_sequence());
 
-        void update_display_data(nl::json data, nl::json metadata, nl::json transient);
+        void update_display_data(nl::json data,
+                                 nl::json metadata,
+                                 nl::json transient,
+                                 buffer_sequence buffers = buffer_sequence());
 
         void publish_execution_input(const std::string &code, int execution_count);
 
@@ -123,6 +154,11 @@ namespace dwarf {
 
         ControlMessenger &get_control_messenger();
 
+        // For interpreters that cannot poll the cancellation token: interrupt
+        // raises signum on the executing thread, which must handle it. Not
+        // supported on Windows. 0 disables it.
+        void set_interrupt_signal(int signum);
+
     private:
 
         virtual void configure_impl() = 0;
@@ -149,16 +185,38 @@ namespace dwarf {
 
         virtual nl::json internal_request_impl(const nl::json &message);
 
+        virtual bool supports_concurrent_requests_impl() const;
+
         nl::json build_display_content(nl::json data, nl::json metadata, nl::json transient);
 
+        // Execution in progress, registered from its start to its end so
+        // that interrupt reaches the thread running it.
+        struct execution {
+            CancellationToken m_cancellation;
+            std::thread::native_handle_type m_thread;
+            const CancellationToken *p_previous;
+        };
+
+        void begin_execution(execution &exec);
+
+        void end_execution(execution &exec);
+
         publisher_type m_publisher;
         stdin_sender_type m_stdin;
-        int m_execution_count;
+        std::atomic<int> m_execution_count;
         CommManager *p_comm_manager;
         parent_header_type m_parent_header;
         input_reply_handler_type m_input_reply_handler;
         ControlMessenger *p_messenger;
         const HistoryManager *p_history;
+
+        // Token of the threads that are not executing, never cancelled
+        CancellationToken m_cancellation;
+        int m_interrupt_signal;
+        // Guards the members below, so that no signal is raised on a thread
+        // that is done executing.
+        std::mutex m_execution_mutex;
+        std::vector<execution *> m_executions;
     };
 
     inline CommManager &Interpreter::comm_manager() noexcept {
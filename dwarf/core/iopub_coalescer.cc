@@ -0,0 +1,262 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <utility>
+
+#include <dwarf/core/iopub_coalescer.h>
+
+namespace dwarf {
+    namespace {
+        LazyJson get_parent_header(const PubMessage &msg) {
+            const binary_buffer &raw = msg.raw_parent_header();
+            return raw.empty() ? LazyJson(msg.parent_header()) : LazyJson(raw, decoding_policy::LAZY);
+        }
+    }
+
+    const std::size_t IOPubCoalescer::max_pending_outputs;
+
+    IOPubCoalescer::IOPubCoalescer(publisher_type publisher, stream_builder_type builder)
+            : m_publisher(std::move(publisher)), m_builder(std::move(builder)),
+              m_window(0), m_flush_size(0), m_stop(false), m_pending_bytes(0), m_armed(false),
+              m_envelope_size(0) {
+    }
+
+    IOPubCoalescer::~IOPubCoalescer() {
+        {
+            lock_type lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_one();
+        if (m_flusher.joinable()) {
+            m_flusher.join();
+        }
+    }
+
+    void IOPubCoalescer::configure(std::chrono::milliseconds window, std::size_t flush_size) {
+        lock_type lock(m_mutex);
+        flush_pending(false);
+        m_window = window;
+        m_flush_size = flush_size;
+    }
+
+    void IOPubCoalescer::publish(const std::string &msg_type, PubMessage msg, channel c) {
+        lock_type lock(m_mutex);
+        if (m_window.count() > 0) {
+            output out;
+            out.m_channel = c;
+            bool pending = true;
+            if (msg_type == "stream" || msg_type == "display_data") {
+                out.m_kind = output_kind::DISPLAY;
+                const nl::json &content = msg.content();
+                auto transient = content.find("transient");
+                if (transient != content.end() && transient->is_object()) {
+                    nl::json display_id = transient->value("display_id", nl::json());
+                    if (display_id.is_string()) {
+                        out.m_display_id = display_id.get<std::string>();
+                    }
+                }
+            } else if (msg_type == "clear_output") {
+                out.m_kind = output_kind::CLEAR;
+                out.m_wait = msg.content().value("wait", false);
+            } else if (msg_type == "update_display_data") {
+                out.m_kind = output_kind::UPDATE;
+                const nl::json &content = msg.content();
+                auto transient = content.find("transient");
+                pending = transient != content.end() && transient->is_object()
+                          && transient->value("display_id", nl::json()).is_string();
+                if (pending) {
+                    out.m_display_id = transient->at("display_id").get<std::string>();
+                }
+            } else {
+                pending = false;
+            }
+
+            if (pending) {
+                ++m_stats.m_writes;
+                out.m_parent_header = get_parent_header(msg);
+                out.m_message = std::move(msg);
+                push(std::move(out));
+                return;
+            }
+        }
+        flush_pending(false);
+        m_publisher(std::move(msg), c);
+    }
+
+    void IOPubCoalescer::write_stream(const std::string &name,
+                                      std::string text,
+                                      LazyJson parent_header,
+                                      channel c) {
+        lock_type lock(m_mutex);
+        ++m_stats.m_writes;
+        if (m_window.count() <= 0) {
+            ++m_stats.m_messages;
+            m_publisher(m_builder(name, std::move(text), std::move(parent_header), c), c);
+            return;
+        }
+
+        m_pending_bytes += text.size();
+        if (!m_pending.empty()) {
+            output &last = m_pending.back();
+            if (last.m_kind == output_kind::STREAM && last.m_channel == c && last.m_name == name
+                && same_parent(last.m_parent_header, parent_header)) {
+                last.m_text += text;
+                ++last.m_writes;
+                if (m_pending_bytes >= m_flush_size) {
+                    flush_pending(false);
+                }
+                return;
+            }
+        }
+
+        output out;
+        out.m_kind = output_kind::STREAM;
+        out.m_channel = c;
+        out.m_parent_header = std::move(parent_header);
+        out.m_name = name;
+        out.m_text = std::move(text);
+        out.m_writes = 1;
+        push(std::move(out));
+    }
+
+    void IOPubCoalescer::flush() {
+        lock_type lock(m_mutex);
+        flush_pending(false);
+    }
+
+    auto IOPubCoalescer::stats() const -> stats_type {
+        lock_type lock(m_mutex);
+        return m_stats;
+    }
+
+    bool IOPubCoalescer::same_parent(const LazyJson &lhs, const LazyJson &rhs) {
+        if (!lhs.raw().empty() && !rhs.raw().empty()) {
+            return lhs.raw() == rhs.raw();
+        }
+        return lhs.get() == rhs.get();
+    }
+
+    std::size_t IOPubCoalescer::envelope_size(const PubMessage &msg) {
+        return msg.raw_header().size() + msg.raw_parent_header().size();
+    }
+
+    void IOPubCoalescer::push(output out) {
+        if (out.m_kind == output_kind::UPDATE) {
+            for (output &pending: m_pending) {
+                if (pending.m_kind == output_kind::UPDATE && pending.m_channel == out.m_channel
+                    && pending.m_display_id == out.m_display_id) {
+                    save(1, envelope_size(pending.m_message));
+                    pending.m_parent_header = std::move(out.m_parent_header);
+                    pending.m_message = std::move(out.m_message);
+                    return;
+                }
+            }
+        } else if (out.m_kind == output_kind::CLEAR) {
+            fold_clear(out);
+        }
+
+        m_pending.push_back(std::move(out));
+        if (!m_armed) {
+            m_armed = true;
+            m_deadline = clock_type::now() + m_window;
+            if (!m_flusher.joinable()) {
+                m_flusher = std::thread(&IOPubCoalescer::run_flusher, this);
+            }
+            m_cv.notify_one();
+        }
+
+        if (m_pending_bytes >= m_flush_size || m_pending.size() >= max_pending_outputs) {
+            flush_pending(false);
+        }
+    }
+
+    void IOPubCoalescer::fold_clear(const output &clear) {
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < m_pending.size(); ++i) {
+            output &pending = m_pending[i];
+            // A display with an id is kept, the updates targeting it would
+            // otherwise reach a display the frontend never received
+            if (pending.m_kind != output_kind::UPDATE && pending.m_display_id.empty()
+                && pending.m_channel == clear.m_channel
+                && same_parent(pending.m_parent_header, clear.m_parent_header)) {
+                if (pending.m_kind == output_kind::STREAM) {
+                    m_pending_bytes -= pending.m_text.size();
+                    save(pending.m_writes, pending.m_writes * m_envelope_size);
+                } else {
+                    save(1, envelope_size(pending.m_message));
+                }
+            } else {
+                if (kept != i) {
+                    m_pending[kept] = std::move(pending);
+                }
+                ++kept;
+            }
+        }
+        m_pending.erase(m_pending.begin() + kept, m_pending.end());
+    }
+
+    void IOPubCoalescer::flush_pending(bool hold_clear) {
+        bool hold = hold_clear && !m_pending.empty()
+                    && m_pending.back().m_kind == output_kind::CLEAR && m_pending.back().m_wait;
+        output held;
+        if (hold) {
+            held = std::move(m_pending.back());
+            m_pending.pop_back();
+        }
+
+        std::vector<output> pending;
+        pending.swap(m_pending);
+        m_pending_bytes = 0;
+        m_armed = false;
+        if (hold) {
+            m_pending.push_back(std::move(held));
+        }
+
+        for (output &out: pending) {
+            publish_output(out);
+        }
+    }
+
+    void IOPubCoalescer::publish_output(output &out) {
+        PubMessage msg = out.m_kind == output_kind::STREAM
+                         ? m_builder(out.m_name, std::move(out.m_text), std::move(out.m_parent_header), out.m_channel)
+                         : std::move(out.m_message);
+        m_envelope_size = envelope_size(msg);
+        ++m_stats.m_messages;
+        if (out.m_kind == output_kind::STREAM) {
+            save(out.m_writes - 1, (out.m_writes - 1) * m_envelope_size);
+        }
+        m_publisher(std::move(msg), out.m_channel);
+    }
+
+    void IOPubCoalescer::save(std::size_t count, std::size_t bytes) {
+        m_stats.m_messages_saved += count;
+        m_stats.m_bytes_saved += bytes;
+    }
+
+    void IOPubCoalescer::run_flusher() {
+        lock_type lock(m_mutex);
+        while (!m_stop) {
+            if (!m_armed) {
+                m_cv.wait(lock);
+            } else {
+                m_cv.wait_until(lock, m_deadline);
+                if (m_armed && clock_type::now() >= m_deadline) {
+                    flush_pending(true);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,158 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dwarf/core/config.h>
+#include <dwarf/core/message.h>
+#include <dwarf/core/server.h>
+
+namespace dwarf {
+
+    /**
+     * @class IOPubCoalescer
+     * @brief Merges and folds output messages before they reach IOPub.
+     *
+     * Outputs (stream, display_data, update_display_data and clear_output)
+     * are kept pending for a short time window, during which:
+     * - consecutive stream writes with the same name and parent are appended
+     *   to a single text,
+     * - an update_display_data replaces, in place, the pending update of the
+     *   same display_id,
+     * - a clear_output drops the pending streams, displays and clears of the
+     *   same parent, since the frontend would erase them anyway.
+     *
+     * Pending outputs are flushed when the stream text grows past the size
+     * threshold, when the window elapses, before any other message is
+     * published, or on an explicit call to flush(). A clear_output(wait=True)
+     * left last when the window elapses is held until the next output, so
+     * that both reach the frontend together. All the publications go through
+     * the same lock: the frontend sees the messages in the order of the calls.
+     */
+    class DWARF_API IOPubCoalescer {
+    public:
+
+        using publisher_type = std::function<void(PubMessage, channel)>;
+        using stream_builder_type = std::function<PubMessage(const std::string &name,
+                                                             std::string text,
+                                                             LazyJson parent_header,
+                                                             channel c)>;
+
+        struct stats_type {
+            // Outputs received
+            std::size_t m_writes = 0;
+            // Outputs actually published
+            std::size_t m_messages = 0;
+            // Outputs merged into another one, replaced or dropped
+            std::size_t m_messages_saved = 0;
+            // Estimated header and parent header bytes of the saved outputs
+            std::size_t m_bytes_saved = 0;
+        };
+
+        IOPubCoalescer(publisher_type publisher, stream_builder_type builder);
+
+        ~IOPubCoalescer();
+
+        IOPubCoalescer(const IOPubCoalescer &) = delete;
+
+        IOPubCoalescer &operator=(const IOPubCoalescer &) = delete;
+
+        // A zero window disables the coalescing
+        void configure(std::chrono::milliseconds window, std::size_t flush_size);
+
+        void publish(const std::string &msg_type, PubMessage msg, channel c);
+
+        void write_stream(const std::string &name, std::string text, LazyJson parent_header, channel c);
+
+        void flush();
+
+        stats_type stats() const;
+
+    private:
+
+        using clock_type = std::chrono::steady_clock;
+        using lock_type = std::unique_lock<std::mutex>;
+
+        enum class output_kind {
+            STREAM,
+            DISPLAY,
+            UPDATE,
+            CLEAR
+        };
+
+        struct output {
+            output_kind m_kind = output_kind::DISPLAY;
+            channel m_channel = channel::SHELL;
+            LazyJson m_parent_header;
+            // STREAM only, the message is built on flush
+            std::string m_name;
+            std::string m_text;
+            std::size_t m_writes = 0;
+            // UPDATE, and DISPLAY created with a display_id
+            std::string m_display_id;
+            // CLEAR only
+            bool m_wait = false;
+            PubMessage m_message;
+        };
+
+        static const std::size_t max_pending_outputs = 256;
+
+        static bool same_parent(const LazyJson &lhs, const LazyJson &rhs);
+
+        static std::size_t envelope_size(const PubMessage &msg);
+
+        // The methods below must be called with m_mutex held
+        void push(output out);
+
+        void fold_clear(const output &clear);
+
+        void flush_pending(bool hold_clear);
+
+        void publish_output(output &out);
+
+        void save(std::size_t count, std::size_t bytes);
+
+        void run_flusher();
+
+        publisher_type m_publisher;
+        stream_builder_type m_builder;
+
+        std::chrono::milliseconds m_window;
+        std::size_t m_flush_size;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cv;
+        std::thread m_flusher;
+        bool m_stop;
+
+        std::vector<output> m_pending;
+        std::size_t m_pending_bytes;
+        bool m_armed;
+        clock_type::time_point m_deadline;
+        // Header and parent header size of the last published output
+        std::size_t m_envelope_size;
+
+        stats_type m_stats;
+    };
+}
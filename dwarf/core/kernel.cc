@@ -23,6 +23,7 @@
 #include <dwarf/core/control_messenger.h>
 #include <dwarf/core/kernel_core.h>
 #include <dwarf/core/logger_impl.h>
+#include <dwarf/core/metrics.h>
 
 #if (defined(__linux__) || defined(__unix__))
 #define LINUX_PLATFORM
@@ -119,6 +120,10 @@ namespace dwarf {
             p_logger = std::make_unique<LoggerNolog>();
         }
 
+        if (m_config.m_metrics) {
+            get_metrics().set_enabled(true);
+        }
+
         p_server = sbuilder(*p_context, m_config, m_error_handler);
         p_server->update_config(m_config);
 
@@ -133,6 +138,7 @@ namespace dwarf {
                                               p_history_manager.get(),
                                               p_debugger.get(),
                                               m_error_handler);
+        p_core->configure(m_config);
 
         ControlMessenger &messenger = p_server->get_control_messenger();
 
@@ -16,11 +16,24 @@
 
 #pragma once
 
+#include <cstddef>
+#include <map>
 #include <string>
 
 #include <dwarf/core/config.h>
+#include <dwarf/core/message.h>
 
 namespace dwarf {
+    // Path of the iopub messages: RELAY hands them over to the publisher
+    // thread through an inproc socket, DIRECT sends them on the external
+    // socket from the thread publishing them, QUEUED moves them unserialized
+    // to the publisher thread, which serializes, signs and sends them.
+    enum class iopub_mode {
+        RELAY,
+        DIRECT,
+        QUEUED
+    };
+
     struct DWARF_API Configuration {
         std::string m_transport = "tcp";
         std::string m_ip = "127.0.0.1";
@@ -31,6 +44,57 @@ namespace dwarf {
         std::string m_hb_port;
         std::string m_signature_scheme = "hmac-sha256";
         std::string m_key;
+        // Extends the HMAC signature to the binary buffers (non standard,
+        // the frontend must sign and verify them the same way).
+        bool m_sign_buffers = false;
+        // Decoding of received messages, LAZY defers parsing of everything
+        // but the header until a handler actually reads it: aborted shell
+        // requests then only parse their header, but malformed sections are
+        // only reported by the handler reading them instead of on reception.
+        decoding_policy m_decoding_policy = decoding_policy::EAGER;
+        // Consecutive stream outputs are merged for up to m_iopub_flush_interval
+        // milliseconds or m_iopub_flush_size bytes, 0 publishes every write.
+        // Opt-in: merging delays the outputs and publishes them from a
+        // flusher thread.
+        long m_iopub_flush_interval = 0;
+        std::size_t m_iopub_flush_size = 65536;
+        iopub_mode m_iopub_mode = iopub_mode::RELAY;
+        // Capacity of the publisher queue in QUEUED mode, publishing blocks
+        // while it is full.
+        std::size_t m_iopub_queue_capacity = 1024;
+        // Maximum number of shell and control messages handled per wakeup
+        // of the server polling loop, at least 1.
+        std::size_t m_receive_batch_size = 32;
+        // Capacity of the queue between the thread receiving and decoding
+        // the shell requests and the thread executing them.
+        std::size_t m_ingress_queue_capacity = 1024;
+        // Priority classes of the queued shell requests by msg_type, 0 being
+        // served first. The request at the head of a class is served once it
+        // has been overtaken m_shell_max_overtakes times by other classes.
+        // Opt-in: a request that overtakes an execution sees the state of the
+        // kernel before it, e.g. a complete_request misses the names the cell
+        // defines. By default, the requests are served in reception order.
+        std::map<std::string, std::size_t> m_shell_priorities;
+        std::size_t m_shell_default_priority = 0;
+        std::size_t m_shell_max_overtakes = 16;
+        // After an error with stop_on_error, the shell requests already queued
+        // are aborted, as well as those received within this period (ms).
+        long m_abort_grace_period = 50;
+        // Number of threads handling the read-only shell requests received
+        // while a cell executes, when the interpreter supports it.
+        std::size_t m_concurrent_request_workers = 2;
+        // Complete and inspect requests superseded by a newer one of the same
+        // session and cell before being handled get an empty reply.
+        bool m_coalesce_stale_requests = true;
+        // Records the latency of each stage of the messages and the traffic
+        // of the sockets, see Metrics. When m_metrics_port is set, the
+        // metrics are also served in the Prometheus format on this port of
+        // the loopback interface, over plain HTTP.
+        bool m_metrics = false;
+        std::string m_metrics_port;
+        // When set, every message received or sent by the kernel sockets
+        // is appended to this file, see WireCapture and wire_replay.
+        std::string m_capture_path;
     };
 
     DWARF_API
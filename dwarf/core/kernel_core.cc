@@ -14,21 +14,55 @@
 //
 
 
+#include <chrono>
 #include <cstdlib>
 #include <exception>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <tuple>
 
 #include <collie/nlohmann/json.hpp>
 
+#include <dwarf/core/guid.h>
+#include <dwarf/core/helper.h>
 #include <dwarf/core/kernel_core.h>
 #include <dwarf/core/history_manager.h>
+#include <dwarf/core/metrics.h>
+#include <dwarf/core/tracer.h>
 
 using namespace std::placeholders;
 
 namespace dwarf {
+    thread_local KernelCore::parent_slot *KernelCore::p_subshell_parent = nullptr;
+
+    namespace {
+        // Requests that do not modify the state of the kernel
+        bool is_comm_request(message_kind kind) {
+            return kind == message_kind::comm_open || kind == message_kind::comm_msg ||
+                   kind == message_kind::comm_close;
+        }
+
+        bool is_concurrent_request(message_kind kind) {
+            switch (kind) {
+                case message_kind::complete_request:
+                case message_kind::inspect_request:
+                case message_kind::is_complete_request:
+                case message_kind::history_request:
+                case message_kind::comm_info_request:
+                case message_kind::kernel_info_request:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        metric_socket to_metric_socket(channel c) {
+            return c == channel::SHELL ? metric_socket::SHELL : metric_socket::CONTROL;
+        }
+    }
+
     KernelCore::KernelCore(const std::string &kernel_id,
                            const std::string &user_name,
                            const std::string &session_id,
@@ -39,29 +73,51 @@ namespace dwarf {
                            debugger_ptr debugger,
                            nl::json::error_handler_t eh)
             : m_kernel_id(std::move(kernel_id)), m_user_name(std::move(user_name)), m_session_id(std::move(session_id)),
-              m_comm_manager(this), p_logger(logger), p_server(server), p_interpreter(interpreter),
-              p_history_manager(history_manager), p_debugger(debugger), m_parent_id({guid_list(0), guid_list(0)}),
-              m_parent_header({nl::json::object(), nl::json::object()}), m_error_handler(eh) {
-        // Request handlers
-        m_handler["execute_request"] = &KernelCore::execute_request;
-        m_handler["complete_request"] = &KernelCore::complete_request;
-        m_handler["inspect_request"] = &KernelCore::inspect_request;
-        m_handler["history_request"] = &KernelCore::history_request;
-        m_handler["is_complete_request"] = &KernelCore::is_complete_request;
-        m_handler["comm_info_request"] = &KernelCore::comm_info_request;
-        m_handler["comm_open"] = &KernelCore::comm_open;
-        m_handler["comm_close"] = &KernelCore::comm_close;
-        m_handler["comm_msg"] = &KernelCore::comm_msg;
-        m_handler["kernel_info_request"] = &KernelCore::kernel_info_request;
-        m_handler["shutdown_request"] = &KernelCore::shutdown_request;
-        m_handler["interrupt_request"] = &KernelCore::interrupt_request;
-        m_handler["debug_request"] = &KernelCore::debug_request;
+              m_header_factory(m_user_name, m_session_id), m_comm_manager(this), p_logger(logger), p_server(server),
+              p_interpreter(interpreter), p_history_manager(history_manager), p_debugger(debugger),
+              m_parent(), m_error_handler(eh),
+              m_abort_grace_period(Configuration().m_abort_grace_period), m_executing(0),
+              m_coalesce_stale_requests(Configuration().m_coalesce_stale_requests),
+              m_coalescer([this](PubMessage msg, channel c) {
+                              p_logger->log_iopub_message(msg);
+                              p_server->publish(std::move(msg), c);
+                          },
+                          [this](const std::string &name, std::string text, LazyJson parent_header, channel) {
+                              nl::json content;
+                              content["name"] = name;
+                              content["text"] = std::move(text);
+                              return build_pub_message("stream",
+                                                       std::move(parent_header),
+                                                       nl::json::object(),
+                                                       std::move(content),
+                                                       buffer_sequence());
+                          }) {
+        // Request handlers, indexed by message kind
+        m_handler.fill(nullptr);
+        m_handler[std::size_t(message_kind::execute_request)] = &KernelCore::execute_request;
+        m_handler[std::size_t(message_kind::complete_request)] = &KernelCore::complete_request;
+        m_handler[std::size_t(message_kind::inspect_request)] = &KernelCore::inspect_request;
+        m_handler[std::size_t(message_kind::history_request)] = &KernelCore::history_request;
+        m_handler[std::size_t(message_kind::is_complete_request)] = &KernelCore::is_complete_request;
+        m_handler[std::size_t(message_kind::comm_info_request)] = &KernelCore::comm_info_request;
+        m_handler[std::size_t(message_kind::comm_open)] = &KernelCore::comm_open;
+        m_handler[std::size_t(message_kind::comm_close)] = &KernelCore::comm_close;
+        m_handler[std::size_t(message_kind::comm_msg)] = &KernelCore::comm_msg;
+        m_handler[std::size_t(message_kind::kernel_info_request)] = &KernelCore::kernel_info_request;
+        m_handler[std::size_t(message_kind::shutdown_request)] = &KernelCore::shutdown_request;
+        m_handler[std::size_t(message_kind::interrupt_request)] = &KernelCore::interrupt_request;
+        m_handler[std::size_t(message_kind::debug_request)] = &KernelCore::debug_request;
+        m_handler[std::size_t(message_kind::create_subshell_request)] = &KernelCore::create_subshell_request;
+        m_handler[std::size_t(message_kind::delete_subshell_request)] = &KernelCore::delete_subshell_request;
+        m_handler[std::size_t(message_kind::list_subshell_request)] = &KernelCore::list_subshell_request;
 
         // Server bindings
         p_server->register_shell_listener(std::bind(&KernelCore::dispatch_shell, this, _1));
         p_server->register_control_listener(std::bind(&KernelCore::dispatch_control, this, _1));
         p_server->register_stdin_listener(std::bind(&KernelCore::dispatch_stdin, this, _1));
         p_server->register_internal_listener(std::bind(&KernelCore::dispatch_internal, this, _1));
+        p_server->register_concurrent_shell_listener(std::bind(&KernelCore::dispatch_concurrent_shell, this, _1));
+        p_server->register_discarded_shell_listener(std::bind(&KernelCore::forget_latest, this, _1));
 
         // Interpreter bindings
         p_interpreter->register_publisher([this](const std::string &msg_type,
@@ -76,18 +132,39 @@ namespace dwarf {
         p_interpreter->register_parent_header([this]() -> const nl::json & {
             return this->parent_header(channel::SHELL);
         });
+
+        // Reserved comm target, answers with a single message holding the
+        // metrics and closes the comm
+        m_comm_manager.register_comm_target(metrics_comm_target, [](Comm &&comm, Message request) {
+            const nl::json &content = request.content();
+            nl::json data = content.is_object() ? content.value("data", nl::json::object()) : nl::json::object();
+            comm.send(nl::json::object(), metrics_reply(data), buffer_sequence());
+            comm.close(nl::json::object(), nl::json::object(), buffer_sequence());
+        });
     }
 
     KernelCore::~KernelCore() {
     }
 
+    void KernelCore::configure(const Configuration &config) {
+        m_coalescer.configure(std::chrono::milliseconds(config.m_iopub_flush_interval),
+                              config.m_iopub_flush_size);
+        m_abort_grace_period = config.m_abort_grace_period;
+        m_coalesce_stale_requests = config.m_coalesce_stale_requests;
+        if (p_interpreter->supports_concurrent_requests() && config.m_concurrent_request_workers != 0) {
+            p_workers.reset(new WorkerPool(config.m_concurrent_request_workers));
+        } else {
+            p_workers.reset();
+        }
+    }
+
     PubMessage KernelCore::build_start_msg() const {
         std::string topic = "kernel_core." + m_kernel_id + ".status";
         nl::json content;
         content["execution_state"] = "starting";
 
         PubMessage msg(topic,
-                         make_header("status", m_user_name, m_session_id),
+                         m_header_factory.make_header("status"),
                          nl::json::object(),
                          nl::json::object(),
                          std::move(content),
@@ -127,21 +204,35 @@ namespace dwarf {
                                      nl::json content,
                                      buffer_sequence buffers,
                                      channel c) {
-        PubMessage msg(get_topic(msg_type),
-                         make_header(msg_type, m_user_name, m_session_id),
-                         get_parent_header(c),
-                         std::move(metadata),
-                         std::move(content),
-                         std::move(buffers));
-        p_logger->log_iopub_message(msg);
-        p_server->publish(std::move(msg), c);
+        // Plain stream outputs are merged by the coalescer, the other outputs
+        // are folded by message type
+        if (msg_type == "stream" && metadata.empty() && buffers.empty() && content.size() == 2) {
+            auto name = content.find("name");
+            auto text = content.find("text");
+            if (name != content.end() && name->is_string() && text != content.end() && text->is_string()) {
+                m_coalescer.write_stream(name->get_ref<const std::string &>(),
+                                         std::move(text->get_ref<std::string &>()),
+                                         get_parent_header(c),
+                                         c);
+                return;
+            }
+        }
+        m_coalescer.publish(msg_type,
+                            build_pub_message(msg_type,
+                                              get_parent_header(c),
+                                              std::move(metadata),
+                                              std::move(content),
+                                              std::move(buffers)),
+                            c);
     }
 
     void KernelCore::send_stdin(const std::string &msg_type,
                                 nl::json metadata,
                                 nl::json content) {
+        // The prompt must not overtake the output printed before it
+        m_coalescer.flush();
         Message msg(get_parent_id(channel::SHELL),
-                     make_header(msg_type, m_user_name, m_session_id),
+                     m_header_factory.make_header(msg_type),
                      get_parent_header(channel::SHELL),
                      std::move(metadata),
                      std::move(content),
@@ -163,37 +254,143 @@ namespace dwarf {
     }
 
     const nl::json &KernelCore::parent_header(channel c) const noexcept {
-        return m_parent_header[std::size_t(c)];
+        return get_parent_slot(c).m_header;
+    }
+
+    IOPubCoalescer::stats_type KernelCore::iopub_stats() const {
+        return m_coalescer.stats();
     }
 
     void KernelCore::dispatch(Message msg, channel c) {
+        TraceSpan span("dispatch", msg);
         p_logger->log_received_message(msg, c == channel::SHELL ? Logger::shell : Logger::control);
         const nl::json &header = msg.header();
-        set_parent(msg.identities(), header, c);
-        publish_status("busy", c);
+        set_parent(msg.identities(), header, msg.raw_header(), c);
+        publish_status("busy", get_parent_header(c), c);
 
-        std::string msg_type = header.value("msg_type", "");
-        handler_type handler = get_handler(msg_type);
+        message_kind kind = msg.kind();
+        handler_type handler = get_handler(kind);
         if (handler == nullptr) {
             std::cerr << "ERROR: received unknown message" << std::endl;
-            std::cerr << "Message type: " << msg_type << std::endl;
+            std::cerr << "Message type: " << msg.msg_type() << std::endl;
         } else {
             try {
+                MetricsTimer timer(metric_stage::handler, to_metric_socket(c), kind);
                 (this->*handler)(std::move(msg), c);
             }
             catch (std::exception &e) {
                 std::cerr << "ERROR: received bad message: " << e.what() << std::endl;
-                std::cerr << "Message type: " << msg_type << std::endl;
+                std::cerr << "Message type: " << to_string(kind) << std::endl;
             }
         }
 
-        publish_status("idle", c);
+        publish_status("idle", get_parent_header(c), c);
     }
 
-    auto KernelCore::get_handler(const std::string &msg_type) -> handler_type {
-        auto iter = m_handler.find(msg_type);
-        handler_type res = (iter == m_handler.end()) ? nullptr : iter->second;
-        return res;
+    bool KernelCore::dispatch_concurrent_shell(Message &msg) {
+        if (m_coalesce_stale_requests) {
+            std::string key = get_stale_key(msg);
+            if (!key.empty()) {
+                std::lock_guard<std::mutex> lock(m_latest_mutex);
+                m_latest_requests[key] = msg.header().value("msg_id", "");
+            }
+        }
+
+        // Comm traffic stays on the main shell, so that the handlers of a
+        // comm never run concurrently.
+        auto subshell_id = msg.header().find("subshell_id");
+        if (subshell_id != msg.header().end() && subshell_id->is_string() && !is_comm_request(msg.kind())) {
+            std::lock_guard<std::mutex> lock(m_subshell_mutex);
+            auto iter = m_subshells.find(subshell_id->get<std::string>());
+            if (iter != m_subshells.end()) {
+                auto request = std::make_shared<Message>(std::move(msg));
+                iter->second->m_thread.post([this, request]() { dispatch(std::move(*request), channel::SHELL); });
+                return true;
+            }
+            // Unknown subshells fall back to the main shell
+        }
+
+        if (p_workers == nullptr || m_executing.load() == 0) {
+            return false;
+        }
+        if (!is_concurrent_request(msg.kind())) {
+            return false;
+        }
+        auto request = std::make_shared<Message>(std::move(msg));
+        p_workers->post([this, request]() { dispatch_concurrent(std::move(*request)); });
+        return true;
+    }
+
+    void KernelCore::dispatch_concurrent(Message msg) {
+        // Same as dispatch, except that the parent of the channel is left to
+        // the request being executed.
+        TraceSpan span("dispatch", msg);
+        p_logger->log_received_message(msg, Logger::shell);
+        LazyJson parent_header = get_parent_header(msg);
+        publish_status("busy", parent_header, channel::SHELL);
+
+        message_kind kind = msg.kind();
+        try {
+            MetricsTimer timer(metric_stage::handler, metric_socket::SHELL, kind);
+            (this->*get_handler(kind))(std::move(msg), channel::SHELL);
+        }
+        catch (std::exception &e) {
+            std::cerr << "ERROR: received bad message: " << e.what() << std::endl;
+            std::cerr << "Message type: " << to_string(kind) << std::endl;
+        }
+
+        publish_status("idle", std::move(parent_header), channel::SHELL);
+    }
+
+    std::string KernelCore::get_stale_key(const Message &msg) {
+        message_kind kind = msg.kind();
+        if (kind != message_kind::complete_request && kind != message_kind::inspect_request) {
+            return std::string();
+        }
+        // Frontends that do not send the cell id share one key per session
+        auto cell_id = msg.metadata().find("cellId");
+        std::string key = to_string(kind) + '/' + msg.header().value("session", "");
+        if (cell_id != msg.metadata().end() && cell_id->is_string()) {
+            key += '/' + cell_id->get<std::string>();
+        }
+        return key;
+    }
+
+    bool KernelCore::is_superseded(const Message &request) {
+        if (!m_coalesce_stale_requests) {
+            return false;
+        }
+        std::string key = get_stale_key(request);
+        std::lock_guard<std::mutex> lock(m_latest_mutex);
+        auto iter = m_latest_requests.find(key);
+        if (iter == m_latest_requests.end()) {
+            return false;
+        }
+        if (iter->second == request.header().value("msg_id", "")) {
+            // Latest request of its key, nothing left to supersede
+            m_latest_requests.erase(iter);
+            return false;
+        }
+        return true;
+    }
+
+    void KernelCore::forget_latest(const Message &request) {
+        if (!m_coalesce_stale_requests) {
+            return;
+        }
+        std::string key = get_stale_key(request);
+        if (key.empty()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_latest_mutex);
+        auto iter = m_latest_requests.find(key);
+        if (iter != m_latest_requests.end() && iter->second == request.header().value("msg_id", "")) {
+            m_latest_requests.erase(iter);
+        }
+    }
+
+    auto KernelCore::get_handler(message_kind kind) const -> handler_type {
+        return m_handler[std::size_t(kind)];
     }
 
     void KernelCore::execute_request(Message request, channel c) {
@@ -205,24 +402,38 @@ namespace dwarf {
             int execution_count = content.value("execution_count", 1);
             store_history = store_history && !silent;
             nl::json user_expression = content.value("user_expressions", nl::json::object());
-            bool allow_stdin = content.value("allow_stdin", true);
+            // Subshells share the stdin channel and input handler of the main
+            // shell, so only the main shell can request input.
+            bool allow_stdin = content.value("allow_stdin", true) && p_subshell_parent == nullptr;
             bool stop_on_error = content.value("stop_on_error", false);
 
             nl::json metadata = get_metadata();
 
-            nl::json reply = p_interpreter->execute_request(
-                    code, silent, store_history, std::move(user_expression), allow_stdin);
+            ++m_executing;
+            nl::json reply;
+            try {
+                MetricsTimer timer(metric_stage::interpreter, to_metric_socket(c), message_kind::execute_request);
+                reply = p_interpreter->execute_request(
+                        code, silent, store_history, std::move(user_expression), allow_stdin);
+            }
+            catch (...) {
+                --m_executing;
+                throw;
+            }
+            --m_executing;
 
             std::string status = reply.value("status", "error");
             send_reply("execute_reply", std::move(metadata), std::move(reply), c);
 
             if (!silent && store_history) {
+                std::lock_guard<std::mutex> lock(m_history_mutex);
                 p_history_manager->store_inputs(0, execution_count, code);
             }
 
-            if (!silent && status == "error" && stop_on_error) {
-                long polling_interval = 50;
-                p_server->abort_queue(std::bind(&KernelCore::abort_request, this, _1), 50);
+            // The queue of a subshell is not aborted, only the main shell
+            // queue has a consumer that can drain it.
+            if (!silent && status == "error" && stop_on_error && p_subshell_parent == nullptr) {
+                p_server->abort_queue(std::bind(&KernelCore::abort_request, this, _1), m_abort_grace_period);
             }
         }
         catch (std::exception &e) {
@@ -236,8 +447,14 @@ namespace dwarf {
         std::string code = content.value("code", "");
         int cursor_pos = content.value("cursor_pos", -1);
 
-        nl::json reply = p_interpreter->complete_request(code, cursor_pos);
-        send_reply("complete_reply", nl::json::object(), std::move(reply), c);
+        nl::json reply;
+        if (is_superseded(request)) {
+            reply = create_complete_reply(nl::json::array(), cursor_pos, cursor_pos);
+        } else {
+            MetricsTimer timer(metric_stage::interpreter, to_metric_socket(c), message_kind::complete_request);
+            reply = p_interpreter->complete_request(code, cursor_pos);
+        }
+        send_reply(request, "complete_reply", nl::json::object(), std::move(reply), c);
     }
 
     void KernelCore::inspect_request(Message request, channel c) {
@@ -246,48 +463,58 @@ namespace dwarf {
         int cursor_pos = content.value("cursor_pos", -1);
         int detail_level = content.value("detail_level", 0);
 
-        nl::json reply = p_interpreter->inspect_request(code, cursor_pos, detail_level);
-        send_reply("inspect_reply", nl::json::object(), std::move(reply), c);
+        nl::json reply;
+        if (is_superseded(request)) {
+            reply = create_inspect_reply();
+        } else {
+            MetricsTimer timer(metric_stage::interpreter, to_metric_socket(c), message_kind::inspect_request);
+            reply = p_interpreter->inspect_request(code, cursor_pos, detail_level);
+        }
+        send_reply(request, "inspect_reply", nl::json::object(), std::move(reply), c);
     }
 
     void KernelCore::history_request(Message request, channel c) {
         const nl::json &content = request.content();
 
-        nl::json history = p_history_manager->process_request(content);
+        nl::json history;
+        {
+            std::lock_guard<std::mutex> lock(m_history_mutex);
+            history = p_history_manager->process_request(content);
+        }
 
-        send_reply("history_reply", nl::json::object(), std::move(history), c);
+        send_reply(request, "history_reply", nl::json::object(), std::move(history), c);
     }
 
     void KernelCore::is_complete_request(Message request, channel c) {
         const nl::json &content = request.content();
         std::string code = content.value("code", "");
 
-        nl::json reply = p_interpreter->is_complete_request(code);
-        send_reply("is_complete_reply", nl::json::object(), std::move(reply), c);
+        nl::json reply;
+        {
+            MetricsTimer timer(metric_stage::interpreter, to_metric_socket(c), message_kind::is_complete_request);
+            reply = p_interpreter->is_complete_request(code);
+        }
+        send_reply(request, "is_complete_reply", nl::json::object(), std::move(reply), c);
     }
 
     void KernelCore::comm_info_request(Message request, channel c) {
         const nl::json &content = request.content();
         std::string target_name = content.is_null() ? "" : content.value("target_name", "");
-        auto comms = nl::json::object();
-        for (auto it = m_comm_manager.comms().cbegin(); it != m_comm_manager.comms().cend(); ++it) {
-            const std::string &name = it->second->target().name();
-            if (target_name.empty() || name == target_name) {
-                nl::json info;
-                info["target_name"] = name;
-                comms[it->first] = std::move(info);
-            }
-        }
-        nl::json reply;
-        reply["comms"] = comms;
-        reply["status"] = "ok";
-        send_reply("comm_info_reply", nl::json::object(), std::move(reply), c);
+        nl::json reply = m_comm_manager.comm_info(target_name);
+        send_reply(request, "comm_info_reply", nl::json::object(), std::move(reply), c);
     }
 
-    void KernelCore::kernel_info_request(Message /* request */, channel c) {
-        nl::json reply = p_interpreter->kernel_info_request();
+    void KernelCore::kernel_info_request(Message request, channel c) {
+        nl::json reply;
+        {
+            MetricsTimer timer(metric_stage::interpreter, to_metric_socket(c), message_kind::kernel_info_request);
+            reply = p_interpreter->kernel_info_request();
+        }
         reply["protocol_version"] = get_protocol_version();
-        send_reply("kernel_info_reply", nl::json::object(), std::move(reply), c);
+        if (p_interpreter->supports_concurrent_requests()) {
+            reply["supported_features"].push_back("kernel subshells");
+        }
+        send_reply(request, "kernel_info_reply", nl::json::object(), std::move(reply), c);
     }
 
     void KernelCore::shutdown_request(Message request, channel c) {
@@ -302,6 +529,9 @@ namespace dwarf {
     }
 
     void KernelCore::interrupt_request(Message, channel c) {
+        // With the split server, runs on the control thread while the shell
+        // thread executes the cell.
+        p_interpreter->interrupt();
         nl::json reply = nl::json::object();
         publish_message("interrupt", nl::json::object(), nl::json(reply), buffer_sequence(), channel::CONTROL);
         send_reply("interrupt_reply", nl::json::object(), std::move(reply), c);
@@ -315,10 +545,16 @@ namespace dwarf {
         }
     }
 
-    void KernelCore::publish_status(const std::string &status, channel c) {
+    void KernelCore::publish_status(const std::string &status, LazyJson parent_header, channel c) {
         nl::json content;
         content["execution_state"] = status;
-        publish_message("status", nl::json::object(), std::move(content), buffer_sequence(), c);
+        m_coalescer.publish("status",
+                            build_pub_message("status",
+                                              std::move(parent_header),
+                                              nl::json::object(),
+                                              std::move(content),
+                                              buffer_sequence()),
+                            c);
     }
 
     void KernelCore::publish_execute_input(const std::string &code,
@@ -345,14 +581,29 @@ namespace dwarf {
                    c);
     }
 
+    void KernelCore::send_reply(const Message &request,
+                                const std::string &reply_type,
+                                nl::json metadata,
+                                nl::json reply_content,
+                                channel c) {
+        send_reply(request.identities(),
+                   reply_type,
+                   get_parent_header(request),
+                   std::move(metadata),
+                   std::move(reply_content),
+                   c);
+    }
+
     void KernelCore::send_reply(const guid_list &id_list,
                                 const std::string &reply_type,
-                                nl::json parent_header,
+                                LazyJson parent_header,
                                 nl::json metadata,
                                 nl::json reply_content,
                                 channel c) {
+        // Outputs of a request are published before its reply
+        m_coalescer.flush();
         Message reply(id_list,
-                       make_header(reply_type, m_user_name, m_session_id),
+                       m_header_factory.make_header(reply_type),
                        std::move(parent_header),
                        std::move(metadata),
                        std::move(reply_content),
@@ -366,15 +617,19 @@ namespace dwarf {
     }
 
     void KernelCore::abort_request(Message msg) {
-        const nl::json &header = msg.header();
-        std::string msg_type = header.value("msg_type", "");
-        // replace "_request" part of message type by "_reply"
-        msg_type.replace(msg_type.find_last_of('_'), 8, "_reply");
+        forget_latest(msg);
+        message_kind kind = reply_kind(msg.kind());
+        std::string msg_type = to_string(kind);
+        if (kind == message_kind::unknown) {
+            // replace "_request" part of message type by "_reply"
+            msg_type = msg.msg_type();
+            msg_type.replace(msg_type.find_last_of('_'), 8, "_reply");
+        }
         nl::json content;
         content["status"] = "error";
         send_reply(msg.identities(),
                    msg_type,
-                   nl::json(header),
+                   get_parent_header(msg),
                    nl::json::object(),
                    std::move(content),
                    channel::SHELL);
@@ -392,18 +647,124 @@ namespace dwarf {
 
     void KernelCore::set_parent(const guid_list &parent_id,
                                 const nl::json &parent_header,
+                                const binary_buffer &raw_parent_header,
                                 channel c) {
-        auto idx = static_cast<std::size_t>(c);
-        m_parent_id[idx] = parent_id;
-        m_parent_header[idx] = parent_header;
+        parent_slot &slot = get_parent_slot(c);
+        slot.m_id = parent_id;
+        slot.m_header = parent_header;
+        // Reuse the received frame when there is one, so that the parent
+        // header is never serialized again for this request.
+        slot.m_raw_header = raw_parent_header.empty()
+                            ? binary_buffer(parent_header.dump(-1, ' ', false, m_error_handler))
+                            : raw_parent_header;
+    }
+
+    PubMessage KernelCore::build_pub_message(const std::string &msg_type,
+                                             LazyJson parent_header,
+                                             nl::json metadata,
+                                             nl::json content,
+                                             buffer_sequence buffers) const {
+        return PubMessage(get_topic(msg_type),
+                          m_header_factory.make_header(msg_type),
+                          std::move(parent_header),
+                          std::move(metadata),
+                          std::move(content),
+                          std::move(buffers));
+    }
+
+    auto KernelCore::get_parent_slot(channel c) -> parent_slot & {
+        if (c == channel::SHELL && p_subshell_parent != nullptr) {
+            return *p_subshell_parent;
+        }
+        return m_parent[std::size_t(c)];
+    }
+
+    auto KernelCore::get_parent_slot(channel c) const -> const parent_slot & {
+        if (c == channel::SHELL && p_subshell_parent != nullptr) {
+            return *p_subshell_parent;
+        }
+        return m_parent[std::size_t(c)];
     }
 
     const KernelCore::guid_list &KernelCore::get_parent_id(channel c) const {
-        return m_parent_id[std::size_t(c)];
+        return get_parent_slot(c).m_id;
+    }
+
+    LazyJson KernelCore::get_parent_header(channel c) const {
+        const parent_slot &slot = get_parent_slot(c);
+        if (slot.m_raw_header.empty()) {
+            return LazyJson(slot.m_header);
+        }
+        return LazyJson(slot.m_raw_header, decoding_policy::LAZY);
+    }
+
+    LazyJson KernelCore::get_parent_header(const Message &msg) {
+        return msg.raw_header().empty()
+               ? LazyJson(msg.header())
+               : LazyJson(msg.raw_header(), decoding_policy::LAZY);
+    }
+
+    void KernelCore::create_subshell_request(Message request, channel c) {
+        nl::json reply;
+        if (!p_interpreter->supports_concurrent_requests()) {
+            reply["status"] = "error";
+            reply["ename"] = "SubshellError";
+            reply["evalue"] = "the interpreter does not support subshells";
+            reply["traceback"] = nl::json::array();
+        } else {
+            std::string subshell_id = std::string(new_guid());
+            subshell_ptr sub(new subshell());
+            parent_slot *slot = &sub->m_parent;
+            sub->m_thread.post([slot]() { p_subshell_parent = slot; });
+            {
+                std::lock_guard<std::mutex> lock(m_subshell_mutex);
+                m_subshells[subshell_id] = std::move(sub);
+            }
+            reply["subshell_id"] = subshell_id;
+            reply["status"] = "ok";
+        }
+        send_reply(request, "create_subshell_reply", nl::json::object(), std::move(reply), c);
+    }
+
+    void KernelCore::delete_subshell_request(Message request, channel c) {
+        const nl::json &content = request.content();
+        std::string subshell_id = content.value("subshell_id", "");
+        subshell_ptr sub;
+        {
+            std::lock_guard<std::mutex> lock(m_subshell_mutex);
+            auto iter = m_subshells.find(subshell_id);
+            if (iter != m_subshells.end()) {
+                sub = std::move(iter->second);
+                m_subshells.erase(iter);
+            }
+        }
+
+        nl::json reply;
+        if (sub == nullptr) {
+            reply["status"] = "error";
+            reply["ename"] = "SubshellError";
+            reply["evalue"] = "no subshell with id " + subshell_id;
+            reply["traceback"] = nl::json::array();
+        } else {
+            // Waits for the requests already routed to the subshell
+            sub.reset();
+            reply["status"] = "ok";
+        }
+        send_reply(request, "delete_subshell_reply", nl::json::object(), std::move(reply), c);
     }
 
-    nl::json KernelCore::get_parent_header(channel c) const {
-        return m_parent_header[std::size_t(c)];
+    void KernelCore::list_subshell_request(Message request, channel c) {
+        nl::json ids = nl::json::array();
+        {
+            std::lock_guard<std::mutex> lock(m_subshell_mutex);
+            for (const auto &sub: m_subshells) {
+                ids.push_back(sub.first);
+            }
+        }
+        nl::json reply;
+        reply["subshell_id"] = std::move(ids);
+        reply["status"] = "ok";
+        send_reply(request, "list_subshell_reply", nl::json::object(), std::move(reply), c);
     }
 
     void KernelCore::comm_open(Message request, channel) {
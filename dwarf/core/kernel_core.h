@@ -16,7 +16,11 @@
 
 #pragma once
 
+#include <atomic>
+#include <array>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 
 #include <collie/nlohmann/json.hpp>
@@ -26,8 +30,11 @@
 #include <dwarf/core/interpreter.h>
 #include <dwarf/core/history_manager.h>
 #include <dwarf/core/debugger.h>
+#include <dwarf/core/header_factory.h>
+#include <dwarf/core/iopub_coalescer.h>
 #include <dwarf/core/message.h>
 #include <dwarf/core/logger.h>
+#include <dwarf/core/worker_pool.h>
 
 namespace nl = nlohmann;
 
@@ -53,6 +60,8 @@ namespace dwarf {
 
         ~KernelCore();
 
+        void configure(const Configuration &config);
+
         PubMessage build_start_msg() const;
 
         void dispatch_shell(Message msg);
@@ -79,14 +88,54 @@ namespace dwarf {
 
         const nl::json &parent_header(channel c) const noexcept;
 
+        IOPubCoalescer::stats_type iopub_stats() const;
+
     private:
 
         using handler_type = void (KernelCore::*)(Message, channel);
         using guid_list = Message::guid_list;
 
+        // Request being handled on a channel, or by a subshell
+        struct parent_slot {
+            guid_list m_id;
+            nl::json m_header = nl::json::object();
+            // Serialized form of m_header, shared by all the messages sent
+            // on behalf of the request.
+            binary_buffer m_raw_header;
+        };
+
+        // Execution lane with its own thread and request queue, sharing the
+        // interpreter with the main shell.
+        struct subshell {
+            parent_slot m_parent;
+            // Destroyed first: runs the queued requests, then joins
+            WorkerPool m_thread{1};
+        };
+
+        using subshell_ptr = std::unique_ptr<subshell>;
+
         void dispatch(Message msg, channel c);
 
-        handler_type get_handler(const std::string &msg_type);
+        // Hands the shell requests with a subshell_id, except comm messages,
+        // over to their subshell, and the read-only ones received during an execution over to the
+        // worker pool, see Interpreter::supports_concurrent_requests
+        bool dispatch_concurrent_shell(Message &msg);
+
+        void dispatch_concurrent(Message msg);
+
+        // Key shared by the complete or inspect requests that supersede each
+        // other, empty for the other requests
+        static std::string get_stale_key(const Message &msg);
+
+        // True when a newer request with the same key has been received
+        bool is_superseded(const Message &request);
+
+        // Forgets the key of a request that will not be handled, if it is
+        // the latest request of its key
+        void forget_latest(const Message &request);
+
+        // nullptr for unknown kinds
+        handler_type get_handler(message_kind kind) const;
 
         void execute_request(Message request, channel c);
 
@@ -114,7 +163,13 @@ namespace dwarf {
 
         void debug_request(Message request, channel c);
 
-        void publish_status(const std::string &status, channel c);
+        void create_subshell_request(Message request, channel c);
+
+        void delete_subshell_request(Message request, channel c);
+
+        void list_subshell_request(Message request, channel c);
+
+        void publish_status(const std::string &status, LazyJson parent_header, channel c);
 
         void publish_execute_input(const std::string &code, int execution_count);
 
@@ -123,9 +178,17 @@ namespace dwarf {
                         nl::json reply_content,
                         channel c);
 
+        // Replies to request with its own identities and header rather than
+        // those of the current request of the channel.
+        void send_reply(const Message &request,
+                        const std::string &reply_type,
+                        nl::json metadata,
+                        nl::json reply_content,
+                        channel c);
+
         void send_reply(const guid_list &id_list,
                         const std::string &reply_type,
-                        nl::json parent_header,
+                        LazyJson parent_header,
                         nl::json metadata,
                         nl::json reply_content,
                         channel c);
@@ -136,17 +199,33 @@ namespace dwarf {
 
         nl::json get_metadata() const;
 
-        void set_parent(const guid_list &list, const nl::json &parent, channel c);
+        void set_parent(const guid_list &list,
+                        const nl::json &parent,
+                        const binary_buffer &raw_parent,
+                        channel c);
+
+        parent_slot &get_parent_slot(channel c);
+
+        const parent_slot &get_parent_slot(channel c) const;
 
         const guid_list &get_parent_id(channel c) const;
 
-        nl::json get_parent_header(channel c) const;
+        LazyJson get_parent_header(channel c) const;
+
+        static LazyJson get_parent_header(const Message &msg);
+
+        PubMessage build_pub_message(const std::string &msg_type,
+                                     LazyJson parent_header,
+                                     nl::json metadata,
+                                     nl::json content,
+                                     buffer_sequence buffers) const;
 
         std::string m_kernel_id;
         std::string m_user_name;
         std::string m_session_id;
+        HeaderFactory m_header_factory;
 
-        std::map<std::string, handler_type> m_handler;
+        std::array<handler_type, message_kind_count> m_handler;
         CommManager m_comm_manager;
         logger_ptr p_logger;
         server_ptr p_server;
@@ -154,9 +233,29 @@ namespace dwarf {
         history_manager_ptr p_history_manager;
         debugger_ptr p_debugger;
 
-        std::array<guid_list, 2> m_parent_id;
-        std::array<nl::json, 2> m_parent_header;
+        std::array<parent_slot, 2> m_parent;
+        // Slot of the subshell running on the current thread, if any. It
+        // replaces the shell slot of m_parent on that thread.
+        static thread_local parent_slot *p_subshell_parent;
 
         nl::json::error_handler_t m_error_handler;
+        long m_abort_grace_period;
+
+        // Number of execute_request in progress, on all the subshells
+        std::atomic<int> m_executing;
+        std::mutex m_history_mutex;
+
+        bool m_coalesce_stale_requests;
+        // msg_id of the last complete or inspect request received per key
+        std::map<std::string, std::string> m_latest_requests;
+        std::mutex m_latest_mutex;
+
+        // Its flusher thread publishes through p_server and p_logger
+        IOPubCoalescer m_coalescer;
+        // Its tasks publish through m_coalescer
+        std::unique_ptr<WorkerPool> p_workers;
+        std::mutex m_subshell_mutex;
+        // Last member: the subshells dispatch through all the above
+        std::map<std::string, subshell_ptr> m_subshells;
     };
 }
\ No newline at end of file
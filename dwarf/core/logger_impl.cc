@@ -124,7 +124,7 @@ namespace dwarf
     
     void LoggerCommon::log_received_message_impl(const Message& message, Logger::channel c) const
     {
-        std::string id = message.identities()[0];
+        std::string id = message.identities()[0].to_string();
         std::string socket_info = "DWARF: received message on "
                                 + channel_str[c] + " - "
                                 + (is_utf8_valid(id) ? id : "invalid UTF8");
@@ -137,7 +137,7 @@ namespace dwarf
 
     void LoggerCommon::log_sent_message_impl(const Message& message, Logger::channel c) const
     {
-        std::string id = message.identities()[0];
+        std::string id = message.identities()[0].to_string();
         std::string socket_info = "DWARF: sent message on "
                                 + channel_str[c] + " - "
                                 + (is_utf8_valid(id) ? id : "invalid UTF8");
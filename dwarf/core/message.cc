@@ -15,10 +15,9 @@
 
 
 #include <chrono>
+#include <ctime>
 #include <cstddef>
-#include <iomanip>
 #include <stdexcept>
-#include <sstream>
 #include <string>
 #include <utility>
 
@@ -31,8 +30,46 @@ namespace nl = nlohmann;
 
 namespace dwarf
 {
+    LazyJson::LazyJson(nl::json value)
+        : m_raw()
+        , m_value(std::move(value))
+        , m_decoded(true)
+    {
+    }
+
+    LazyJson::LazyJson(binary_buffer raw, decoding_policy policy)
+        : m_raw(std::move(raw))
+        , m_value()
+        , m_decoded(false)
+    {
+        if (policy == decoding_policy::EAGER)
+        {
+            get();
+        }
+    }
+
+    const nl::json& LazyJson::get() const
+    {
+        if (!m_decoded)
+        {
+            m_value = nl::json::parse(m_raw.begin(), m_raw.end());
+            m_decoded = true;
+        }
+        return m_value;
+    }
+
+    const binary_buffer& LazyJson::raw() const noexcept
+    {
+        return m_raw;
+    }
+
+    bool LazyJson::is_decoded() const noexcept
+    {
+        return m_decoded;
+    }
+
     MessageBase::MessageBase(
-        nl::json header, nl::json parent_header, nl::json metadata, nl::json content, buffer_sequence buffers)
+        LazyJson header, LazyJson parent_header, nl::json metadata, nl::json content, buffer_sequence buffers)
         : m_header(std::move(header))
         , m_parent_header(std::move(parent_header))
         , m_metadata(std::move(metadata))
@@ -41,24 +78,58 @@ namespace dwarf
     {
     }
 
+    MessageBase::MessageBase(MessageBaseData&& data)
+        : m_header(std::move(data.m_header))
+        , m_parent_header(std::move(data.m_parent_header))
+        , m_metadata(std::move(data.m_metadata))
+        , m_content(std::move(data.m_content))
+        , m_buffers(std::move(data.m_buffers))
+    {
+        // Received headers are already decoded
+        if (m_header.is_decoded())
+        {
+            resolve_kind();
+        }
+    }
+
     const nl::json& MessageBase::header() const
     {
-        return m_header;
+        return m_header.get();
     }
 
     const nl::json& MessageBase::parent_header() const
     {
-        return m_parent_header;
+        return m_parent_header.get();
     }
 
     const nl::json& MessageBase::metadata() const
     {
-        return m_metadata;
+        return m_metadata.get();
     }
 
     const nl::json& MessageBase::content() const
     {
-        return m_content;
+        return m_content.get();
+    }
+
+    const binary_buffer& MessageBase::raw_header() const noexcept
+    {
+        return m_header.raw();
+    }
+
+    const binary_buffer& MessageBase::raw_parent_header() const noexcept
+    {
+        return m_parent_header.raw();
+    }
+
+    const binary_buffer& MessageBase::raw_metadata() const noexcept
+    {
+        return m_metadata.raw();
+    }
+
+    const binary_buffer& MessageBase::raw_content() const noexcept
+    {
+        return m_content.raw();
     }
 
     const buffer_sequence& MessageBase::buffers() const &
@@ -70,10 +141,41 @@ namespace dwarf
     {
         return std::move(m_buffers);
     }
+
+    message_kind MessageBase::kind() const
+    {
+        if (!m_kind_resolved)
+        {
+            resolve_kind();
+        }
+        return m_kind;
+    }
+
+    const std::string& MessageBase::msg_type() const
+    {
+        static const std::string empty;
+        message_kind k = kind();
+        if (k != message_kind::unknown)
+        {
+            return to_string(k);
+        }
+        auto iter = header().find("msg_type");
+        return iter != header().end() && iter->is_string() ? iter->get_ref<const std::string&>() : empty;
+    }
+
+    void MessageBase::resolve_kind() const
+    {
+        auto iter = header().find("msg_type");
+        if (iter != header().end() && iter->is_string())
+        {
+            m_kind = to_message_kind(iter->get_ref<const std::string&>());
+        }
+        m_kind_resolved = true;
+    }
     
-    Message::Message(const guid_list& zmq_id,
-                       nl::json header,
-                       nl::json parent_header,
+    Message::Message(guid_list zmq_id,
+                       LazyJson header,
+                       LazyJson parent_header,
                        nl::json metadata,
                        nl::json content,
                        buffer_sequence buffers)
@@ -82,18 +184,14 @@ namespace dwarf
                         std::move(metadata),
                         std::move(content),
                         std::move(buffers))
-        , m_zmq_id(zmq_id)
+        , m_zmq_id(std::move(zmq_id))
     {
     }
 
-    Message::Message(const guid_list& zmq_id,
+    Message::Message(guid_list zmq_id,
                        MessageBaseData&& data)
-        : MessageBase(std::move(data.m_header),
-                        std::move(data.m_parent_header),
-                        std::move(data.m_metadata),
-                        std::move(data.m_content),
-                        std::move(data.m_buffers))
-        , m_zmq_id(zmq_id)
+        : MessageBase(std::move(data))
+        , m_zmq_id(std::move(zmq_id))
     {
     }
 
@@ -103,8 +201,8 @@ namespace dwarf
     }
 
     PubMessage::PubMessage(const std::string& topic,
-                               nl::json header,
-                               nl::json parent_header,
+                               LazyJson header,
+                               LazyJson parent_header,
                                nl::json metadata,
                                nl::json content,
                                buffer_sequence buffers)
@@ -119,11 +217,7 @@ namespace dwarf
 
     PubMessage::PubMessage(const std::string& topic,
                                MessageBaseData&& data)
-        : MessageBase(std::move(data.m_header),
-                        std::move(data.m_parent_header),
-                        std::move(data.m_metadata),
-                        std::move(data.m_content),
-                        std::move(data.m_buffers))
+        : MessageBase(std::move(data))
         , m_topic(topic)
     {
     }
@@ -133,23 +227,66 @@ namespace dwarf
         return m_topic;
     }
 
-    std::string iso8601_now()
+    namespace
+    {
+        // The date and time down to the second only change once per second,
+        // each thread keeps them formatted.
+        struct iso8601_seconds_cache
+        {
+            std::time_t m_seconds = static_cast<std::time_t>(-1);
+            char m_prefix[32] = {};
+            std::size_t m_size = 0;
+
+            void update(std::time_t seconds)
+            {
+                std::tm utc;
+#ifdef _WIN32
+                gmtime_s(&utc, &seconds);
+#else
+                gmtime_r(&seconds, &utc);
+#endif
+                m_size = std::strftime(m_prefix, sizeof(m_prefix), "%Y-%m-%dT%H:%M:%S", &utc);
+                m_seconds = seconds;
+            }
+        };
+    }
+
+    void append_iso8601_now(std::string& out)
     {
-        std::ostringstream ss;
+        thread_local iso8601_seconds_cache cache;
+
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        auto seconds = micros / 1000000;
+        auto fractionals = micros % 1000000;
+        if (fractionals < 0)
+        {
+            fractionals += 1000000;
+            seconds -= 1;
+        }
 
-        // now
-        auto now = std::chrono::system_clock::now();
+        if (static_cast<std::time_t>(seconds) != cache.m_seconds)
+        {
+            cache.update(static_cast<std::time_t>(seconds));
+        }
 
-        // down to seconds
-        auto itt = std::chrono::system_clock::to_time_t(now);
-        ss << std::put_time(std::gmtime(&itt), "%FT%T");
+        char suffix[9] = { '.', '0', '0', '0', '0', '0', '0', 'Z', '\0' };
+        for (int i = 6; i > 0 && fractionals != 0; --i)
+        {
+            suffix[i] = static_cast<char>('0' + fractionals % 10);
+            fractionals /= 10;
+        }
 
-        // down to microseconds
-        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch());
-        auto fractionals = micros.count() % 1000000;
-        ss << "." << fractionals << "Z";
+        out.append(cache.m_prefix, cache.m_size);
+        out.append(suffix, 8);
+    }
 
-        return ss.str();
+    std::string iso8601_now()
+    {
+        std::string res;
+        res.reserve(27);
+        append_iso8601_now(res);
+        return res;
     }
 
     std::string get_protocol_version()
@@ -21,20 +21,64 @@
 
 #include <collie/nlohmann/json.hpp>
 #include <dwarf/core/config.h>
+#include <dwarf/core/message_kind.h>
+#include <dwarf/core/shared_buffer.h>
 
 namespace nl = nlohmann;
 
 namespace dwarf
 {
-    using binary_buffer = std::vector<char>;
+    // Buffers are reference counted so that received frames can be handed
+    // to handlers, and outgoing ones to the transport, without any copy.
+    using binary_buffer = SharedBuffer;
     using buffer_sequence = std::vector<binary_buffer>;
 
+    // How the JSON sections of a received message are decoded: EAGER parses
+    // every section upon reception, LAZY only parses the header and defers
+    // the other sections to their first access.
+    enum class decoding_policy
+    {
+        EAGER,
+        LAZY
+    };
+
+    /**
+     * @class LazyJson
+     * @brief JSON section of a message, optionally backed by its raw frame.
+     *
+     * A section built from a raw frame keeps the frame around and decodes it
+     * on first access (or immediately with the EAGER policy). Access is not
+     * synchronized: like the message owning it, a section must not be read
+     * from several threads at the same time.
+     */
+    class DWARF_API LazyJson
+    {
+    public:
+
+        LazyJson() = default;
+        LazyJson(nl::json value);
+        LazyJson(binary_buffer raw, decoding_policy policy);
+
+        const nl::json& get() const;
+
+        // Serialized form of the section, empty if it was not built from a frame.
+        const binary_buffer& raw() const noexcept;
+
+        bool is_decoded() const noexcept;
+
+    private:
+
+        binary_buffer m_raw;
+        mutable nl::json m_value;
+        mutable bool m_decoded = true;
+    };
+
     struct DWARF_API MessageBaseData
     {
-        nl::json m_header;
-        nl::json m_parent_header;
-        nl::json m_metadata;
-        nl::json m_content;
+        LazyJson m_header;
+        LazyJson m_parent_header;
+        LazyJson m_metadata;
+        LazyJson m_content;
         buffer_sequence m_buffers;
     };
 
@@ -50,14 +94,24 @@ namespace dwarf
         const nl::json& metadata() const;
         const nl::json& content() const;
 
+        const binary_buffer& raw_header() const noexcept;
+        const binary_buffer& raw_parent_header() const noexcept;
+        const binary_buffer& raw_metadata() const noexcept;
+        const binary_buffer& raw_content() const noexcept;
+
         const buffer_sequence& buffers() const&;
         buffer_sequence&& buffers() &&;
 
+        // Resolved upon reception, or on first call for the other messages
+        message_kind kind() const;
+        // msg_type of the header, also for unknown kinds
+        const std::string& msg_type() const;
+
     protected:
 
         MessageBase() = default;
-        MessageBase(nl::json header,
-                      nl::json parent_header,
+        MessageBase(LazyJson header,
+                      LazyJson parent_header,
                       nl::json metadata,
                       nl::json content,
                       buffer_sequence buffers);
@@ -69,11 +123,15 @@ namespace dwarf
 
     private:
 
-        nl::json m_header;
-        nl::json m_parent_header;
-        nl::json m_metadata;
-        nl::json m_content;
+        void resolve_kind() const;
+
+        LazyJson m_header;
+        LazyJson m_parent_header;
+        LazyJson m_metadata;
+        LazyJson m_content;
         buffer_sequence m_buffers;
+        mutable message_kind m_kind = message_kind::unknown;
+        mutable bool m_kind_resolved = false;
     };
 
     class DWARF_API Message : public MessageBase
@@ -81,16 +139,16 @@ namespace dwarf
     public:
 
         using base_type = MessageBase;
-        using guid_list = std::vector<std::string>;
+        using guid_list = std::vector<binary_buffer>;
 
         Message() = default;
-        Message(const guid_list& zmq_id,
-                 nl::json header,
-                 nl::json parent_header,
+        Message(guid_list zmq_id,
+                 LazyJson header,
+                 LazyJson parent_header,
                  nl::json metadata,
                  nl::json content,
                  buffer_sequence buffers);
-        Message(const guid_list& zmq_id,
+        Message(guid_list zmq_id,
                  MessageBaseData&& data);
 
         ~Message() = default;
@@ -116,8 +174,8 @@ namespace dwarf
 
         PubMessage() = default;
         PubMessage(const std::string& topic,
-                     nl::json header,
-                     nl::json parent_header,
+                     LazyJson header,
+                     LazyJson parent_header,
                      nl::json metadata,
                      nl::json content,
                      buffer_sequence buffers);
@@ -141,6 +199,9 @@ namespace dwarf
 
     DWARF_API std::string iso8601_now();
 
+    // Appends the current UTC time, formatted as by iso8601_now, to out.
+    DWARF_API void append_iso8601_now(std::string& out);
+
     DWARF_API std::string get_protocol_version();
 
     DWARF_API nl::json make_header(const std::string& msg_type,
@@ -0,0 +1,159 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <cstring>
+
+#include <dwarf/core/message_kind.h>
+
+namespace dwarf {
+    namespace {
+        constexpr const char *kind_names[message_kind_count] = {
+                "",
+                "execute_request",
+                "execute_reply",
+                "inspect_request",
+                "inspect_reply",
+                "complete_request",
+                "complete_reply",
+                "history_request",
+                "history_reply",
+                "is_complete_request",
+                "is_complete_reply",
+                "comm_info_request",
+                "comm_info_reply",
+                "kernel_info_request",
+                "kernel_info_reply",
+                "shutdown_request",
+                "shutdown_reply",
+                "interrupt_request",
+                "interrupt_reply",
+                "debug_request",
+                "debug_reply",
+                "create_subshell_request",
+                "create_subshell_reply",
+                "delete_subshell_request",
+                "delete_subshell_reply",
+                "list_subshell_request",
+                "list_subshell_reply",
+                "comm_open",
+                "comm_msg",
+                "comm_close",
+                "input_request",
+                "input_reply",
+                "stream",
+                "display_data",
+                "update_display_data",
+                "execute_input",
+                "execute_result",
+                "error",
+                "status",
+                "clear_output",
+                "debug_event"
+        };
+
+        // FNV-1a, seeded so that the top bits of the hashes of the names
+        // above are all different. Changing the names may require another seed.
+        constexpr std::uint32_t kind_seed = 696;
+        constexpr std::size_t kind_slot_bits = 7;
+        constexpr std::size_t kind_slot_count = std::size_t(1) << kind_slot_bits;
+
+        constexpr std::size_t kind_length(const char *name) {
+            std::size_t res = 0;
+            while (name[res] != '\0') {
+                ++res;
+            }
+            return res;
+        }
+
+        constexpr std::size_t kind_slot(const char *data, std::size_t size) {
+            std::uint32_t hash = kind_seed ^ 2166136261u;
+            for (std::size_t i = 0; i < size; ++i) {
+                hash ^= static_cast<std::uint8_t>(data[i]);
+                hash *= 16777619u;
+            }
+            return hash >> (32 - kind_slot_bits);
+        }
+
+        struct kind_table {
+            std::uint8_t m_slots[kind_slot_count];
+            bool m_perfect;
+        };
+
+        constexpr kind_table make_kind_table() {
+            kind_table res = {};
+            res.m_perfect = true;
+            for (std::size_t kind = 1; kind < message_kind_count; ++kind) {
+                std::size_t slot = kind_slot(kind_names[kind], kind_length(kind_names[kind]));
+                if (res.m_slots[slot] != 0) {
+                    res.m_perfect = false;
+                }
+                res.m_slots[slot] = static_cast<std::uint8_t>(kind);
+            }
+            return res;
+        }
+
+        constexpr kind_table kind_slots = make_kind_table();
+        static_assert(kind_slots.m_perfect, "message kinds collide, kind_seed must be changed");
+
+        const std::string *make_kind_strings() {
+            static std::string strings[message_kind_count];
+            for (std::size_t kind = 0; kind < message_kind_count; ++kind) {
+                strings[kind] = kind_names[kind];
+            }
+            return strings;
+        }
+    }
+
+    message_kind to_message_kind(const char *msg_type, std::size_t size) noexcept {
+        std::uint8_t kind = kind_slots.m_slots[kind_slot(msg_type, size)];
+        const char *name = kind_names[kind];
+        if (kind != 0 && kind_length(name) == size && std::memcmp(name, msg_type, size) == 0) {
+            return static_cast<message_kind>(kind);
+        }
+        return message_kind::unknown;
+    }
+
+    message_kind to_message_kind(const std::string &msg_type) noexcept {
+        return to_message_kind(msg_type.data(), msg_type.size());
+    }
+
+    const std::string &to_string(message_kind kind) noexcept {
+        static const std::string *strings = make_kind_strings();
+        return strings[static_cast<std::size_t>(kind)];
+    }
+
+    message_kind reply_kind(message_kind kind) noexcept {
+        switch (kind) {
+            case message_kind::execute_request:
+            case message_kind::inspect_request:
+            case message_kind::complete_request:
+            case message_kind::history_request:
+            case message_kind::is_complete_request:
+            case message_kind::comm_info_request:
+            case message_kind::kernel_info_request:
+            case message_kind::shutdown_request:
+            case message_kind::interrupt_request:
+            case message_kind::debug_request:
+            case message_kind::create_subshell_request:
+            case message_kind::delete_subshell_request:
+            case message_kind::list_subshell_request:
+            case message_kind::input_request:
+                // Each request is followed by its reply
+                return static_cast<message_kind>(static_cast<std::uint8_t>(kind) + 1);
+            default:
+                return message_kind::unknown;
+        }
+    }
+}
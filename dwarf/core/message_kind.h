@@ -0,0 +1,84 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <dwarf/core/config.h>
+
+namespace dwarf {
+
+    // Message types of the kernel protocol. Types not listed here, including
+    // custom ones, are unknown and must be handled through their msg_type.
+    enum class message_kind : std::uint8_t {
+        unknown,
+        execute_request,
+        execute_reply,
+        inspect_request,
+        inspect_reply,
+        complete_request,
+        complete_reply,
+        history_request,
+        history_reply,
+        is_complete_request,
+        is_complete_reply,
+        comm_info_request,
+        comm_info_reply,
+        kernel_info_request,
+        kernel_info_reply,
+        shutdown_request,
+        shutdown_reply,
+        interrupt_request,
+        interrupt_reply,
+        debug_request,
+        debug_reply,
+        create_subshell_request,
+        create_subshell_reply,
+        delete_subshell_request,
+        delete_subshell_reply,
+        list_subshell_request,
+        list_subshell_reply,
+        comm_open,
+        comm_msg,
+        comm_close,
+        input_request,
+        input_reply,
+        stream,
+        display_data,
+        update_display_data,
+        execute_input,
+        execute_result,
+        error,
+        status,
+        clear_output,
+        debug_event
+    };
+
+    constexpr std::size_t message_kind_count = static_cast<std::size_t>(message_kind::debug_event) + 1;
+
+    // Resolved with a perfect hash built at compile time
+    DWARF_API message_kind to_message_kind(const char *msg_type, std::size_t size) noexcept;
+
+    DWARF_API message_kind to_message_kind(const std::string &msg_type) noexcept;
+
+    // Empty for unknown
+    DWARF_API const std::string &to_string(message_kind kind) noexcept;
+
+    // Kind of the reply to a request, unknown if kind is not a request
+    DWARF_API message_kind reply_kind(message_kind kind) noexcept;
+}
@@ -0,0 +1,448 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <utility>
+
+#include <dwarf/core/metrics.h>
+
+namespace dwarf {
+    namespace {
+        constexpr std::size_t latency_slot_count = metric_stage_count * metric_socket_count * message_kind_count;
+
+        constexpr std::size_t latency_slot(std::size_t stage, std::size_t socket, std::size_t kind) {
+            return (stage * metric_socket_count + socket) * message_kind_count + kind;
+        }
+
+        constexpr std::size_t counter_slot(metric_socket socket, metric_direction direction) {
+            return std::size_t(socket) * 2 + std::size_t(direction);
+        }
+
+        void increment(std::atomic<std::uint64_t> &counter, std::uint64_t value) noexcept {
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+
+        std::string kind_label(std::size_t kind) {
+            const std::string &res = to_string(message_kind(kind));
+            return res.empty() ? "unknown" : res;
+        }
+
+        std::string seconds(std::uint64_t nanoseconds) {
+            std::ostringstream oss;
+            oss << std::setprecision(9) << double(nanoseconds) * 1e-9;
+            return oss.str();
+        }
+
+        std::atomic<std::uint64_t> metrics_id(0);
+    }
+
+    const char *to_string(metric_stage stage) noexcept {
+        switch (stage) {
+            case metric_stage::queue_wait:
+                return "queue_wait";
+            case metric_stage::deserialize:
+                return "deserialize";
+            case metric_stage::handler:
+                return "handler";
+            case metric_stage::interpreter:
+                return "interpreter";
+            case metric_stage::serialize:
+                return "serialize";
+            case metric_stage::send:
+                return "send";
+        }
+        return "";
+    }
+
+    const char *to_string(metric_socket socket) noexcept {
+        switch (socket) {
+            case metric_socket::SHELL:
+                return "shell";
+            case metric_socket::CONTROL:
+                return "control";
+            case metric_socket::STDIN:
+                return "stdin";
+            case metric_socket::IOPUB:
+                return "iopub";
+        }
+        return "";
+    }
+
+    /*************************************
+     * LatencyHistogram implementation *
+     *************************************/
+
+    constexpr std::size_t LatencyHistogram::sub_bucket_count;
+    constexpr std::size_t LatencyHistogram::bucket_count;
+
+    LatencyHistogram::LatencyHistogram() noexcept
+            : m_sum(0), m_max(0) {
+        for (auto &count: m_counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void LatencyHistogram::record(std::uint64_t value) noexcept {
+        increment(m_counts[bucket(value)], 1);
+        increment(m_sum, value);
+        if (value > m_max.load(std::memory_order_relaxed)) {
+            m_max.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    std::uint64_t LatencyHistogram::count(std::size_t bucket) const noexcept {
+        return m_counts[bucket].load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t LatencyHistogram::total() const noexcept {
+        std::uint64_t res = 0;
+        for (const auto &count: m_counts) {
+            res += count.load(std::memory_order_relaxed);
+        }
+        return res;
+    }
+
+    std::uint64_t LatencyHistogram::sum() const noexcept {
+        return m_sum.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t LatencyHistogram::max() const noexcept {
+        return m_max.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t LatencyHistogram::lower_bound(std::size_t bucket) noexcept {
+        if (bucket < sub_bucket_count) {
+            return bucket;
+        }
+        std::size_t magnitude = bucket / sub_bucket_count + 2;
+        std::uint64_t sub_bucket = bucket % sub_bucket_count;
+        return (sub_bucket_count + sub_bucket) << (magnitude - 3);
+    }
+
+    std::size_t LatencyHistogram::bucket(std::uint64_t value) noexcept {
+        if (value < sub_bucket_count) {
+            return std::size_t(value);
+        }
+        std::size_t magnitude = 3;
+        while (magnitude < 63 && (value >> (magnitude + 1)) != 0) {
+            ++magnitude;
+        }
+        std::size_t res = (magnitude - 2) * sub_bucket_count + ((value >> (magnitude - 3)) & (sub_bucket_count - 1));
+        return std::min(res, bucket_count - 1);
+    }
+
+    /****************************
+     * Metrics implementation *
+     ****************************/
+
+    struct Metrics::shard {
+        std::atomic<bool> m_in_use{true};
+        std::array<std::atomic<LatencyHistogram *>, latency_slot_count> m_latencies;
+        // Only touched by the thread owning the shard
+        std::vector<std::unique_ptr<LatencyHistogram>> m_histograms;
+        std::array<std::atomic<std::uint64_t>, metric_socket_count * 2> m_messages;
+        std::array<std::atomic<std::uint64_t>, metric_socket_count * 2> m_bytes;
+
+        shard() {
+            for (auto &latency: m_latencies) {
+                latency.store(nullptr, std::memory_order_relaxed);
+            }
+            for (std::size_t i = 0; i < m_messages.size(); ++i) {
+                m_messages[i].store(0, std::memory_order_relaxed);
+                m_bytes[i].store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    // Shards of the current thread, handed back to their registry when
+    // the thread exits. A shard outlives its registry if needed.
+    struct Metrics::shard_holder {
+        std::vector<std::pair<std::uint64_t, std::shared_ptr<shard>>> m_shards;
+
+        ~shard_holder() {
+            for (auto &s: m_shards) {
+                s.second->m_in_use.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    Metrics::Metrics()
+            : m_enabled(false), m_id(++metrics_id) {
+    }
+
+    Metrics::~Metrics() {
+    }
+
+    bool Metrics::enabled() const noexcept {
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+
+    void Metrics::set_enabled(bool enabled) noexcept {
+        m_enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    void Metrics::record(metric_stage stage, metric_socket socket, message_kind kind, std::uint64_t nanoseconds) {
+        if (!enabled()) {
+            return;
+        }
+        shard &s = local_shard();
+        auto &slot = s.m_latencies[latency_slot(std::size_t(stage), std::size_t(socket), std::size_t(kind))];
+        LatencyHistogram *histogram = slot.load(std::memory_order_relaxed);
+        if (histogram == nullptr) {
+            s.m_histograms.emplace_back(new LatencyHistogram());
+            histogram = s.m_histograms.back().get();
+            slot.store(histogram, std::memory_order_release);
+        }
+        histogram->record(nanoseconds);
+    }
+
+    void Metrics::record(metric_stage stage, metric_socket socket, message_kind kind, clock_type::time_point start) {
+        if (!enabled()) {
+            return;
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start);
+        record(stage, socket, kind, static_cast<std::uint64_t>(std::max<long long>(elapsed.count(), 0)));
+    }
+
+    void Metrics::count(metric_socket socket, metric_direction direction, std::uint64_t bytes) {
+        if (!enabled()) {
+            return;
+        }
+        shard &s = local_shard();
+        std::size_t slot = counter_slot(socket, direction);
+        increment(s.m_messages[slot], 1);
+        increment(s.m_bytes[slot], bytes);
+    }
+
+    auto Metrics::local_shard() -> shard & {
+        static thread_local shard_holder holder;
+        for (auto &s: holder.m_shards) {
+            if (s.first == m_id) {
+                return *s.second;
+            }
+        }
+
+        std::shared_ptr<shard> res;
+        {
+            std::lock_guard<std::mutex> lock(m_shards_mutex);
+            // Shards of the threads that exited are reused, so that threads
+            // created on demand do not grow the registry.
+            for (auto &s: m_shards) {
+                bool in_use = false;
+                if (s->m_in_use.compare_exchange_strong(in_use, true, std::memory_order_acquire)) {
+                    res = s;
+                    break;
+                }
+            }
+            if (res == nullptr) {
+                res = std::make_shared<shard>();
+                m_shards.push_back(res);
+            }
+        }
+        holder.m_shards.emplace_back(m_id, res);
+        return *res;
+    }
+
+    std::uint64_t Metrics::latency_total::quantile(double q) const {
+        std::uint64_t target = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(q * double(m_total))));
+        std::uint64_t cumulated = 0;
+        for (std::size_t i = 0; i < m_counts.size(); ++i) {
+            cumulated += m_counts[i];
+            if (cumulated >= target) {
+                // Highest value of the bucket, or the maximum if lower
+                if (i + 1 == m_counts.size()) {
+                    return m_max;
+                }
+                return std::min(LatencyHistogram::lower_bound(i + 1) - 1, m_max);
+            }
+        }
+        return m_max;
+    }
+
+    auto Metrics::merge_latencies() const -> latency_totals {
+        latency_totals res(latency_slot_count);
+        std::lock_guard<std::mutex> lock(m_shards_mutex);
+        for (const auto &s: m_shards) {
+            for (std::size_t slot = 0; slot < latency_slot_count; ++slot) {
+                const LatencyHistogram *histogram = s->m_latencies[slot].load(std::memory_order_acquire);
+                if (histogram == nullptr) {
+                    continue;
+                }
+                if (res[slot] == nullptr) {
+                    res[slot].reset(new latency_total());
+                }
+                latency_total &total = *res[slot];
+                for (std::size_t i = 0; i < LatencyHistogram::bucket_count; ++i) {
+                    std::uint64_t c = histogram->count(i);
+                    total.m_counts[i] += c;
+                    total.m_total += c;
+                }
+                total.m_sum += histogram->sum();
+                total.m_max = std::max(total.m_max, histogram->max());
+            }
+        }
+        return res;
+    }
+
+    auto Metrics::merge_counters(bool bytes) const -> std::array<std::uint64_t, metric_socket_count * 2> {
+        std::array<std::uint64_t, metric_socket_count * 2> res{};
+        std::lock_guard<std::mutex> lock(m_shards_mutex);
+        for (const auto &s: m_shards) {
+            const auto &counters = bytes ? s->m_bytes : s->m_messages;
+            for (std::size_t i = 0; i < res.size(); ++i) {
+                res[i] += counters[i].load(std::memory_order_relaxed);
+            }
+        }
+        return res;
+    }
+
+    nl::json Metrics::to_json() const {
+        nl::json res;
+        res["enabled"] = enabled();
+
+        nl::json latencies = nl::json::array();
+        latency_totals totals = merge_latencies();
+        for (std::size_t kind = 0; kind < message_kind_count; ++kind) {
+            for (std::size_t socket = 0; socket < metric_socket_count; ++socket) {
+                for (std::size_t stage = 0; stage < metric_stage_count; ++stage) {
+                    const auto &total = totals[latency_slot(stage, socket, kind)];
+                    if (total == nullptr || total->m_total == 0) {
+                        continue;
+                    }
+                    nl::json latency;
+                    latency["msg_type"] = kind_label(kind);
+                    latency["socket"] = to_string(metric_socket(socket));
+                    latency["stage"] = to_string(metric_stage(stage));
+                    latency["count"] = total->m_total;
+                    latency["sum_ns"] = total->m_sum;
+                    latency["p50_ns"] = total->quantile(0.5);
+                    latency["p90_ns"] = total->quantile(0.9);
+                    latency["p99_ns"] = total->quantile(0.99);
+                    latency["max_ns"] = total->m_max;
+                    latencies.push_back(std::move(latency));
+                }
+            }
+        }
+        res["latencies"] = std::move(latencies);
+
+        auto messages = merge_counters(false);
+        auto bytes = merge_counters(true);
+        nl::json sockets = nl::json::object();
+        for (std::size_t socket = 0; socket < metric_socket_count; ++socket) {
+            std::size_t received = counter_slot(metric_socket(socket), metric_direction::RECEIVED);
+            std::size_t sent = counter_slot(metric_socket(socket), metric_direction::SENT);
+            nl::json counters;
+            counters["received_messages"] = messages[received];
+            counters["received_bytes"] = bytes[received];
+            counters["sent_messages"] = messages[sent];
+            counters["sent_bytes"] = bytes[sent];
+            sockets[to_string(metric_socket(socket))] = std::move(counters);
+        }
+        res["sockets"] = std::move(sockets);
+        return res;
+    }
+
+    std::string Metrics::to_prometheus() const {
+        std::ostringstream oss;
+        oss << "# HELP dwarf_message_latency_seconds Time spent by the messages in each stage of their handling.\n"
+            << "# TYPE dwarf_message_latency_seconds summary\n";
+        latency_totals totals = merge_latencies();
+        for (std::size_t kind = 0; kind < message_kind_count; ++kind) {
+            for (std::size_t socket = 0; socket < metric_socket_count; ++socket) {
+                for (std::size_t stage = 0; stage < metric_stage_count; ++stage) {
+                    const auto &total = totals[latency_slot(stage, socket, kind)];
+                    if (total == nullptr || total->m_total == 0) {
+                        continue;
+                    }
+                    std::string labels = "msg_type=\"" + kind_label(kind) +
+                                         "\",socket=\"" + to_string(metric_socket(socket)) +
+                                         "\",stage=\"" + to_string(metric_stage(stage)) + "\"";
+                    for (double q: {0.5, 0.9, 0.99}) {
+                        oss << "dwarf_message_latency_seconds{" << labels << ",quantile=\"" << q << "\"} "
+                            << seconds(total->quantile(q)) << '\n';
+                    }
+                    oss << "dwarf_message_latency_seconds_sum{" << labels << "} " << seconds(total->m_sum) << '\n'
+                        << "dwarf_message_latency_seconds_count{" << labels << "} " << total->m_total << '\n';
+                }
+            }
+        }
+
+        const char *directions[] = {"received", "sent"};
+        auto messages = merge_counters(false);
+        auto bytes = merge_counters(true);
+        oss << "# HELP dwarf_socket_messages_total Messages received and sent per socket.\n"
+            << "# TYPE dwarf_socket_messages_total counter\n";
+        for (std::size_t i = 0; i < messages.size(); ++i) {
+            oss << "dwarf_socket_messages_total{socket=\"" << to_string(metric_socket(i / 2))
+                << "\",direction=\"" << directions[i % 2] << "\"} " << messages[i] << '\n';
+        }
+        oss << "# HELP dwarf_socket_bytes_total Bytes received and sent per socket.\n"
+            << "# TYPE dwarf_socket_bytes_total counter\n";
+        for (std::size_t i = 0; i < bytes.size(); ++i) {
+            oss << "dwarf_socket_bytes_total{socket=\"" << to_string(metric_socket(i / 2))
+                << "\",direction=\"" << directions[i % 2] << "\"} " << bytes[i] << '\n';
+        }
+        return oss.str();
+    }
+
+    Metrics &get_metrics() {
+        static Metrics metrics;
+        return metrics;
+    }
+
+    /*********************************
+     * MetricsTimer implementation *
+     *********************************/
+
+    MetricsTimer::MetricsTimer(metric_stage stage, metric_socket socket, message_kind kind) noexcept
+            : m_active(get_metrics().enabled()), m_stage(stage), m_socket(socket), m_kind(kind) {
+        if (m_active) {
+            m_start = Metrics::clock_type::now();
+        }
+    }
+
+    MetricsTimer::~MetricsTimer() {
+        if (m_active) {
+            get_metrics().record(m_stage, m_socket, m_kind, m_start);
+        }
+    }
+
+    void MetricsTimer::set_kind(message_kind kind) noexcept {
+        m_kind = kind;
+    }
+
+    bool is_metrics_request(const nl::json &message) {
+        if (!message.is_object()) {
+            return false;
+        }
+        auto request = message.find("dwarf_request");
+        return request != message.end() && request->is_string() && request->get<std::string>() == "metrics";
+    }
+
+    nl::json metrics_reply(const nl::json &message) {
+        nl::json res;
+        res["status"] = "ok";
+        auto format = message.find("format");
+        if (format != message.end() && format->is_string() && format->get<std::string>() == "prometheus") {
+            res["text"] = get_metrics().to_prometheus();
+        } else {
+            res["metrics"] = get_metrics().to_json();
+        }
+        return res;
+    }
+}
@@ -0,0 +1,214 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <collie/nlohmann/json.hpp>
+
+#include <dwarf/core/config.h>
+#include <dwarf/core/message_kind.h>
+
+namespace nl = nlohmann;
+
+namespace dwarf {
+    // Steps of the handling of a message, timed in nanoseconds
+    enum class metric_stage : std::uint8_t {
+        queue_wait,
+        deserialize,
+        handler,
+        interpreter,
+        serialize,
+        send
+    };
+
+    constexpr std::size_t metric_stage_count = 6;
+
+    enum class metric_socket : std::uint8_t {
+        SHELL,
+        CONTROL,
+        STDIN,
+        IOPUB
+    };
+
+    constexpr std::size_t metric_socket_count = 4;
+
+    enum class metric_direction : std::uint8_t {
+        RECEIVED,
+        SENT
+    };
+
+    DWARF_API
+    const char *to_string(metric_stage stage) noexcept;
+
+    DWARF_API
+    const char *to_string(metric_socket socket) noexcept;
+
+    /**
+     * @class LatencyHistogram
+     * @brief Distribution of durations with a bounded relative error.
+     *
+     * Values below 8 have their own bucket, each power of two above is
+     * split in 8 linear sub-buckets, so that a bucket is at most 12.5%
+     * wide. Values above 2^41 go to the last bucket. Same threading model
+     * as Histogram: a single writer, readers on any thread.
+     */
+    class DWARF_API LatencyHistogram {
+    public:
+
+        static constexpr std::size_t sub_bucket_count = 8;
+        static constexpr std::size_t bucket_count = 312;
+
+        LatencyHistogram() noexcept;
+
+        LatencyHistogram(const LatencyHistogram &) = delete;
+
+        LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+        void record(std::uint64_t value) noexcept;
+
+        std::uint64_t count(std::size_t bucket) const noexcept;
+
+        std::uint64_t total() const noexcept;
+
+        std::uint64_t sum() const noexcept;
+
+        std::uint64_t max() const noexcept;
+
+        // Smallest value counted by the bucket
+        static std::uint64_t lower_bound(std::size_t bucket) noexcept;
+
+        static std::size_t bucket(std::uint64_t value) noexcept;
+
+    private:
+
+        std::array<std::atomic<std::uint64_t>, bucket_count> m_counts;
+        std::atomic<std::uint64_t> m_sum;
+        std::atomic<std::uint64_t> m_max;
+    };
+
+    /**
+     * @class Metrics
+     * @brief Registry of the latencies and traffic of the kernel.
+     *
+     * Every thread records in its own shard, the shards are merged when the
+     * registry is queried. While disabled, recording neither reads the clock
+     * nor touches the shards.
+     */
+    class DWARF_API Metrics {
+    public:
+
+        using clock_type = std::chrono::steady_clock;
+
+        Metrics();
+
+        ~Metrics();
+
+        Metrics(const Metrics &) = delete;
+
+        Metrics &operator=(const Metrics &) = delete;
+
+        bool enabled() const noexcept;
+
+        void set_enabled(bool enabled) noexcept;
+
+        void record(metric_stage stage, metric_socket socket, message_kind kind, std::uint64_t nanoseconds);
+
+        void record(metric_stage stage, metric_socket socket, message_kind kind, clock_type::time_point start);
+
+        void count(metric_socket socket, metric_direction direction, std::uint64_t bytes);
+
+        // Sums of the shards, latencies are listed by msg_type, socket and stage
+        nl::json to_json() const;
+
+        // Prometheus text exposition format
+        std::string to_prometheus() const;
+
+    private:
+
+        struct shard;
+        struct shard_holder;
+
+        shard &local_shard();
+
+        struct latency_total {
+            std::array<std::uint64_t, LatencyHistogram::bucket_count> m_counts{};
+            std::uint64_t m_total = 0;
+            std::uint64_t m_sum = 0;
+            std::uint64_t m_max = 0;
+
+            std::uint64_t quantile(double q) const;
+        };
+
+        using latency_totals = std::vector<std::unique_ptr<latency_total>>;
+
+        latency_totals merge_latencies() const;
+
+        std::array<std::uint64_t, metric_socket_count * 2> merge_counters(bool bytes) const;
+
+        std::atomic<bool> m_enabled;
+        std::uint64_t m_id;
+        mutable std::mutex m_shards_mutex;
+        std::vector<std::shared_ptr<shard>> m_shards;
+    };
+
+    DWARF_API
+    Metrics &get_metrics();
+
+    /**
+     * @class MetricsTimer
+     * @brief Records the lifetime of the timer as a stage of a message.
+     */
+    class DWARF_API MetricsTimer {
+    public:
+
+        MetricsTimer(metric_stage stage, metric_socket socket, message_kind kind = message_kind::unknown) noexcept;
+
+        ~MetricsTimer();
+
+        MetricsTimer(const MetricsTimer &) = delete;
+
+        MetricsTimer &operator=(const MetricsTimer &) = delete;
+
+        // For the stages where the message is only known at the end
+        void set_kind(message_kind kind) noexcept;
+
+    private:
+
+        bool m_active;
+        metric_stage m_stage;
+        metric_socket m_socket;
+        message_kind m_kind;
+        Metrics::clock_type::time_point m_start;
+    };
+
+    // Reserved internal request and comm target answered with the metrics
+    DWARF_API
+    bool is_metrics_request(const nl::json &message);
+
+    DWARF_API
+    nl::json metrics_reply(const nl::json &message);
+
+    constexpr const char *metrics_comm_target = "dwarf.metrics";
+}
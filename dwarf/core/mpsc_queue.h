@@ -0,0 +1,143 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace dwarf {
+
+    /**
+     * @class MpscQueue
+     * @brief Bounded lock-free queue with many producers and a single consumer.
+     *
+     * Each cell carries a sequence number telling whether it is ready to be
+     * written or read at a given position, so that producers only contend on
+     * the enqueue position and never wait for each other. The capacity is
+     * rounded up to a power of two. try_pop must always be called from the
+     * same thread.
+     */
+    template<class T>
+    class MpscQueue {
+    public:
+
+        using value_type = T;
+        using size_type = std::size_t;
+
+        explicit MpscQueue(size_type capacity);
+
+        MpscQueue(const MpscQueue &) = delete;
+
+        MpscQueue &operator=(const MpscQueue &) = delete;
+
+        size_type capacity() const noexcept;
+
+        // Moves from value on success only
+        bool try_push(value_type &value);
+
+        bool try_pop(value_type &value);
+
+        // Approximate when called concurrently with try_push
+        bool empty() const noexcept;
+
+    private:
+
+        struct cell {
+            std::atomic<size_type> m_sequence;
+            value_type m_value;
+        };
+
+        static size_type round_capacity(size_type capacity) noexcept;
+
+        std::unique_ptr<cell[]> p_cells;
+        size_type m_mask;
+        // Producers and consumer positions live on different cache lines
+        char m_pad0[64];
+        std::atomic<size_type> m_enqueue_pos;
+        char m_pad1[64];
+        size_type m_dequeue_pos;
+    };
+
+    /****************************
+     * MpscQueue implementation *
+     ****************************/
+
+    template<class T>
+    inline MpscQueue<T>::MpscQueue(size_type capacity)
+            : p_cells(new cell[round_capacity(capacity)]), m_mask(round_capacity(capacity) - 1),
+              m_enqueue_pos(0), m_dequeue_pos(0) {
+        for (size_type i = 0; i <= m_mask; ++i) {
+            p_cells[i].m_sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    template<class T>
+    inline auto MpscQueue<T>::capacity() const noexcept -> size_type {
+        return m_mask + 1;
+    }
+
+    template<class T>
+    inline bool MpscQueue<T>::try_push(value_type &value) {
+        size_type pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            cell &c = p_cells[pos & m_mask];
+            size_type sequence = c.m_sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    c.m_value = std::move(value);
+                    c.m_sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // Full
+                return false;
+            } else {
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    template<class T>
+    inline bool MpscQueue<T>::try_pop(value_type &value) {
+        cell &c = p_cells[m_dequeue_pos & m_mask];
+        size_type sequence = c.m_sequence.load(std::memory_order_acquire);
+        if (sequence != m_dequeue_pos + 1) {
+            return false;
+        }
+        value = std::move(c.m_value);
+        c.m_value = value_type();
+        c.m_sequence.store(m_dequeue_pos + m_mask + 1, std::memory_order_release);
+        ++m_dequeue_pos;
+        return true;
+    }
+
+    template<class T>
+    inline bool MpscQueue<T>::empty() const noexcept {
+        return p_cells[m_dequeue_pos & m_mask].m_sequence.load(std::memory_order_acquire) != m_dequeue_pos + 1;
+    }
+
+    template<class T>
+    inline auto MpscQueue<T>::round_capacity(size_type capacity) noexcept -> size_type {
+        size_type res = 2;
+        while (res < capacity) {
+            res <<= 1;
+        }
+        return res;
+    }
+}
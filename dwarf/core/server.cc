@@ -17,6 +17,7 @@
 #include <iostream>
 
 #include <dwarf/core/server.h>
+#include <dwarf/core/tracer.h>
 
 namespace dwarf {
     ControlMessenger &Server::get_control_messenger() {
@@ -24,18 +25,22 @@ namespace dwarf {
     }
 
     void Server::send_shell(Message message) {
+        TraceSpan span("send_reply", message);
         send_shell_impl(std::move(message));
     }
 
     void Server::send_control(Message message) {
+        TraceSpan span("send_reply", message);
         send_control_impl(std::move(message));
     }
 
     void Server::send_stdin(Message message) {
+        TraceSpan span("send_stdin", message);
         send_stdin_impl(std::move(message));
     }
 
     void Server::publish(PubMessage message, channel c) {
+        TraceSpan span("publish", message);
         publish_impl(std::move(message), c);
     }
 
@@ -46,8 +51,8 @@ namespace dwarf {
         start_impl(std::move(message));
     }
 
-    void Server::abort_queue(const listener &l, long polling_interval) {
-        abort_queue_impl(l, polling_interval);
+    void Server::abort_queue(const listener &l, long grace_period) {
+        abort_queue_impl(l, grace_period);
     }
 
     void Server::stop() {
@@ -74,10 +79,28 @@ namespace dwarf {
         m_internal_listener = l;
     }
 
+    void Server::register_concurrent_shell_listener(const concurrent_listener &l) {
+        m_concurrent_shell_listener = l;
+    }
+
+    void Server::register_discarded_shell_listener(const discarded_listener &l) {
+        m_discarded_shell_listener = l;
+    }
+
     void Server::notify_shell_listener(Message msg) {
         m_shell_listener(std::move(msg));
     }
 
+    bool Server::notify_concurrent_shell_listener(Message &msg) {
+        return m_concurrent_shell_listener && m_concurrent_shell_listener(msg);
+    }
+
+    void Server::notify_discarded_shell_listener(const Message &msg) {
+        if (m_discarded_shell_listener) {
+            m_discarded_shell_listener(msg);
+        }
+    }
+
     void Server::notify_control_listener(Message msg) {
         m_control_listener(std::move(msg));
     }
@@ -34,6 +34,9 @@ namespace dwarf {
 
         using listener = std::function<void(Message)>;
         using internal_listener = std::function<nl::json(nl::json)>;
+        // Returns true when it takes over the message
+        using concurrent_listener = std::function<bool(Message &)>;
+        using discarded_listener = std::function<void(const Message &)>;
 
         virtual ~Server() = default;
 
@@ -57,7 +60,9 @@ namespace dwarf {
 
         void start(PubMessage message);
 
-        void abort_queue(const listener &l, long polling_interval);
+        // Passes the shell messages already queued to l, then those received
+        // within grace_period milliseconds.
+        void abort_queue(const listener &l, long grace_period);
 
         void stop();
 
@@ -71,12 +76,24 @@ namespace dwarf {
 
         void register_internal_listener(const internal_listener &l);
 
+        // Called on the receiving thread with each shell message, before it
+        // is queued for the shell listener.
+        void register_concurrent_shell_listener(const concurrent_listener &l);
+
+        // Called with each shell message removed from the queue without
+        // being passed to the shell listener, e.g. extracted by the caller.
+        void register_discarded_shell_listener(const discarded_listener &l);
+
     protected:
 
         Server() = default;
 
         void notify_shell_listener(Message msg);
 
+        bool notify_concurrent_shell_listener(Message &msg);
+
+        void notify_discarded_shell_listener(const Message &msg);
+
         void notify_control_listener(Message msg);
 
         void notify_stdin_listener(Message msg);
@@ -97,7 +114,7 @@ namespace dwarf {
 
         virtual void start_impl(PubMessage message) = 0;
 
-        virtual void abort_queue_impl(const listener &l, long polling_interval) = 0;
+        virtual void abort_queue_impl(const listener &l, long grace_period) = 0;
 
         virtual void stop_impl() = 0;
 
@@ -107,5 +124,7 @@ namespace dwarf {
         listener m_control_listener;
         listener m_stdin_listener;
         internal_listener m_internal_listener;
+        concurrent_listener m_concurrent_shell_listener;
+        discarded_listener m_discarded_shell_listener;
     };
 }
@@ -0,0 +1,67 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include <cstring>
+#include <utility>
+
+#include <dwarf/core/shared_buffer.h>
+
+namespace dwarf {
+    SharedBuffer::SharedBuffer() noexcept
+            : m_owner(), m_data(nullptr), m_size(0) {
+    }
+
+    SharedBuffer::SharedBuffer(std::vector<char> data)
+            : SharedBuffer() {
+        if (!data.empty()) {
+            auto owner = std::make_shared<std::vector<char>>(std::move(data));
+            m_data = owner->data();
+            m_size = owner->size();
+            m_owner = std::move(owner);
+        }
+    }
+
+    SharedBuffer::SharedBuffer(std::string data)
+            : SharedBuffer() {
+        if (!data.empty()) {
+            auto owner = std::make_shared<std::string>(std::move(data));
+            m_data = owner->data();
+            m_size = owner->size();
+            m_owner = std::move(owner);
+        }
+    }
+
+    SharedBuffer::SharedBuffer(const char *data, size_type size, owner_type owner) noexcept
+            : m_owner(std::move(owner)), m_data(data), m_size(size) {
+    }
+
+    std::vector<char> SharedBuffer::to_vector() const {
+        return std::vector<char>(begin(), end());
+    }
+
+    std::string SharedBuffer::to_string() const {
+        return empty() ? std::string() : std::string(m_data, m_size);
+    }
+
+    bool operator==(const SharedBuffer &lhs, const SharedBuffer &rhs) noexcept {
+        return lhs.size() == rhs.size()
+               && (lhs.empty() || lhs.data() == rhs.data() || std::memcmp(lhs.data(), rhs.data(), lhs.size()) == 0);
+    }
+
+    bool operator!=(const SharedBuffer &lhs, const SharedBuffer &rhs) noexcept {
+        return !(lhs == rhs);
+    }
+}
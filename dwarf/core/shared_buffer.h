@@ -0,0 +1,121 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dwarf/core/config.h>
+
+namespace dwarf {
+
+    /**
+     * @class SharedBuffer
+     * @brief Immutable, reference counted view over a block of bytes.
+     *
+     * The memory is kept alive by an opaque owner (a vector, a string, a
+     * received zmq frame...), so copying a SharedBuffer only bumps a
+     * reference count and never duplicates the payload.
+     */
+    class DWARF_API SharedBuffer {
+    public:
+
+        using value_type = char;
+        using size_type = std::size_t;
+        using const_iterator = const char *;
+        using owner_type = std::shared_ptr<const void>;
+
+        SharedBuffer() noexcept;
+
+        SharedBuffer(std::vector<char> data);
+
+        SharedBuffer(std::string data);
+
+        template<class InputIt>
+        SharedBuffer(InputIt first, InputIt last);
+
+        // Zero-copy view over [data, data + size), kept alive by owner.
+        SharedBuffer(const char *data, size_type size, owner_type owner) noexcept;
+
+        const char *data() const noexcept;
+
+        size_type size() const noexcept;
+
+        bool empty() const noexcept;
+
+        const_iterator begin() const noexcept;
+
+        const_iterator end() const noexcept;
+
+        const char &operator[](size_type i) const noexcept;
+
+        const owner_type &owner() const noexcept;
+
+        std::vector<char> to_vector() const;
+
+        std::string to_string() const;
+
+    private:
+
+        owner_type m_owner;
+        const char *m_data;
+        size_type m_size;
+    };
+
+    DWARF_API bool operator==(const SharedBuffer &lhs, const SharedBuffer &rhs) noexcept;
+
+    DWARF_API bool operator!=(const SharedBuffer &lhs, const SharedBuffer &rhs) noexcept;
+
+    /*******************************
+     * SharedBuffer implementation *
+     *******************************/
+
+    template<class InputIt>
+    inline SharedBuffer::SharedBuffer(InputIt first, InputIt last)
+            : SharedBuffer(std::vector<char>(first, last)) {
+    }
+
+    inline const char *SharedBuffer::data() const noexcept {
+        return m_data;
+    }
+
+    inline auto SharedBuffer::size() const noexcept -> size_type {
+        return m_size;
+    }
+
+    inline bool SharedBuffer::empty() const noexcept {
+        return m_size == 0;
+    }
+
+    inline auto SharedBuffer::begin() const noexcept -> const_iterator {
+        return m_data;
+    }
+
+    inline auto SharedBuffer::end() const noexcept -> const_iterator {
+        return m_data + m_size;
+    }
+
+    inline const char &SharedBuffer::operator[](size_type i) const noexcept {
+        return m_data[i];
+    }
+
+    inline auto SharedBuffer::owner() const noexcept -> const owner_type & {
+        return m_owner;
+    }
+}
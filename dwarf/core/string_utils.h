@@ -31,4 +31,40 @@ namespace dwarf {
         }
         return oss.str();
     }
+
+    // Writes the 2 * size lowercase hexadecimal digits of data to out.
+    inline void hex_encode(const unsigned char *data, std::size_t size, char *out) noexcept {
+        static const char digits[] = "0123456789abcdef";
+        for (std::size_t i = 0; i < size; ++i) {
+            out[2 * i] = digits[data[i] >> 4];
+            out[2 * i + 1] = digits[data[i] & 0x0f];
+        }
+    }
+
+    inline int hex_digit_value(char c) noexcept {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+
+    // Decodes the 2 * size hexadecimal digits of in to size bytes,
+    // returns false if in holds a non hexadecimal character.
+    inline bool hex_decode(const char *in, std::size_t size, unsigned char *out) noexcept {
+        for (std::size_t i = 0; i < size; ++i) {
+            int high = hex_digit_value(in[2 * i]);
+            int low = hex_digit_value(in[2 * i + 1]);
+            if (high < 0 || low < 0) {
+                return false;
+            }
+            out[i] = static_cast<unsigned char>((high << 4) | low);
+        }
+        return true;
+    }
 }
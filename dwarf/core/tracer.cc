@@ -0,0 +1,327 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <dwarf/core/tracer.h>
+
+namespace dwarf {
+    namespace {
+        constexpr std::size_t id_words = 6;
+        constexpr std::size_t id_size = id_words * sizeof(std::uint64_t);
+
+        using packed_id = std::array<std::atomic<std::uint64_t>, id_words>;
+
+        void pack(const std::string &id, packed_id &words) noexcept {
+            char buffer[id_size] = {};
+            std::memcpy(buffer, id.data(), std::min(id.size(), id_size - 1));
+            for (std::size_t i = 0; i < id_words; ++i) {
+                std::uint64_t word;
+                std::memcpy(&word, buffer + i * sizeof(word), sizeof(word));
+                words[i].store(word, std::memory_order_relaxed);
+            }
+        }
+
+        void unpack(const packed_id &words, char *buffer) noexcept {
+            for (std::size_t i = 0; i < id_words; ++i) {
+                std::uint64_t word = words[i].load(std::memory_order_relaxed);
+                std::memcpy(buffer + i * sizeof(word), &word, sizeof(word));
+            }
+            buffer[id_size - 1] = '\0';
+        }
+
+        int get_process_id() {
+#ifdef _WIN32
+            return _getpid();
+#else
+            return static_cast<int>(getpid());
+#endif
+        }
+
+        std::atomic<std::uint64_t> tracer_id(0);
+        std::atomic<std::uint32_t> thread_id(0);
+    }
+
+    constexpr std::size_t Tracer::default_capacity;
+
+    // Written by its thread only. Each event is guarded by a sequence
+    // number, odd while the event is written, so that a reader skips
+    // the events overwritten while it copies them.
+    struct Tracer::ring {
+        struct event {
+            std::atomic<std::uint64_t> m_sequence;
+            std::atomic<const char *> m_name;
+            std::atomic<std::uint64_t> m_start;
+            std::atomic<std::uint64_t> m_end;
+            packed_id m_msg_id;
+            packed_id m_parent_id;
+        };
+
+        explicit ring(std::size_t capacity)
+                : m_events(new event[capacity]), m_capacity(capacity), m_head(0),
+                  m_tid(++thread_id), m_name(nullptr) {
+            for (std::size_t i = 0; i < capacity; ++i) {
+                m_events[i].m_sequence.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        void push(const char *name, std::uint64_t start, std::uint64_t end,
+                  const std::string &msg_id, const std::string &parent_id) noexcept {
+            std::uint64_t head = m_head.load(std::memory_order_relaxed);
+            event &e = m_events[head % m_capacity];
+            std::uint64_t sequence = e.m_sequence.load(std::memory_order_relaxed);
+            e.m_sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            e.m_name.store(name, std::memory_order_relaxed);
+            e.m_start.store(start, std::memory_order_relaxed);
+            e.m_end.store(end, std::memory_order_relaxed);
+            pack(msg_id, e.m_msg_id);
+            pack(parent_id, e.m_parent_id);
+            e.m_sequence.store(sequence + 2, std::memory_order_release);
+            m_head.store(head + 1, std::memory_order_release);
+        }
+
+        std::unique_ptr<event[]> m_events;
+        std::size_t m_capacity;
+        std::atomic<std::uint64_t> m_head;
+        std::uint32_t m_tid;
+        std::atomic<const char *> m_name;
+    };
+
+    struct Tracer::ring_holder {
+        std::vector<std::pair<std::uint64_t, std::shared_ptr<ring>>> m_rings;
+    };
+
+    Tracer::Tracer(std::string path, std::size_t capacity)
+            : m_path(std::move(path)), m_capacity(std::max<std::size_t>(capacity, 1)), m_id(++tracer_id) {
+    }
+
+    Tracer::~Tracer() {
+        if (enabled()) {
+            dump(m_path);
+        }
+    }
+
+    bool Tracer::enabled() const noexcept {
+        return !m_path.empty();
+    }
+
+    const std::string &Tracer::path() const noexcept {
+        return m_path;
+    }
+
+    std::uint64_t Tracer::now() noexcept {
+        auto elapsed = std::chrono::steady_clock::now().time_since_epoch();
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+    void Tracer::record(const char *name,
+                        std::uint64_t start,
+                        std::uint64_t end,
+                        const std::string &msg_id,
+                        const std::string &parent_id) {
+        if (!enabled()) {
+            return;
+        }
+        local_ring().push(name, start, end, msg_id, parent_id);
+    }
+
+    void Tracer::set_thread_name(const char *name) {
+        if (!enabled()) {
+            return;
+        }
+        local_ring().m_name.store(name, std::memory_order_release);
+    }
+
+    auto Tracer::local_ring() -> ring & {
+        static thread_local ring_holder holder;
+        for (auto &r: holder.m_rings) {
+            if (r.first == m_id) {
+                return *r.second;
+            }
+        }
+
+        // The rings of the threads that exited are kept, their spans are
+        // still part of the timeline.
+        auto res = std::make_shared<ring>(m_capacity);
+        {
+            std::lock_guard<std::mutex> lock(m_rings_mutex);
+            m_rings.push_back(res);
+        }
+        holder.m_rings.emplace_back(m_id, res);
+        return *res;
+    }
+
+    nl::json Tracer::to_chrome_trace() const {
+        int pid = get_process_id();
+        nl::json events = nl::json::array();
+
+        std::lock_guard<std::mutex> lock(m_rings_mutex);
+        for (const auto &r: m_rings) {
+            const char *thread_name = r->m_name.load(std::memory_order_acquire);
+            if (thread_name != nullptr) {
+                nl::json metadata;
+                metadata["name"] = "thread_name";
+                metadata["ph"] = "M";
+                metadata["pid"] = pid;
+                metadata["tid"] = r->m_tid;
+                metadata["args"]["name"] = thread_name;
+                events.push_back(std::move(metadata));
+            }
+
+            std::uint64_t head = r->m_head.load(std::memory_order_acquire);
+            std::uint64_t first = head > r->m_capacity ? head - r->m_capacity : 0;
+            for (std::uint64_t i = first; i < head; ++i) {
+                const ring::event &e = r->m_events[i % r->m_capacity];
+                std::uint64_t sequence = e.m_sequence.load(std::memory_order_acquire);
+                if (sequence % 2 != 0) {
+                    continue;
+                }
+                const char *name = e.m_name.load(std::memory_order_relaxed);
+                std::uint64_t start = e.m_start.load(std::memory_order_relaxed);
+                std::uint64_t end = e.m_end.load(std::memory_order_relaxed);
+                char msg_id[id_size];
+                char parent_id[id_size];
+                unpack(e.m_msg_id, msg_id);
+                unpack(e.m_parent_id, parent_id);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (e.m_sequence.load(std::memory_order_relaxed) != sequence || name == nullptr) {
+                    continue;
+                }
+
+                nl::json event;
+                event["name"] = name;
+                event["cat"] = "dwarf";
+                event["ph"] = "X";
+                event["pid"] = pid;
+                event["tid"] = r->m_tid;
+                event["ts"] = double(start) / 1000.;
+                event["dur"] = double(end > start ? end - start : 0) / 1000.;
+                event["args"]["msg_id"] = msg_id;
+                event["args"]["parent_msg_id"] = parent_id;
+                events.push_back(std::move(event));
+            }
+        }
+
+        nl::json res;
+        res["traceEvents"] = std::move(events);
+        res["displayTimeUnit"] = "ns";
+        return res;
+    }
+
+    bool Tracer::dump(const std::string &path) const {
+        std::ofstream ofs(path);
+        if (!ofs) {
+            return false;
+        }
+        ofs << to_chrome_trace().dump();
+        return bool(ofs);
+    }
+
+    Tracer &get_tracer() {
+        static Tracer tracer([]() {
+            const char *path = std::getenv("DWARF_TRACE");
+            return std::string(path != nullptr ? path : "");
+        }());
+        return tracer;
+    }
+
+    /******************************
+     * TraceSpan implementation *
+     ******************************/
+
+    TraceSpan::TraceSpan(const char *name) noexcept
+            : m_name(name), m_start(get_tracer().enabled() ? Tracer::now() : 0) {
+    }
+
+    TraceSpan::TraceSpan(const char *name, const MessageBase &msg)
+            : TraceSpan(name) {
+        if (active()) {
+            get_trace_ids(msg, m_msg_id, m_parent_id);
+        }
+    }
+
+    TraceSpan::~TraceSpan() {
+        if (active()) {
+            get_tracer().record(m_name, m_start, Tracer::now(), m_msg_id, m_parent_id);
+        }
+    }
+
+    bool TraceSpan::active() const noexcept {
+        return m_start != 0;
+    }
+
+    void TraceSpan::set_message(const MessageBase &msg) {
+        if (active()) {
+            get_trace_ids(msg, m_msg_id, m_parent_id);
+        }
+    }
+
+    void TraceSpan::set_ids(std::string msg_id, std::string parent_id) {
+        m_msg_id = std::move(msg_id);
+        m_parent_id = std::move(parent_id);
+    }
+
+    void get_trace_ids(const MessageBase &msg, std::string &msg_id, std::string &parent_id) {
+        const nl::json &header = msg.header();
+        const nl::json &parent_header = msg.parent_header();
+        msg_id = header.is_object() ? header.value("msg_id", "") : "";
+        parent_id = parent_header.is_object() ? parent_header.value("msg_id", "") : "";
+    }
+
+    bool is_trace_request(const nl::json &message) {
+        if (!message.is_object()) {
+            return false;
+        }
+        auto request = message.find("dwarf_request");
+        return request != message.end() && request->is_string() && request->get<std::string>() == "trace";
+    }
+
+    nl::json trace_reply(const nl::json &message) {
+        nl::json res;
+        Tracer &tracer = get_tracer();
+        if (!tracer.enabled()) {
+            res["status"] = "error";
+            res["what"] = "tracing disabled, set DWARF_TRACE to enable it";
+            return res;
+        }
+        auto path = message.find("path");
+        if (path != message.end() && path->is_string()) {
+            if (!tracer.dump(path->get<std::string>())) {
+                res["status"] = "error";
+                res["what"] = "could not write " + path->get<std::string>();
+                return res;
+            }
+            res["status"] = "ok";
+            res["path"] = *path;
+        } else {
+            res["status"] = "ok";
+            res["trace"] = tracer.to_chrome_trace();
+        }
+        return res;
+    }
+}
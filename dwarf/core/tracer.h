@@ -0,0 +1,146 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <collie/nlohmann/json.hpp>
+
+#include <dwarf/core/config.h>
+#include <dwarf/core/message.h>
+
+namespace nl = nlohmann;
+
+namespace dwarf {
+
+    /**
+     * @class Tracer
+     * @brief Timeline of the spans of the messages, across threads.
+     *
+     * Spans are keyed by the msg_id of the message and the msg_id of its
+     * parent. Each thread writes its spans to its own ring buffer, without
+     * locking; the oldest spans are overwritten once the ring is full. The
+     * rings are dumped in the Chrome trace format, which Perfetto and
+     * chrome://tracing open.
+     *
+     * The global tracer is enabled by setting DWARF_TRACE to the path of
+     * the file the trace is written to when the process exits.
+     */
+    class DWARF_API Tracer {
+    public:
+
+        static constexpr std::size_t default_capacity = 16384;
+
+        // Disabled when path is empty
+        explicit Tracer(std::string path = "", std::size_t capacity = default_capacity);
+
+        // Writes the trace to path when enabled
+        ~Tracer();
+
+        Tracer(const Tracer &) = delete;
+
+        Tracer &operator=(const Tracer &) = delete;
+
+        bool enabled() const noexcept;
+
+        const std::string &path() const noexcept;
+
+        // Nanoseconds on a steady clock
+        static std::uint64_t now() noexcept;
+
+        // name must be a string literal, ids are truncated to 47 characters
+        void record(const char *name,
+                    std::uint64_t start,
+                    std::uint64_t end,
+                    const std::string &msg_id,
+                    const std::string &parent_id);
+
+        // Names the track of the current thread, name must be a string literal
+        void set_thread_name(const char *name);
+
+        nl::json to_chrome_trace() const;
+
+        bool dump(const std::string &path) const;
+
+    private:
+
+        struct ring;
+        struct ring_holder;
+
+        ring &local_ring();
+
+        std::string m_path;
+        std::size_t m_capacity;
+        std::uint64_t m_id;
+        mutable std::mutex m_rings_mutex;
+        std::vector<std::shared_ptr<ring>> m_rings;
+    };
+
+    DWARF_API
+    Tracer &get_tracer();
+
+    /**
+     * @class TraceSpan
+     * @brief Records the lifetime of the span in the global tracer.
+     *
+     * Reading the ids of a message decodes its parent header, which only
+     * happens while tracing.
+     */
+    class DWARF_API TraceSpan {
+    public:
+
+        explicit TraceSpan(const char *name) noexcept;
+
+        TraceSpan(const char *name, const MessageBase &msg);
+
+        ~TraceSpan();
+
+        TraceSpan(const TraceSpan &) = delete;
+
+        TraceSpan &operator=(const TraceSpan &) = delete;
+
+        bool active() const noexcept;
+
+        // For the spans where the message is only known at the end
+        void set_message(const MessageBase &msg);
+
+        void set_ids(std::string msg_id, std::string parent_id);
+
+    private:
+
+        const char *m_name;
+        std::uint64_t m_start;
+        std::string m_msg_id;
+        std::string m_parent_id;
+    };
+
+    DWARF_API
+    void get_trace_ids(const MessageBase &msg, std::string &msg_id, std::string &parent_id);
+
+    // Reserved internal request answered with the trace, or writing it to
+    // the "path" of the request
+    DWARF_API
+    bool is_trace_request(const nl::json &message);
+
+    DWARF_API
+    nl::json trace_reply(const nl::json &message);
+}
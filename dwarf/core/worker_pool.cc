@@ -0,0 +1,78 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <exception>
+#include <iostream>
+#include <utility>
+
+#include <dwarf/core/tracer.h>
+#include <dwarf/core/worker_pool.h>
+
+namespace dwarf {
+    WorkerPool::WorkerPool(std::size_t thread_count)
+            : m_stopped(false) {
+        m_threads.reserve(thread_count);
+        for (std::size_t i = 0; i < thread_count; ++i) {
+            m_threads.emplace_back(&WorkerPool::run, this);
+        }
+    }
+
+    WorkerPool::~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopped = true;
+        }
+        m_condition.notify_all();
+        for (auto &thread: m_threads) {
+            thread.join();
+        }
+    }
+
+    std::size_t WorkerPool::size() const noexcept {
+        return m_threads.size();
+    }
+
+    void WorkerPool::post(task_type task) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.push_back(std::move(task));
+        }
+        m_condition.notify_one();
+    }
+
+    void WorkerPool::run() {
+        get_tracer().set_thread_name("worker");
+        while (true) {
+            task_type task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this]() { return m_stopped || !m_tasks.empty(); });
+                if (m_tasks.empty()) {
+                    return;
+                }
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+
+            try {
+                task();
+            }
+            catch (std::exception &e) {
+                std::cerr << "ERROR: in worker task" << std::endl;
+                std::cerr << e.what() << std::endl;
+            }
+        }
+    }
+}
@@ -0,0 +1,66 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <dwarf/core/config.h>
+
+namespace dwarf {
+
+    /**
+     * @class WorkerPool
+     * @brief Fixed set of threads running tasks in submission order.
+     *
+     * Tasks are started in the order they are posted, but may complete in
+     * any order when the pool has more than one thread. The destructor runs
+     * the tasks already posted, then joins the threads.
+     */
+    class DWARF_API WorkerPool {
+    public:
+
+        using task_type = std::function<void()>;
+
+        explicit WorkerPool(std::size_t thread_count);
+
+        ~WorkerPool();
+
+        WorkerPool(const WorkerPool &) = delete;
+
+        WorkerPool &operator=(const WorkerPool &) = delete;
+
+        std::size_t size() const noexcept;
+
+        // Can be called from any thread
+        void post(task_type task);
+
+    private:
+
+        void run();
+
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        std::deque<task_type> m_tasks;
+        bool m_stopped;
+        std::vector<std::thread> m_threads;
+    };
+}
@@ -14,11 +14,15 @@
 //
 
 
+#include <atomic>
+#include <cstdint>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <string>
 #include <stdexcept>
+#include <unordered_map>
 #include <vector>
 
 #include <openssl/hmac.h>
@@ -30,6 +34,110 @@
 
 namespace dwarf
 {
+    namespace
+    {
+        const raw_buffer_sequence NO_BUFFERS;
+
+        HMAC_CTX* new_hmac_context()
+        {
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+            // OpenSSL 1.0.x
+            HMAC_CTX* ctx = new HMAC_CTX();
+            HMAC_CTX_init(ctx);
+            return ctx;
+#else
+            return HMAC_CTX_new();
+#endif
+        }
+
+        struct hmac_context_deleter
+        {
+            void operator()(HMAC_CTX* ctx) const
+            {
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+                // OpenSSL 1.0.x
+                HMAC_CTX_cleanup(ctx);
+                delete ctx;
+#else
+                HMAC_CTX_free(ctx);
+#endif
+            }
+        };
+
+        using hmac_context_ptr = std::unique_ptr<HMAC_CTX, hmac_context_deleter>;
+
+        // Ids of the authentications alive, and number of authentications
+        // destroyed so far: a thread releases the contexts of the destroyed
+        // authentications the next time it signs after a destruction.
+        struct authentication_registry
+        {
+            std::mutex m_mutex;
+            std::set<std::uint64_t> m_live_ids;
+            std::uint64_t m_next_id = 0;
+            std::atomic<std::uint64_t> m_generation{0};
+        };
+
+        authentication_registry& get_authentication_registry()
+        {
+            static authentication_registry registry;
+            return registry;
+        }
+
+        std::uint64_t register_authentication()
+        {
+            authentication_registry& registry = get_authentication_registry();
+            std::lock_guard<std::mutex> lock(registry.m_mutex);
+            std::uint64_t id = registry.m_next_id++;
+            registry.m_live_ids.insert(id);
+            return id;
+        }
+
+        void unregister_authentication(std::uint64_t id)
+        {
+            authentication_registry& registry = get_authentication_registry();
+            std::lock_guard<std::mutex> lock(registry.m_mutex);
+            registry.m_live_ids.erase(id);
+            registry.m_generation.fetch_add(1, std::memory_order_release);
+        }
+
+        // HMAC contexts of the calling thread, indexed by authentication id
+        struct thread_hmac_contexts
+        {
+            std::unordered_map<std::uint64_t, hmac_context_ptr> m_contexts;
+            std::uint64_t m_generation = 0;
+
+            // Releases the contexts of the destroyed authentications
+            void collect()
+            {
+                authentication_registry& registry = get_authentication_registry();
+                std::uint64_t generation = registry.m_generation.load(std::memory_order_acquire);
+                if (generation == m_generation)
+                {
+                    return;
+                }
+                std::lock_guard<std::mutex> lock(registry.m_mutex);
+                for (auto iter = m_contexts.begin(); iter != m_contexts.end();)
+                {
+                    if (registry.m_live_ids.count(iter->first) == 0)
+                    {
+                        iter = m_contexts.erase(iter);
+                    }
+                    else
+                    {
+                        ++iter;
+                    }
+                }
+                m_generation = generation;
+            }
+        };
+
+        thread_hmac_contexts& get_thread_hmac_contexts()
+        {
+            thread_local thread_hmac_contexts contexts;
+            return contexts;
+        }
+    }
+
     // RawBuffer implementation
     RawBuffer::RawBuffer(const unsigned char* data, size_t size)
         : m_data(data), m_size(size)
@@ -47,31 +155,50 @@ namespace dwarf
     }
 
     // Specialization of Authentication using OpenSSL.
+    // The key is set once on a template context; every thread signs with its
+    // own copy of it, so that signing never locks nor re-keys.
     class openssl_xauthentication : public Authentication
     {
     public:
 
         openssl_xauthentication(const std::string& scheme,
-                                const std::string& key);
+                                const std::string& key,
+                                bool sign_buffers);
         virtual ~openssl_xauthentication();
 
     private:
 
-        std::string sign_impl(const RawBuffer& header,
-                              const RawBuffer& parent_header,
-                              const RawBuffer& meta_data,
-                              const RawBuffer& content) const override;
+        void sign_impl(char* signature,
+                       const RawBuffer& header,
+                       const RawBuffer& parent_header,
+                       const RawBuffer& meta_data,
+                       const RawBuffer& content,
+                       const raw_buffer_sequence& buffers) const override;
+
+        std::size_t signature_size_impl() const override;
 
         bool verify_impl(const RawBuffer& signature,
                          const RawBuffer& header,
                          const RawBuffer& parent_header,
                          const RawBuffer& meta_data,
-                         const RawBuffer& content) const override;
+                         const RawBuffer& content,
+                         const raw_buffer_sequence& buffers) const override;
+
+        HMAC_CTX* thread_context() const;
+
+        void compute_digest(unsigned char* digest,
+                            const RawBuffer& header,
+                            const RawBuffer& parent_header,
+                            const RawBuffer& meta_data,
+                            const RawBuffer& content,
+                            const raw_buffer_sequence& buffers) const;
 
         const EVP_MD* m_evp;
-        std::string m_key;
-        HMAC_CTX* m_hmac;
-        mutable std::mutex m_hmac_mutex;
+        std::size_t m_digest_size;
+        std::uint64_t m_id;
+        hmac_context_ptr p_template;
+        // Only guards the copies of the template
+        mutable std::mutex m_template_mutex;
     };
 
     // Specialization of Authentication without any signature checking.
@@ -79,29 +206,65 @@ namespace dwarf
     {
     public:
 
-        no_xauthentication() = default;
+        explicit no_xauthentication(bool sign_buffers);
         virtual ~no_xauthentication() = default;
 
     private:
 
-        std::string sign_impl(const RawBuffer& header,
-                              const RawBuffer& parent_header,
-                              const RawBuffer& meta_data,
-                              const RawBuffer& content) const override;
+        void sign_impl(char* signature,
+                       const RawBuffer& header,
+                       const RawBuffer& parent_header,
+                       const RawBuffer& meta_data,
+                       const RawBuffer& content,
+                       const raw_buffer_sequence& buffers) const override;
+
+        std::size_t signature_size_impl() const override;
 
         bool verify_impl(const RawBuffer& signature,
                          const RawBuffer& header,
                          const RawBuffer& parent_header,
                          const RawBuffer& meta_data,
-                         const RawBuffer& content) const override;
+                         const RawBuffer& content,
+                         const raw_buffer_sequence& buffers) const override;
     };
 
+    Authentication::Authentication(bool sign_buffers)
+        : m_sign_buffers(sign_buffers)
+    {
+    }
+
     std::string Authentication::sign(const RawBuffer& header,
                                       const RawBuffer& parent_header,
                                       const RawBuffer& meta_data,
                                       const RawBuffer& content) const
     {
-        return sign_impl(header, parent_header, meta_data, content);
+        return sign(header, parent_header, meta_data, content, NO_BUFFERS);
+    }
+
+    std::string Authentication::sign(const RawBuffer& header,
+                                      const RawBuffer& parent_header,
+                                      const RawBuffer& meta_data,
+                                      const RawBuffer& content,
+                                      const raw_buffer_sequence& buffers) const
+    {
+        std::string signature(signature_size(), '\0');
+        sign_into(&signature[0], header, parent_header, meta_data, content, buffers);
+        return signature;
+    }
+
+    void Authentication::sign_into(char* signature,
+                                   const RawBuffer& header,
+                                   const RawBuffer& parent_header,
+                                   const RawBuffer& meta_data,
+                                   const RawBuffer& content,
+                                   const raw_buffer_sequence& buffers) const
+    {
+        sign_impl(signature, header, parent_header, meta_data, content, m_sign_buffers ? buffers : NO_BUFFERS);
+    }
+
+    std::size_t Authentication::signature_size() const
+    {
+        return signature_size_impl();
     }
 
     bool Authentication::verify(const RawBuffer& signature,
@@ -110,19 +273,35 @@ namespace dwarf
                                  const RawBuffer& meta_data,
                                  const RawBuffer& content) const
     {
-        return verify_impl(signature, header, parent_header, meta_data, content);
+        return verify_impl(signature, header, parent_header, meta_data, content, NO_BUFFERS);
+    }
+
+    bool Authentication::verify(const RawBuffer& signature,
+                                 const RawBuffer& header,
+                                 const RawBuffer& parent_header,
+                                 const RawBuffer& meta_data,
+                                 const RawBuffer& content,
+                                 const raw_buffer_sequence& buffers) const
+    {
+        return verify_impl(signature, header, parent_header, meta_data, content, m_sign_buffers ? buffers : NO_BUFFERS);
+    }
+
+    bool Authentication::sign_buffers() const noexcept
+    {
+        return m_sign_buffers;
     }
 
     std::unique_ptr<Authentication> make_authentication(const std::string& scheme,
-                                                          const std::string& key)
+                                                          const std::string& key,
+                                                          bool sign_buffers)
     {
         if (scheme == "none")
         {
-            return std::make_unique<no_xauthentication>();
+            return std::make_unique<no_xauthentication>(sign_buffers);
         }
         else
         {
-            return std::make_unique<openssl_xauthentication>(scheme, key);
+            return std::make_unique<openssl_xauthentication>(scheme, key, sign_buffers);
         }
     }
 
@@ -146,83 +325,135 @@ namespace dwarf
         return schemes.at(scheme)();
     }
 
-    openssl_xauthentication::openssl_xauthentication(const std::string& scheme, const std::string& key)
-        : m_evp(asevp(scheme)), m_key(key)
+    openssl_xauthentication::openssl_xauthentication(const std::string& scheme,
+                                                     const std::string& key,
+                                                     bool sign_buffers)
+        : Authentication(sign_buffers)
+        , m_evp(asevp(scheme))
+        , m_digest_size(static_cast<std::size_t>(EVP_MD_size(m_evp)))
+        , m_id(register_authentication())
+        , p_template(new_hmac_context())
     {
-#if OPENSSL_VERSION_NUMBER < 0x10100000L
-        // OpenSSL 1.0.x
-        m_hmac = new HMAC_CTX();
-        HMAC_CTX_init(m_hmac);
-#else
-        m_hmac = HMAC_CTX_new();
-#endif
+        if (!p_template || !HMAC_Init_ex(p_template.get(), key.c_str(), static_cast<int>(key.size()), m_evp, nullptr))
+        {
+            throw std::runtime_error("ERROR: could not initialize HMAC context");
+        }
     }
 
     openssl_xauthentication::~openssl_xauthentication()
     {
-#if OPENSSL_VERSION_NUMBER < 0x10100000L
-        // OpenSSL 1.0.x
-        HMAC_CTX_cleanup(m_hmac);
-#else
-        HMAC_CTX_free(m_hmac);
-#endif
+        unregister_authentication(m_id);
     }
 
-    std::string openssl_xauthentication::sign_impl(const RawBuffer& header,
-                                                   const RawBuffer& parent_header,
-                                                   const RawBuffer& meta_data,
-                                                   const RawBuffer& content) const
+    HMAC_CTX* openssl_xauthentication::thread_context() const
     {
-        std::lock_guard<std::mutex> lock(m_hmac_mutex);
-        HMAC_Init_ex(m_hmac, m_key.c_str(), m_key.size(), m_evp, nullptr);
+        thread_hmac_contexts& thread_contexts = get_thread_hmac_contexts();
+        thread_contexts.collect();
+        auto& contexts = thread_contexts.m_contexts;
+        auto iter = contexts.find(m_id);
+        if (iter != contexts.end())
+        {
+            return iter->second.get();
+        }
+
+        hmac_context_ptr ctx(new_hmac_context());
+        {
+            std::lock_guard<std::mutex> lock(m_template_mutex);
+            if (!ctx || !HMAC_CTX_copy(ctx.get(), p_template.get()))
+            {
+                throw std::runtime_error("ERROR: could not initialize HMAC context");
+            }
+        }
+        HMAC_CTX* res = ctx.get();
+        contexts.emplace(m_id, std::move(ctx));
+        return res;
+    }
+
+    void openssl_xauthentication::compute_digest(unsigned char* digest,
+                                                 const RawBuffer& header,
+                                                 const RawBuffer& parent_header,
+                                                 const RawBuffer& meta_data,
+                                                 const RawBuffer& content,
+                                                 const raw_buffer_sequence& buffers) const
+    {
+        HMAC_CTX* ctx = thread_context();
+        // Resets the context to its keyed state, the key is not processed again
+        HMAC_Init_ex(ctx, nullptr, 0, nullptr, nullptr);
+
+        HMAC_Update(ctx, header.data(), header.size());
+        HMAC_Update(ctx, parent_header.data(), parent_header.size());
+        HMAC_Update(ctx, meta_data.data(), meta_data.size());
+        HMAC_Update(ctx, content.data(), content.size());
+        for (const RawBuffer& buffer : buffers)
+        {
+            HMAC_Update(ctx, buffer.data(), buffer.size());
+        }
 
-        HMAC_Update(m_hmac, header.data(), header.size());
-        HMAC_Update(m_hmac, parent_header.data(), parent_header.size());
-        HMAC_Update(m_hmac, meta_data.data(), meta_data.size());
-        HMAC_Update(m_hmac, content.data(), content.size());
+        HMAC_Final(ctx, digest, nullptr);
+    }
 
-        auto sig = std::vector<unsigned char>(EVP_MD_size(m_evp));
-        HMAC_Final(m_hmac, sig.data(), nullptr);
+    void openssl_xauthentication::sign_impl(char* signature,
+                                            const RawBuffer& header,
+                                            const RawBuffer& parent_header,
+                                            const RawBuffer& meta_data,
+                                            const RawBuffer& content,
+                                            const raw_buffer_sequence& buffers) const
+    {
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        compute_digest(digest, header, parent_header, meta_data, content, buffers);
+        hex_encode(digest, m_digest_size, signature);
+    }
 
-        std::string hex_sig = hex_string(sig);
-        return hex_sig;
+    std::size_t openssl_xauthentication::signature_size_impl() const
+    {
+        return 2 * m_digest_size;
     }
 
     bool openssl_xauthentication::verify_impl(const RawBuffer& signature,
                                               const RawBuffer& header,
                                               const RawBuffer& parent_header,
                                               const RawBuffer& meta_data,
-                                              const RawBuffer& content) const
+                                              const RawBuffer& content,
+                                              const raw_buffer_sequence& buffers) const
     {
-        std::lock_guard<std::mutex> lock(m_hmac_mutex);
-        HMAC_Init_ex(m_hmac, m_key.c_str(), m_key.size(), m_evp, nullptr);
+        // Malformed signatures are rejected without hashing anything
+        unsigned char expected[EVP_MAX_MD_SIZE];
+        if (signature.size() != 2 * m_digest_size
+            || !hex_decode(reinterpret_cast<const char*>(signature.data()), m_digest_size, expected))
+        {
+            return false;
+        }
 
-        HMAC_Update(m_hmac, header.data(), header.size());
-        HMAC_Update(m_hmac, parent_header.data(), parent_header.size());
-        HMAC_Update(m_hmac, meta_data.data(), meta_data.size());
-        HMAC_Update(m_hmac, content.data(), content.size());
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        compute_digest(digest, header, parent_header, meta_data, content, buffers);
+        return CRYPTO_memcmp(expected, digest, m_digest_size) == 0;
+    }
 
-        auto sig = std::vector<unsigned char>(EVP_MD_size(m_evp));
-        HMAC_Final(m_hmac, sig.data(), nullptr);
+    no_xauthentication::no_xauthentication(bool sign_buffers)
+        : Authentication(sign_buffers)
+    {
+    }
 
-        std::string hex_sig = hex_string(sig);
-        auto cmp = CRYPTO_memcmp(reinterpret_cast<const void*>(hex_sig.c_str()), signature.data(), hex_sig.size());
-        return cmp == 0;
+    void no_xauthentication::sign_impl(char* /*signature*/,
+                                       const RawBuffer& /*header*/,
+                                       const RawBuffer& /*parent_header*/,
+                                       const RawBuffer& /*meta_data*/,
+                                       const RawBuffer& /*content*/,
+                                       const raw_buffer_sequence& /*buffers*/) const
+    {
     }
 
-    std::string no_xauthentication::sign_impl(const RawBuffer& /*header*/,
-                                              const RawBuffer& /*parent_header*/,
-                                              const RawBuffer& /*meta_data*/,
-                                              const RawBuffer& /*content*/) const
+    std::size_t no_xauthentication::signature_size_impl() const
     {
-        return std::string();
+        return 0;
     }
 
     bool no_xauthentication::verify_impl(const RawBuffer& /*signature*/,
                                          const RawBuffer& /*header*/,
                                          const RawBuffer& /*parent_header*/,
                                          const RawBuffer& /*meta_data*/,
-                                         const RawBuffer& /*content*/) const
+                                         const RawBuffer& /*content*/,
+                                         const raw_buffer_sequence& /*buffers*/) const
     {
         return true;
     }
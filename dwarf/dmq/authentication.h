@@ -16,8 +16,10 @@
 
 #pragma once
 
+#include <cstddef>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <dwarf/core/config.h>
 
@@ -38,6 +40,8 @@ namespace dwarf {
         size_t m_size;
     };
 
+    using raw_buffer_sequence = std::vector<RawBuffer>;
+
     class DWARF_API Authentication {
     public:
 
@@ -56,31 +60,69 @@ namespace dwarf {
                          const RawBuffer &meta_data,
                          const RawBuffer &content) const;
 
+        // The binary buffers are part of the signature only when the
+        // authentication was created with sign_buffers enabled.
+        std::string sign(const RawBuffer &header,
+                         const RawBuffer &parent_header,
+                         const RawBuffer &meta_data,
+                         const RawBuffer &content,
+                         const raw_buffer_sequence &buffers) const;
+
+        // Writes the signature_size() characters of the signature to
+        // signature, e.g. directly into an outgoing frame.
+        void sign_into(char *signature,
+                       const RawBuffer &header,
+                       const RawBuffer &parent_header,
+                       const RawBuffer &meta_data,
+                       const RawBuffer &content,
+                       const raw_buffer_sequence &buffers) const;
+
+        std::size_t signature_size() const;
+
         bool verify(const RawBuffer &signature,
                     const RawBuffer &header,
                     const RawBuffer &parent_header,
                     const RawBuffer &meta_data,
                     const RawBuffer &content) const;
 
+        bool verify(const RawBuffer &signature,
+                    const RawBuffer &header,
+                    const RawBuffer &parent_header,
+                    const RawBuffer &meta_data,
+                    const RawBuffer &content,
+                    const raw_buffer_sequence &buffers) const;
+
+        bool sign_buffers() const noexcept;
+
     protected:
 
-        Authentication() = default;
+        explicit Authentication(bool sign_buffers = false);
 
     private:
 
-        virtual std::string sign_impl(const RawBuffer &header,
-                                      const RawBuffer &parent_header,
-                                      const RawBuffer &meta_data,
-                                      const RawBuffer &content) const = 0;
+        virtual void sign_impl(char *signature,
+                               const RawBuffer &header,
+                               const RawBuffer &parent_header,
+                               const RawBuffer &meta_data,
+                               const RawBuffer &content,
+                               const raw_buffer_sequence &buffers) const = 0;
+
+        virtual std::size_t signature_size_impl() const = 0;
 
         virtual bool verify_impl(const RawBuffer &signature,
                                  const RawBuffer &header,
                                  const RawBuffer &parent_header,
                                  const RawBuffer &meta_data,
-                                 const RawBuffer &content) const = 0;
+                                 const RawBuffer &content,
+                                 const raw_buffer_sequence &buffers) const = 0;
+
+        bool m_sign_buffers;
     };
 
+    // sign_buffers extends the signature to the binary buffers. This is not
+    // part of the Jupyter protocol, both ends of the connection must agree on it.
     DWARF_API
     std::unique_ptr<Authentication> make_authentication(const std::string &scheme,
-                                                          const std::string &key);
+                                                          const std::string &key,
+                                                          bool sign_buffers = false);
 }
\ No newline at end of file
@@ -18,9 +18,11 @@
 #include <chrono>
 #include <iostream>
 
+#include <dwarf/core/tracer.h>
 #include <dwarf/dmq/middleware.h>
 #include <dwarf/dmq/server_zmq_split.h>
 #include <dwarf/dmq/control.h>
+#include <dwarf/dmq/wire_capture.h>
 
 namespace dwarf {
     Control::Control(zmq::context_t &context,
@@ -29,7 +31,7 @@ namespace dwarf {
                      const std::string &control_port,
                      ServerZmqSplit *server)
             : m_control(context, zmq::socket_type::router), m_publisher_pub(context, zmq::socket_type::pub),
-              m_messenger(context), p_server(server), m_request_stop(false) {
+              m_messenger(context), p_server(server), p_capture(nullptr), m_request_stop(false) {
         init_socket(m_control, transport, ip, control_port);
         m_publisher_pub.set(zmq::sockopt::linger, get_socket_linger());
         m_publisher_pub.connect(get_publisher_end_point());
@@ -46,18 +48,34 @@ namespace dwarf {
         m_messenger.connect();
     }
 
+    void Control::set_capture(WireCapture *capture) noexcept {
+        p_capture = capture;
+    }
+
     ControlMessenger &Control::get_messenger() {
         return m_messenger;
     }
 
     void Control::run() {
+        get_tracer().set_thread_name("control");
         m_request_stop = false;
 
         while (!m_request_stop) {
             zmq::multipart_t wire_msg;
             wire_msg.recv(m_control);
+            count_wire_message(metric_socket::CONTROL, metric_direction::RECEIVED, wire_msg);
+            if (p_capture != nullptr) {
+                p_capture->record(metric_socket::CONTROL, metric_direction::RECEIVED, wire_msg);
+            }
             try {
-                Message msg = p_server->deserialize(wire_msg);
+                Message msg;
+                {
+                    TraceSpan span("recv");
+                    MetricsTimer timer(metric_stage::deserialize, metric_socket::CONTROL);
+                    msg = p_server->deserialize(wire_msg);
+                    timer.set_kind(msg.kind());
+                    span.set_message(msg);
+                }
                 p_server->notify_control_listener(std::move(msg));
             }
             catch (std::exception &e) {
@@ -74,6 +92,10 @@ namespace dwarf {
     }
 
     void Control::send_control(zmq::multipart_t &message) {
+        count_wire_message(metric_socket::CONTROL, metric_direction::SENT, message);
+        if (p_capture != nullptr) {
+            p_capture->record(metric_socket::CONTROL, metric_direction::SENT, message);
+        }
         message.send(m_control);
     }
 
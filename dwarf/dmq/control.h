@@ -25,6 +25,8 @@
 namespace dwarf {
     class ServerZmqSplit;
 
+    class WireCapture;
+
     class Control {
     public:
 
@@ -42,6 +44,9 @@ namespace dwarf {
 
         void connect_messenger();
 
+        // Must be called before run, capture must outlive the control
+        void set_capture(WireCapture *capture) noexcept;
+
         ControlMessenger &get_messenger();
 
         void run();
@@ -59,6 +64,7 @@ namespace dwarf {
         // Internal sockets for controlling other threads
         ZmqMessenger m_messenger;
         ServerZmqSplit *p_server;
+        WireCapture *p_capture;
         bool m_request_stop;
     };
 }
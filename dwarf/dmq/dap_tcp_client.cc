@@ -16,10 +16,21 @@
 #include <dwarf/zmq/zmq_addon.hpp>
 #include <collie/nlohmann/json.hpp>
 #include <dwarf/core/message.h>
+#include <dwarf/core/tracer.h>
 #include <dwarf/dmq/zmq_serializer.h>
 #include <dwarf/dmq/dap_tcp_client.h>
 
 namespace dwarf {
+    namespace {
+        // Traced DAP messages are attached to the debug request being handled
+        void trace_debug_request(TraceSpan &span, const std::string &parent_header) {
+            if (span.active() && !parent_header.empty()) {
+                nl::json header = nl::json::parse(parent_header, nullptr, false);
+                span.set_ids("", header.is_object() ? header.value("msg_id", "") : "");
+            }
+        }
+    }
+
     /*********************************
      * DapTcpClient implemenation *
      *********************************/
@@ -42,7 +53,7 @@ namespace dwarf {
               m_controller_header(context, zmq::socket_type::rep), m_dap_tcp_type(dap_config.m_dap_tcp_type),
               m_dap_init_type(dap_config.m_dap_init_type), m_user_name(dap_config.m_user_name),
               m_session_id(dap_config.m_session_id), m_event_callback(cb),
-              p_auth(dwarf::make_authentication(config.m_signature_scheme, config.m_key)), m_parent_header(""),
+              p_auth(dwarf::make_authentication(config.m_signature_scheme, config.m_key, config.m_sign_buffers)), m_parent_header(""),
               m_request_stop(false) {
         m_tcp_socket.set(zmq::sockopt::linger, socket_linger);
         m_publisher.set(zmq::sockopt::linger, socket_linger);
@@ -139,6 +150,7 @@ namespace dwarf {
                                          std::string publisher_end_point,
                                          std::string controller_end_point,
                                          std::string controller_header_end_point) {
+        get_tracer().set_thread_name("dap_client");
         m_publisher.connect(publisher_end_point);
         m_controller.connect(controller_end_point);
         m_controller_header.connect(controller_header_end_point);
@@ -221,6 +233,8 @@ namespace dwarf {
     void DapTcpClient::handle_control_socket() {
         zmq::message_t message;
         (void) m_controller.recv(message);
+        TraceSpan span("dap_request");
+        trace_debug_request(span, m_parent_header);
 
         if (m_wait_attach) {
             std::string raw_message = std::string(message.data<const char>(), message.size());
@@ -309,6 +323,8 @@ namespace dwarf {
         while (!m_message_queue.empty()) {
             const std::string &raw_message = m_message_queue.front();
             nl::json message = nl::json::parse(raw_message);
+            TraceSpan span(message["type"] == "event" ? "dap_event" : "dap_response");
+            trace_debug_request(span, m_parent_header);
             // message is either an event or a response
             if (message["type"] == "event") {
                 handle_event(std::move(message));
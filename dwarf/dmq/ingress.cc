@@ -0,0 +1,447 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <utility>
+
+#include <dwarf/core/tracer.h>
+#include <dwarf/dmq/middleware.h>
+#include <dwarf/dmq/ingress.h>
+#include <dwarf/dmq/wire_capture.h>
+#include <dwarf/dmq/zmq_serializer.h>
+
+namespace dwarf {
+    namespace {
+        void drain_signals(zmq::socket_t &socket) {
+            zmq::message_t signal;
+            while (socket.recv(signal, zmq::recv_flags::dontwait)) {
+            }
+        }
+    }
+
+    Ingress::Ingress(zmq::context_t &context,
+                     const std::string &transport,
+                     const std::string &ip,
+                     const std::string &port,
+                     const std::string &name,
+                     std::size_t capacity,
+                     std::size_t receive_batch_size)
+            : m_socket(context, zmq::socket_type::router), m_controller(context, zmq::socket_type::rep),
+              m_stop_requester(context, zmq::socket_type::req),
+              m_request_signal_pull(context, zmq::socket_type::pull),
+              m_request_signal_push(context, zmq::socket_type::push),
+              m_reply_signal_pull(context, zmq::socket_type::pull),
+              m_reply_signal_push(context, zmq::socket_type::push),
+              m_requests(capacity), m_replies(capacity), m_pending(1), m_pending_count(0), m_depth(0),
+              m_ingress_sleeping(false), m_executor_sleeping(false), m_ingress_blocked(false),
+              m_blocked_entry(), m_blocked(false), m_receive_batch_size(std::max(receive_batch_size, std::size_t(1))),
+              m_kind_priorities(), m_default_priority(0), m_max_overtakes(0), m_overtaken(1, 0), m_sequence(0), p_queue_waits(new Histogram[1]),
+              p_capture(nullptr) {
+        init_socket(m_socket, transport, ip, port);
+
+        std::string controller_end_point = get_controller_end_point(name + "_ingress");
+        init_socket(m_controller, controller_end_point);
+        m_stop_requester.set(zmq::sockopt::linger, get_socket_linger());
+        m_stop_requester.connect(controller_end_point);
+
+        std::string request_end_point = get_controller_end_point(name + "_ingress_requests");
+        m_request_signal_pull.bind(request_end_point);
+        m_request_signal_push.set(zmq::sockopt::linger, 0);
+        m_request_signal_push.connect(request_end_point);
+
+        std::string reply_end_point = get_controller_end_point(name + "_ingress_replies");
+        m_reply_signal_pull.bind(reply_end_point);
+        m_reply_signal_push.set(zmq::sockopt::linger, 0);
+        m_reply_signal_push.connect(reply_end_point);
+    }
+
+    Ingress::~Ingress() {
+        stop();
+    }
+
+    std::string Ingress::get_port() const {
+        return get_socket_port(m_socket);
+    }
+
+    void Ingress::set_priorities(std::map<std::string, std::size_t> priorities,
+                                 std::size_t default_priority,
+                                 std::size_t max_overtakes) {
+        std::size_t count = default_priority + 1;
+        for (const auto &priority: priorities) {
+            count = std::max(count, priority.second + 1);
+        }
+        m_kind_priorities.fill(default_priority);
+        m_priorities.clear();
+        for (const auto &priority: priorities) {
+            message_kind kind = to_message_kind(priority.first);
+            if (kind == message_kind::unknown) {
+                m_priorities.insert(priority);
+            } else {
+                m_kind_priorities[std::size_t(kind)] = priority.second;
+            }
+        }
+        m_default_priority = default_priority;
+        m_max_overtakes = max_overtakes;
+        m_pending = std::vector<entry_list>(count);
+        m_overtaken = std::vector<std::size_t>(count, 0);
+        p_queue_waits.reset(new Histogram[count]);
+    }
+
+    void Ingress::set_capture(WireCapture *capture) noexcept {
+        p_capture = capture;
+    }
+
+    void Ingress::start(deserializer_type deserializer, interceptor_type interceptor) {
+        m_deserializer = std::move(deserializer);
+        m_interceptor = std::move(interceptor);
+        m_thread = ZmqThread(&Ingress::run, this);
+    }
+
+    void Ingress::stop() {
+        if (m_thread.joinable()) {
+            zmq::message_t stop_msg("stop", 4);
+            zmq::message_t response;
+            m_stop_requester.send(stop_msg, zmq::send_flags::none);
+            (void) m_stop_requester.recv(response);
+            m_thread.join();
+        }
+    }
+
+    void Ingress::send(zmq::multipart_t &message) {
+        while (!m_replies.try_push(message)) {
+            std::this_thread::yield();
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_ingress_sleeping.exchange(false)) {
+            std::lock_guard<std::mutex> lock(m_reply_signal_mutex);
+            (void) m_reply_signal_push.send(zmq::message_t(), zmq::send_flags::dontwait);
+        }
+    }
+
+    bool Ingress::try_pop(Message &msg) {
+        collect();
+        if (m_pending_count == 0) {
+            return false;
+        }
+
+        std::size_t priority = select_priority();
+        request_entry &entry = m_pending[priority].front();
+        for (std::size_t other = 0; other < m_pending.size(); ++other) {
+            if (other != priority && !m_pending[other].empty() &&
+                m_pending[other].front().m_sequence < entry.m_sequence) {
+                ++m_overtaken[other];
+            }
+        }
+        m_overtaken[priority] = 0;
+        auto wait = clock_type::now() - entry.m_received;
+        p_queue_waits[priority].record(
+                static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(wait).count()));
+        get_metrics().record(metric_stage::queue_wait, metric_socket::SHELL, entry.m_msg.kind(),
+                             static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count()));
+        msg = std::move(entry.m_msg);
+        m_pending[priority].pop_front();
+        --m_pending_count;
+        --m_depth;
+        return true;
+    }
+
+    std::vector<Message> Ingress::extract_if(const predicate_type &pred) {
+        collect();
+        std::vector<request_entry> extracted;
+        for (std::size_t priority = 0; priority < m_pending.size(); ++priority) {
+            entry_list &entries = m_pending[priority];
+            if (entries.empty()) {
+                continue;
+            }
+            std::uint64_t head = entries.front().m_sequence;
+            entry_list kept;
+            for (request_entry &entry: entries) {
+                if (pred(entry.m_msg)) {
+                    extracted.push_back(std::move(entry));
+                } else {
+                    kept.push_back(std::move(entry));
+                }
+            }
+            entries.swap(kept);
+            // A new head has not been overtaken yet
+            if (entries.empty() || entries.front().m_sequence != head) {
+                m_overtaken[priority] = 0;
+            }
+        }
+        std::sort(extracted.begin(), extracted.end(), [](const request_entry &lhs, const request_entry &rhs) {
+            return lhs.m_sequence < rhs.m_sequence;
+        });
+
+        std::vector<Message> res;
+        res.reserve(extracted.size());
+        for (request_entry &entry: extracted) {
+            res.push_back(std::move(entry.m_msg));
+        }
+        m_pending_count -= res.size();
+        m_depth -= res.size();
+        return res;
+    }
+
+    void Ingress::for_each(const visitor_type &visitor) {
+        collect();
+        for (const request_entry *entry: pending_in_order()) {
+            visitor(entry->m_msg);
+        }
+    }
+
+    void Ingress::drain_until(clock_type::time_point deadline, const consumer_type &consumer) {
+        while (true) {
+            Message msg;
+            if (!try_pop(msg)) {
+                auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - clock_type::now());
+                if (remaining.count() <= 0) {
+                    return;
+                }
+                poll(nullptr, 0, remaining.count());
+                continue;
+            }
+
+            try {
+                consumer(std::move(msg));
+            }
+            catch (std::exception &e) {
+                std::cerr << e.what() << std::endl;
+            }
+        }
+    }
+
+    void Ingress::poll(zmq::pollitem_t *items, int nb_items, long timeout) {
+        zmq::pollitem_t all_items[4];
+        std::copy(items, items + nb_items, all_items);
+        all_items[nb_items] = {m_request_signal_pull, 0, ZMQ_POLLIN, 0};
+
+        m_executor_sleeping.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_pending_count != 0 || !m_requests.empty()) {
+            // Requests are ready, only report the events already there
+            m_executor_sleeping.store(false);
+            zmq::poll(&all_items[0], nb_items, std::chrono::milliseconds(0));
+        } else {
+            zmq::poll(&all_items[0], nb_items + 1, std::chrono::milliseconds(timeout));
+            m_executor_sleeping.store(false);
+            if (all_items[nb_items].revents & ZMQ_POLLIN) {
+                drain_signals(m_request_signal_pull);
+            }
+        }
+
+        for (int i = 0; i < nb_items; ++i) {
+            items[i].revents = all_items[i].revents;
+        }
+    }
+
+    std::size_t Ingress::depth() const noexcept {
+        return m_depth.load(std::memory_order_relaxed);
+    }
+
+    const Histogram &Ingress::receive_batch_sizes() const noexcept {
+        return m_receive_batch_sizes;
+    }
+
+    std::size_t Ingress::priority_count() const noexcept {
+        return m_pending.size();
+    }
+
+    const Histogram &Ingress::queue_waits(std::size_t priority) const noexcept {
+        return p_queue_waits[priority];
+    }
+
+    void Ingress::run() {
+        get_tracer().set_thread_name("shell_ingress");
+        zmq::pollitem_t items[] = {
+                {m_socket,            0, ZMQ_POLLIN, 0},
+                {m_reply_signal_pull, 0, ZMQ_POLLIN, 0},
+                {m_controller,        0, ZMQ_POLLIN, 0}
+        };
+
+        while (true) {
+            send_replies();
+            if (m_blocked) {
+                push_blocked();
+            }
+            // The socket is only read when the requests can be queued
+            items[0].events = m_blocked ? 0 : ZMQ_POLLIN;
+            // A sender that sees m_ingress_sleeping set wakes the thread up,
+            // otherwise the reply queue is checked again before polling.
+            m_ingress_sleeping.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!m_replies.empty()) {
+                m_ingress_sleeping.store(false);
+                continue;
+            }
+
+            zmq::poll(&items[0], 3, std::chrono::milliseconds(-1));
+            m_ingress_sleeping.store(false);
+
+            if (items[0].revents & ZMQ_POLLIN) {
+                receive_requests();
+            }
+
+            if (items[1].revents & ZMQ_POLLIN) {
+                drain_signals(m_reply_signal_pull);
+            }
+
+            if (items[2].revents & ZMQ_POLLIN) {
+                // stop message
+                send_replies();
+                zmq::multipart_t wire_msg;
+                wire_msg.recv(m_controller);
+                wire_msg.send(m_controller);
+                break;
+            }
+        }
+    }
+
+    void Ingress::receive_requests() {
+        std::size_t batch_size = 0;
+        zmq::multipart_t wire_msg;
+        while (!m_blocked && batch_size < m_receive_batch_size && wire_msg.recv(m_socket, ZMQ_DONTWAIT)) {
+            ++batch_size;
+            count_wire_message(metric_socket::SHELL, metric_direction::RECEIVED, wire_msg);
+            if (p_capture != nullptr) {
+                p_capture->record(metric_socket::SHELL, metric_direction::RECEIVED, wire_msg);
+            }
+            TraceSpan span("recv");
+            try {
+                Message msg;
+                {
+                    MetricsTimer timer(metric_stage::deserialize, metric_socket::SHELL);
+                    msg = m_deserializer(wire_msg);
+                    timer.set_kind(msg.kind());
+                }
+                span.set_message(msg);
+                if (!m_interceptor || !m_interceptor(msg)) {
+                    request_entry entry;
+                    entry.m_priority = m_kind_priorities[std::size_t(msg.kind())];
+                    if (msg.kind() == message_kind::unknown && !m_priorities.empty()) {
+                        auto iter = m_priorities.find(msg.msg_type());
+                        entry.m_priority = iter == m_priorities.end() ? m_default_priority : iter->second;
+                    }
+                    entry.m_sequence = m_sequence++;
+                    entry.m_received = clock_type::now();
+                    entry.m_msg = std::move(msg);
+                    ++m_depth;
+                    if (m_requests.try_push(entry)) {
+                        wake_executor();
+                    } else {
+                        m_blocked_entry = std::move(entry);
+                        m_blocked = true;
+                        push_blocked();
+                    }
+                }
+            }
+            catch (std::exception &e) {
+                std::cerr << e.what() << std::endl;
+            }
+            wire_msg.clear();
+        }
+        m_receive_batch_sizes.record(batch_size);
+    }
+
+    void Ingress::send_replies() {
+        zmq::multipart_t wire_msg;
+        while (m_replies.try_pop(wire_msg)) {
+            count_wire_message(metric_socket::SHELL, metric_direction::SENT, wire_msg);
+            if (p_capture != nullptr) {
+                p_capture->record(metric_socket::SHELL, metric_direction::SENT, wire_msg);
+            }
+            TraceSpan span("reply_send");
+            if (span.active()) {
+                std::string msg_id, parent_id;
+                xzmq_serializer::peek_ids(wire_msg, msg_id, parent_id);
+                span.set_ids(std::move(msg_id), std::move(parent_id));
+            }
+            wire_msg.send(m_socket);
+        }
+    }
+
+    void Ingress::collect() {
+        request_entry entry;
+        bool collected = false;
+        while (m_requests.try_pop(entry)) {
+            std::size_t priority = entry.m_priority;
+            m_pending[priority].push_back(std::move(entry));
+            ++m_pending_count;
+            collected = true;
+        }
+
+        if (collected) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (m_ingress_blocked.exchange(false)) {
+                std::lock_guard<std::mutex> lock(m_reply_signal_mutex);
+                (void) m_reply_signal_push.send(zmq::message_t(), zmq::send_flags::dontwait);
+            }
+        }
+    }
+
+    void Ingress::push_blocked() {
+        // The executor that frees room after the flag is set signals the
+        // ingress thread, otherwise the push below sees the room.
+        m_ingress_blocked.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_requests.try_push(m_blocked_entry)) {
+            m_ingress_blocked.store(false);
+            m_blocked = false;
+            wake_executor();
+        }
+    }
+
+    std::size_t Ingress::select_priority() const {
+        // The lowest class goes first, unless the head of a class has been
+        // overtaken too many times: the oldest of those heads goes first then.
+        std::size_t res = m_pending.size();
+        bool res_starved = false;
+        for (std::size_t priority = 0; priority < m_pending.size(); ++priority) {
+            if (m_pending[priority].empty()) {
+                continue;
+            }
+            bool starved = m_overtaken[priority] >= m_max_overtakes;
+            if (res == m_pending.size() || (starved && !res_starved) ||
+                (starved && m_pending[priority].front().m_sequence < m_pending[res].front().m_sequence)) {
+                res = priority;
+                res_starved = starved;
+            }
+        }
+        return res;
+    }
+
+    auto Ingress::pending_in_order() -> std::vector<request_entry *> {
+        std::vector<request_entry *> res;
+        res.reserve(m_pending_count);
+        for (entry_list &entries: m_pending) {
+            for (request_entry &entry: entries) {
+                res.push_back(&entry);
+            }
+        }
+        std::sort(res.begin(), res.end(), [](const request_entry *lhs, const request_entry *rhs) {
+            return lhs->m_sequence < rhs->m_sequence;
+        });
+        return res;
+    }
+
+    void Ingress::wake_executor() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_executor_sleeping.exchange(false)) {
+            (void) m_request_signal_push.send(zmq::message_t(), zmq::send_flags::dontwait);
+        }
+    }
+}
@@ -0,0 +1,206 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <dwarf/zmq/zmq.hpp>
+#include <dwarf/zmq/zmq_addon.hpp>
+
+#include <dwarf/core/histogram.h>
+#include <dwarf/core/message.h>
+#include <dwarf/core/mpsc_queue.h>
+#include <dwarf/dmq/thread.h>
+
+namespace dwarf {
+    class WireCapture;
+
+    /**
+     * @class Ingress
+     * @brief Receives the requests of a ROUTER socket on a dedicated thread.
+     *
+     * The ingress thread owns the socket: it receives, authenticates and
+     * deserializes the requests, and queues them for the executor thread,
+     * so that decoding the next requests overlaps with the execution of the
+     * current one. The deserializer may leave sections to be decoded on
+     * first access by the executor. Replies are queued the other way and sent by the ingress
+     * thread. Each side wakes the other up through an inproc socket, only
+     * when the other side is waiting on an empty queue. While the request
+     * queue is full, the ingress thread stops reading the socket and leaves
+     * the backlog to zmq, until the executor collects the queued requests;
+     * it keeps sending the replies meanwhile.
+     *
+     * Requests are sorted into priority classes by msg_type, 0 being served
+     * first. The order of reception is kept within a class, and the request
+     * at the head of a class is served once it has been overtaken a given
+     * number of times by requests of other classes, so that lower classes
+     * are not starved.
+     *
+     * try_pop, extract_if, for_each and poll must be called from a single
+     * executor thread.
+     */
+    class Ingress {
+    public:
+
+        using deserializer_type = std::function<Message(zmq::multipart_t &)>;
+        // Returns true when it takes over a request, which is then not queued
+        using interceptor_type = std::function<bool(Message &)>;
+        using predicate_type = std::function<bool(const Message &)>;
+        using visitor_type = std::function<void(const Message &)>;
+        using consumer_type = std::function<void(Message)>;
+
+        Ingress(zmq::context_t &context,
+                const std::string &transport,
+                const std::string &ip,
+                const std::string &port,
+                const std::string &name,
+                std::size_t capacity,
+                std::size_t receive_batch_size);
+
+        ~Ingress();
+
+        std::string get_port() const;
+
+        // Must be called before start. With max_overtakes set to 0, the
+        // requests are served in reception order.
+        void set_priorities(std::map<std::string, std::size_t> priorities,
+                            std::size_t default_priority,
+                            std::size_t max_overtakes);
+
+        // Must be called before start, capture must outlive the ingress
+        void set_capture(WireCapture *capture) noexcept;
+
+        void start(deserializer_type deserializer, interceptor_type interceptor = interceptor_type());
+
+        // Sends the pending replies and stops the ingress thread
+        void stop();
+
+        // Can be called from any thread, blocks while the queue is full
+        void send(zmq::multipart_t &message);
+
+        // Pops the oldest request of the class to serve next
+        bool try_pop(Message &msg);
+
+        // Removes the queued requests matching pred, in reception order
+        std::vector<Message> extract_if(const predicate_type &pred);
+
+        // Visits the queued requests in reception order
+        void for_each(const visitor_type &visitor);
+
+        // Hands the queued requests to consumer without sleeping, then those
+        // received until the deadline
+        void drain_until(std::chrono::steady_clock::time_point deadline, const consumer_type &consumer);
+
+        // Waits for a request or an event on items, at most 3 of them
+        void poll(zmq::pollitem_t *items, int nb_items, long timeout);
+
+        // Number of queued requests
+        std::size_t depth() const noexcept;
+
+        // Number of requests received per wakeup of the ingress thread
+        const Histogram &receive_batch_sizes() const noexcept;
+
+        std::size_t priority_count() const noexcept;
+
+        // Time spent in the queue by the requests of a priority class (us)
+        const Histogram &queue_waits(std::size_t priority) const noexcept;
+
+    private:
+
+        using clock_type = std::chrono::steady_clock;
+
+        struct request_entry {
+            Message m_msg;
+            std::size_t m_priority = 0;
+            std::uint64_t m_sequence = 0;
+            clock_type::time_point m_received;
+        };
+
+        using entry_list = std::deque<request_entry>;
+
+        void run();
+
+        void receive_requests();
+
+        void send_replies();
+
+        void collect();
+
+        // Retries queuing the request kept aside while the queue was full
+        void push_blocked();
+
+        // Index of the class to serve next, m_pending must not be empty
+        std::size_t select_priority() const;
+
+        std::vector<request_entry *> pending_in_order();
+
+        void wake_executor();
+
+        zmq::socket_t m_socket;
+        zmq::socket_t m_controller;
+        zmq::socket_t m_stop_requester;
+        zmq::socket_t m_request_signal_pull;
+        zmq::socket_t m_request_signal_push;
+        zmq::socket_t m_reply_signal_pull;
+        zmq::socket_t m_reply_signal_push;
+        std::mutex m_reply_signal_mutex;
+
+        MpscQueue<request_entry> m_requests;
+        MpscQueue<zmq::multipart_t> m_replies;
+        // Requests moved out of m_requests by the executor, one list per
+        // priority class
+        std::vector<entry_list> m_pending;
+        std::size_t m_pending_count;
+        std::atomic<std::size_t> m_depth;
+        std::atomic<bool> m_ingress_sleeping;
+        std::atomic<bool> m_executor_sleeping;
+        // Set by the ingress thread when it waits for room in m_requests,
+        // the executor then signals it once it has collected the requests
+        std::atomic<bool> m_ingress_blocked;
+        // Only used by the ingress thread
+        request_entry m_blocked_entry;
+        bool m_blocked;
+
+        deserializer_type m_deserializer;
+        interceptor_type m_interceptor;
+        std::size_t m_receive_batch_size;
+        Histogram m_receive_batch_sizes;
+
+        // By message kind, m_priorities only holds the unknown types
+        std::array<std::size_t, message_kind_count> m_kind_priorities;
+        std::map<std::string, std::size_t> m_priorities;
+        std::size_t m_default_priority;
+        std::size_t m_max_overtakes;
+        // Number of times the head of each class has been overtaken
+        std::vector<std::size_t> m_overtaken;
+        // Only used by the ingress thread
+        std::uint64_t m_sequence;
+        std::unique_ptr<Histogram[]> p_queue_waits;
+        WireCapture *p_capture;
+        ZmqThread m_thread;
+    };
+}
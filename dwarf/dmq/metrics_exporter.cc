@@ -0,0 +1,105 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <chrono>
+#include <string>
+
+#include <dwarf/zmq/zmq_addon.hpp>
+#include <dwarf/core/metrics.h>
+#include <dwarf/dmq/middleware.h>
+#include <dwarf/dmq/metrics_exporter.h>
+
+namespace dwarf {
+    MetricsExporter::MetricsExporter(zmq::context_t &context, const std::string &port)
+            : m_exporter(context, zmq::socket_type::stream), m_controller(context, zmq::socket_type::rep),
+              m_stop_requester(context, zmq::socket_type::req) {
+        init_socket(m_exporter, "tcp", "127.0.0.1", port);
+        std::string controller_end_point = get_controller_end_point("metrics_exporter");
+        init_socket(m_controller, controller_end_point);
+        m_stop_requester.set(zmq::sockopt::linger, get_socket_linger());
+        m_stop_requester.connect(controller_end_point);
+    }
+
+    MetricsExporter::~MetricsExporter() {
+        stop();
+    }
+
+    std::string MetricsExporter::get_port() const {
+        return get_socket_port(m_exporter);
+    }
+
+    void MetricsExporter::start() {
+        m_thread = ZmqThread(&MetricsExporter::run, this);
+    }
+
+    void MetricsExporter::stop() {
+        if (m_thread.joinable()) {
+            zmq::message_t stop_msg("stop", 4);
+            zmq::message_t response;
+            m_stop_requester.send(stop_msg, zmq::send_flags::none);
+            (void) m_stop_requester.recv(response);
+            m_thread.join();
+        }
+    }
+
+    void MetricsExporter::run() {
+        zmq::pollitem_t items[] = {
+                {m_exporter,   0, ZMQ_POLLIN, 0},
+                {m_controller, 0, ZMQ_POLLIN, 0}
+        };
+
+        while (true) {
+            zmq::poll(&items[0], 2, std::chrono::milliseconds(-1));
+
+            if (items[0].revents & ZMQ_POLLIN) {
+                // Connection identity followed by the received data, which
+                // is empty when a peer connects or disconnects
+                zmq::multipart_t wire_msg;
+                wire_msg.recv(m_exporter);
+                if (wire_msg.size() == 2 && wire_msg[1].size() != 0) {
+                    zmq::message_t id = wire_msg.pop();
+                    reply(id);
+                }
+            }
+
+            if (items[1].revents & ZMQ_POLLIN) {
+                // stop message
+                zmq::multipart_t wire_msg;
+                wire_msg.recv(m_controller);
+                wire_msg.send(m_controller);
+                break;
+            }
+        }
+    }
+
+    void MetricsExporter::reply(zmq::message_t &id) {
+        std::string body = get_metrics().to_prometheus();
+        std::string response = "HTTP/1.1 200 OK\r\n"
+                               "Content-Type: text/plain; version=0.0.4\r\n"
+                               "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                               "Connection: close\r\n\r\n" + body;
+
+        zmq::multipart_t wire_msg;
+        wire_msg.add(zmq::message_t(id.data(), id.size()));
+        wire_msg.addstr(response);
+        wire_msg.send(m_exporter);
+
+        // An empty frame closes the connection
+        zmq::multipart_t close_msg;
+        close_msg.add(std::move(id));
+        close_msg.add(zmq::message_t());
+        close_msg.send(m_exporter);
+    }
+}
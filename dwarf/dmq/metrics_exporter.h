@@ -0,0 +1,58 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <string>
+
+#include <dwarf/zmq/zmq.hpp>
+
+#include <dwarf/dmq/thread.h>
+
+namespace dwarf {
+
+    /**
+     * @class MetricsExporter
+     * @brief Serves the metrics registry in the Prometheus text format.
+     *
+     * Minimal HTTP endpoint on a STREAM socket bound to the loopback
+     * interface: every request gets the current metrics and the connection
+     * is closed.
+     */
+    class MetricsExporter {
+    public:
+
+        MetricsExporter(zmq::context_t &context, const std::string &port);
+
+        ~MetricsExporter();
+
+        std::string get_port() const;
+
+        void start();
+
+        void stop();
+
+    private:
+
+        void run();
+
+        void reply(zmq::message_t &id);
+
+        zmq::socket_t m_exporter;
+        zmq::socket_t m_controller;
+        zmq::socket_t m_stop_requester;
+        ZmqThread m_thread;
+    };
+}
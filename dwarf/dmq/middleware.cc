@@ -86,6 +86,22 @@ namespace dwarf {
         return end_point.substr(end_point.find_last_of(":") + 1);
     }
 
+    void count_wire_message(metric_socket socket, metric_direction direction, const zmq::multipart_t &wire_msg) {
+        Metrics &metrics = get_metrics();
+        if (!metrics.enabled()) {
+            return;
+        }
+        std::uint64_t bytes = 0;
+        for (const zmq::message_t &frame: wire_msg) {
+            bytes += frame.size();
+        }
+        metrics.count(socket, direction, bytes);
+    }
+
+    message_kind get_metric_kind(const MessageBase &msg) {
+        return get_metrics().enabled() ? msg.kind() : message_kind::unknown;
+    }
+
     std::string find_free_port(std::size_t max_tries, int start, int stop) {
         static const std::string transport = "tcp";
         static const std::string ip = "127.0.0.1";
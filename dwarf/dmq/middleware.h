@@ -19,7 +19,10 @@
 #include <string>
 
 #include <dwarf/zmq/zmq.hpp>
+#include <dwarf/zmq/zmq_addon.hpp>
 #include <dwarf/core/config.h>
+#include <dwarf/core/message.h>
+#include <dwarf/core/metrics.h>
 
 namespace dwarf
 {
@@ -48,6 +51,15 @@ namespace dwarf
     DWARF_API
     std::string get_socket_port(const zmq::socket_t& socket);
 
+    // Counts a message and its bytes in the metrics registry
+    DWARF_API
+    void count_wire_message(metric_socket socket, metric_direction direction, const zmq::multipart_t& wire_msg);
+
+    // Kind of an outgoing message for the metrics timers, only resolved when
+    // the metrics are enabled since it parses a lazy header
+    DWARF_API
+    message_kind get_metric_kind(const MessageBase& msg);
+
     DWARF_API
     std::string find_free_port(std::size_t max_tries = 100, int start = 49152, int stop = 65536);
 }
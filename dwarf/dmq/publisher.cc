@@ -14,20 +14,42 @@
 //
 
 
+#include <chrono>
 #include <string>
+#include <thread>
 #include <iostream>
+#include <vector>
 
 #include <dwarf/zmq/zmq_addon.hpp>
+#include <dwarf/core/tracer.h>
 #include <dwarf/dmq/middleware.h>
 #include <dwarf/dmq/publisher.h>
+#include <dwarf/dmq/wire_capture.h>
+#include <dwarf/dmq/zmq_serializer.h>
 
 namespace dwarf {
+    namespace {
+        // Maximum number of queued messages serialized before being sent
+        // under a single lock of the external socket
+        const std::size_t max_batch_size = 64;
+
+        void trace_relay(TraceSpan &span, const zmq::multipart_t &wire_msg) {
+            if (span.active()) {
+                std::string msg_id, parent_id;
+                xzmq_serializer::peek_ids(wire_msg, msg_id, parent_id);
+                span.set_ids(std::move(msg_id), std::move(parent_id));
+            }
+        }
+    }
+
     Publisher::Publisher(zmq::context_t &context,
                          const std::string &transport,
                          const std::string &ip,
                          const std::string &port)
             : m_publisher(context, zmq::socket_type::pub), m_listener(context, zmq::socket_type::sub),
-              m_controller(context, zmq::socket_type::rep) {
+              m_controller(context, zmq::socket_type::rep), m_wakeup_pull(context, zmq::socket_type::pull),
+              m_wakeup_push(context, zmq::socket_type::push), m_sleeping(false), m_stopped(false),
+              p_capture(nullptr) {
         init_socket(m_publisher, transport, ip, port);
         m_listener.set(zmq::sockopt::subscribe, "");
         m_listener.bind(get_publisher_end_point());
@@ -43,22 +65,58 @@ namespace dwarf {
     }
 
     void Publisher::run() {
+        get_tracer().set_thread_name("iopub");
         zmq::pollitem_t items[] = {
-                {m_listener,   0, ZMQ_POLLIN, 0},
-                {m_controller, 0, ZMQ_POLLIN, 0}
+                {m_listener,    0, ZMQ_POLLIN, 0},
+                {m_controller,  0, ZMQ_POLLIN, 0},
+                {m_wakeup_pull, 0, ZMQ_POLLIN, 0}
         };
+        int nb_items = p_queue != nullptr ? 3 : 2;
 
         while (true) {
-            zmq::poll(&items[0], 2, std::chrono::milliseconds(-1));
+            if (p_queue != nullptr) {
+                while (send_queued()) {
+                }
+                // A producer that sees m_sleeping set wakes the thread up,
+                // otherwise the queue is checked again before polling.
+                m_sleeping.store(true);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (!p_queue->empty()) {
+                    m_sleeping.store(false);
+                    continue;
+                }
+            }
+
+            zmq::poll(&items[0], nb_items, std::chrono::milliseconds(-1));
+            m_sleeping.store(false);
 
             if (items[0].revents & ZMQ_POLLIN) {
                 zmq::multipart_t wire_msg;
                 wire_msg.recv(m_listener);
+                TraceSpan span("relay");
+                trace_relay(span, wire_msg);
+                count_wire_message(metric_socket::IOPUB, metric_direction::SENT, wire_msg);
+                if (p_capture != nullptr) {
+                    p_capture->record(metric_socket::IOPUB, metric_direction::SENT, wire_msg);
+                }
+                std::lock_guard<std::mutex> lock(m_publisher_mutex);
                 wire_msg.send(m_publisher);
             }
 
+            if (items[2].revents & ZMQ_POLLIN) {
+                zmq::multipart_t wakeup_msg;
+                while (wakeup_msg.recv(m_wakeup_pull, ZMQ_DONTWAIT)) {
+                    wakeup_msg.clear();
+                }
+            }
+
             if (items[1].revents & ZMQ_POLLIN) {
-                // stop message
+                // stop message, sent once the pending messages are published
+                if (p_queue != nullptr) {
+                    while (send_queued()) {
+                    }
+                }
+                m_stopped.store(true);
                 zmq::multipart_t wire_msg;
                 wire_msg.recv(m_controller);
                 wire_msg.send(m_controller);
@@ -66,4 +124,70 @@ namespace dwarf {
             }
         }
     }
+
+    void Publisher::publish(zmq::multipart_t &message) {
+        count_wire_message(metric_socket::IOPUB, metric_direction::SENT, message);
+        if (p_capture != nullptr) {
+            p_capture->record(metric_socket::IOPUB, metric_direction::SENT, message);
+        }
+        std::lock_guard<std::mutex> lock(m_publisher_mutex);
+        message.send(m_publisher);
+    }
+
+    void Publisher::enable_queue(std::size_t capacity, serializer_type serializer) {
+        p_queue = std::make_unique<queue_type>(capacity);
+        m_serializer = std::move(serializer);
+        std::string end_point = get_controller_end_point("publisher_wakeup");
+        m_wakeup_pull.bind(end_point);
+        m_wakeup_push.set(zmq::sockopt::linger, 0);
+        m_wakeup_push.connect(end_point);
+    }
+
+    void Publisher::enqueue(PubMessage message) {
+        while (!p_queue->try_push(message)) {
+            // Nothing drains the queue anymore, e.g. during shutdown
+            if (m_stopped.load()) {
+                std::cerr << "ERROR: publisher stopped, dropping iopub message "
+                          << message.msg_type() << std::endl;
+                return;
+            }
+            std::this_thread::yield();
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleeping.exchange(false)) {
+            std::lock_guard<std::mutex> lock(m_wakeup_mutex);
+            (void) m_wakeup_push.send(zmq::message_t(), zmq::send_flags::dontwait);
+        }
+    }
+
+    void Publisher::set_capture(WireCapture *capture) noexcept {
+        p_capture = capture;
+    }
+
+    bool Publisher::send_queued() {
+        std::vector<zmq::multipart_t> batch;
+        PubMessage message;
+        std::size_t popped = 0;
+        while (popped < max_batch_size && p_queue->try_pop(message)) {
+            ++popped;
+            try {
+                batch.push_back(m_serializer(std::move(message)));
+            }
+            catch (std::exception &e) {
+                std::cerr << "ERROR: could not serialize iopub message: " << e.what() << std::endl;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_publisher_mutex);
+        for (zmq::multipart_t &wire_msg: batch) {
+            TraceSpan span("relay");
+            trace_relay(span, wire_msg);
+            count_wire_message(metric_socket::IOPUB, metric_direction::SENT, wire_msg);
+            if (p_capture != nullptr) {
+                p_capture->record(metric_socket::IOPUB, metric_direction::SENT, wire_msg);
+            }
+            wire_msg.send(m_publisher);
+        }
+        return popped == max_batch_size;
+    }
 }
@@ -13,17 +13,29 @@
 // limitations under the License.
 //
 
-
 #pragma once
 
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
 
 #include <dwarf/zmq/zmq.hpp>
+#include <dwarf/zmq/zmq_addon.hpp>
+
+#include <dwarf/core/message.h>
+#include <dwarf/core/mpsc_queue.h>
 
 namespace dwarf {
+    class WireCapture;
+
     class Publisher {
     public:
 
+        using serializer_type = std::function<zmq::multipart_t(PubMessage)>;
+
         Publisher(zmq::context_t &context,
                   const std::string &transport,
                   const std::string &ip,
@@ -35,10 +47,41 @@ namespace dwarf {
 
         void run();
 
+        // Sends the message on the external socket without going through
+        // the relay, can be called from any thread.
+        void publish(zmq::multipart_t &message);
+
+        // Must be called before run: messages passed to enqueue are then
+        // serialized and sent by the publisher thread.
+        void enable_queue(std::size_t capacity, serializer_type serializer);
+
+        // Can be called from any thread, blocks while the queue is full and
+        // the publisher thread is running
+        void enqueue(PubMessage message);
+
+        // Must be called before run, capture must outlive the publisher
+        void set_capture(WireCapture *capture) noexcept;
+
     private:
 
+        bool send_queued();
+
         zmq::socket_t m_publisher;
         zmq::socket_t m_listener;
         zmq::socket_t m_controller;
+        std::mutex m_publisher_mutex;
+
+        using queue_type = MpscQueue<PubMessage>;
+        std::unique_ptr<queue_type> p_queue;
+        serializer_type m_serializer;
+        // Wakes the publisher thread up when it is polling an empty queue
+        zmq::socket_t m_wakeup_pull;
+        zmq::socket_t m_wakeup_push;
+        std::mutex m_wakeup_mutex;
+        std::atomic<bool> m_sleeping;
+        // Set when the publisher thread exits, enqueue then drops the
+        // messages instead of waiting for room in a full queue
+        std::atomic<bool> m_stopped;
+        WireCapture *p_capture;
     };
 }
@@ -43,7 +43,7 @@ namespace dwarf
         ServerZmqSplit::start_heartbeat_thread();
         ServerZmqSplit::start_shell_thread();
 
-        ServerZmqSplit::get_controller().publish(wire_msg);
+        ServerZmqSplit::publish_wire_msg(wire_msg, channel::CONTROL);
         ServerZmqSplit::get_controller().run();
     }
 
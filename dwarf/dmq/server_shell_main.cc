@@ -44,7 +44,7 @@ namespace dwarf
         ServerZmqSplit::start_heartbeat_thread();
         ServerZmqSplit::start_control_thread();
 
-        ServerZmqSplit::get_shell().publish(wire_msg);
+        ServerZmqSplit::publish_wire_msg(wire_msg, channel::SHELL);
         ServerZmqSplit::get_shell().run();
     }
 
@@ -14,17 +14,22 @@
 //
 
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 
 #include <dwarf/zmq/zmq_addon.hpp>
 #include <dwarf/core/guid.h>
+#include <dwarf/core/tracer.h>
 #include <dwarf/dmq/server_zmq.h>
 #include <dwarf/dmq/middleware.h>
 #include <dwarf/dmq/zmq_serializer.h>
 #include <dwarf/dmq/publisher.h>
 #include <dwarf/dmq/heartbeat.h>
+#include <dwarf/dmq/ingress.h>
+#include <dwarf/dmq/metrics_exporter.h>
 #include <dwarf/dmq/trivial_messenger.h>
+#include <dwarf/dmq/wire_capture.h>
 
 namespace dwarf
 {
@@ -32,7 +37,9 @@ namespace dwarf
     ServerZmq::ServerZmq(zmq::context_t& context,
                              const Configuration& config,
                              nl::json::error_handler_t eh)
-        : m_shell(context, zmq::socket_type::router)
+        : p_capture(config.m_capture_path.empty() ? nullptr : new WireCapture(config.m_capture_path))
+        , p_shell(new Ingress(context, config.m_transport, config.m_ip, config.m_shell_port, "shell",
+                              config.m_ingress_queue_capacity, config.m_receive_batch_size))
         , m_controller(context, zmq::socket_type::router)
         , m_stdin(context, zmq::socket_type::router)
         , m_publisher_pub(context, zmq::socket_type::pub)
@@ -43,11 +50,22 @@ namespace dwarf
         , m_iopub_thread()
         , m_hb_thread()
         , p_messenger(new TrivialMessenger(this))
-        , p_auth(make_authentication(config.m_signature_scheme, config.m_key))
+        , p_auth(make_authentication(config.m_signature_scheme, config.m_key, config.m_sign_buffers))
         , m_error_handler(eh)
+        , m_decoding_policy(config.m_decoding_policy)
+        , m_iopub_mode(config.m_iopub_mode)
+        , m_receive_batch_size(std::max(config.m_receive_batch_size, std::size_t(1)))
         , m_request_stop(false)
     {
-        init_socket(m_shell, config.m_transport, config.m_ip, config.m_shell_port);
+        p_shell->set_priorities(config.m_shell_priorities,
+                                config.m_shell_default_priority,
+                                config.m_shell_max_overtakes);
+        if (!config.m_metrics_port.empty())
+        {
+            p_metrics_exporter.reset(new MetricsExporter(context, config.m_metrics_port));
+        }
+        p_shell->set_capture(p_capture.get());
+        p_publisher->set_capture(p_capture.get());
         init_socket(m_controller, config.m_transport, config.m_ip, config.m_control_port);
         init_socket(m_stdin, config.m_transport, config.m_ip, config.m_stdin_port);
         m_publisher_pub.set(zmq::sockopt::linger, get_socket_linger());
@@ -57,12 +75,45 @@ namespace dwarf
         m_publisher_controller.connect(get_controller_end_point("publisher"));
         m_heartbeat_controller.set(zmq::sockopt::linger, get_socket_linger());
         m_heartbeat_controller.connect(get_controller_end_point("heartbeat"));
+
+        if (m_iopub_mode == iopub_mode::QUEUED)
+        {
+            p_publisher->enable_queue(config.m_iopub_queue_capacity, [this](PubMessage msg) {
+                MetricsTimer timer(metric_stage::serialize, metric_socket::IOPUB, get_metric_kind(msg));
+                return xzmq_serializer::serialize_iopub(std::move(msg), *p_auth, m_error_handler);
+            });
+        }
     }
 
     // Has to be in the cpp because incomplete
     // types are used in unique_ptr in the header
     ServerZmq::~ServerZmq() = default;
 
+    const Histogram& ServerZmq::receive_batch_sizes() const noexcept
+    {
+        return p_shell->receive_batch_sizes();
+    }
+
+    std::size_t ServerZmq::shell_queue_depth() const noexcept
+    {
+        return p_shell->depth();
+    }
+
+    const Histogram& ServerZmq::shell_queue_waits(std::size_t priority) const noexcept
+    {
+        return p_shell->queue_waits(priority);
+    }
+
+    std::vector<Message> ServerZmq::extract_shell_requests(const std::function<bool(const Message&)>& pred)
+    {
+        std::vector<Message> res = p_shell->extract_if(pred);
+        for (const Message& msg : res)
+        {
+            Server::notify_discarded_shell_listener(msg);
+        }
+        return res;
+    }
+
     ControlMessenger& ServerZmq::get_control_messenger_impl()
     {
         return *p_messenger;
@@ -70,26 +121,68 @@ namespace dwarf
 
     void ServerZmq::send_shell_impl(Message msg)
     {
-        zmq::multipart_t wire_msg = xzmq_serializer::serialize(std::move(msg), *p_auth, m_error_handler);
-        wire_msg.send(m_shell);
+        message_kind kind = get_metric_kind(msg);
+        zmq::multipart_t wire_msg;
+        {
+            MetricsTimer timer(metric_stage::serialize, metric_socket::SHELL, kind);
+            wire_msg = xzmq_serializer::serialize(std::move(msg), *p_auth, m_error_handler);
+        }
+        // The ingress thread sends the reply, this only times the handover
+        MetricsTimer timer(metric_stage::send, metric_socket::SHELL, kind);
+        p_shell->send(wire_msg);
     }
 
     void ServerZmq::send_control_impl(Message msg)
     {
-        zmq::multipart_t wire_msg = xzmq_serializer::serialize(std::move(msg), *p_auth, m_error_handler);
+        message_kind kind = get_metric_kind(msg);
+        zmq::multipart_t wire_msg;
+        {
+            MetricsTimer timer(metric_stage::serialize, metric_socket::CONTROL, kind);
+            wire_msg = xzmq_serializer::serialize(std::move(msg), *p_auth, m_error_handler);
+        }
+        count_wire_message(metric_socket::CONTROL, metric_direction::SENT, wire_msg);
+        if (p_capture != nullptr)
+        {
+            p_capture->record(metric_socket::CONTROL, metric_direction::SENT, wire_msg);
+        }
+        MetricsTimer timer(metric_stage::send, metric_socket::CONTROL, kind);
         wire_msg.send(m_controller);
     }
 
     void ServerZmq::send_stdin_impl(Message msg)
     {
-        zmq::multipart_t wire_msg = xzmq_serializer::serialize(std::move(msg), *p_auth, m_error_handler);
-        wire_msg.send(m_stdin);
+        message_kind kind = get_metric_kind(msg);
+        zmq::multipart_t wire_msg;
+        {
+            MetricsTimer timer(metric_stage::serialize, metric_socket::STDIN, kind);
+            wire_msg = xzmq_serializer::serialize(std::move(msg), *p_auth, m_error_handler);
+        }
+        std::lock_guard<std::mutex> lock(m_stdin_mutex);
+        count_wire_message(metric_socket::STDIN, metric_direction::SENT, wire_msg);
+        if (p_capture != nullptr)
+        {
+            p_capture->record(metric_socket::STDIN, metric_direction::SENT, wire_msg);
+        }
+        {
+            MetricsTimer timer(metric_stage::send, metric_socket::STDIN, kind);
+            wire_msg.send(m_stdin);
+        }
         zmq::multipart_t wire_reply;
 	// Block until a response to the input request is received.
         wire_reply.recv(m_stdin);
+        count_wire_message(metric_socket::STDIN, metric_direction::RECEIVED, wire_reply);
+        if (p_capture != nullptr)
+        {
+            p_capture->record(metric_socket::STDIN, metric_direction::RECEIVED, wire_reply);
+        }
         try
         {
-            Message reply = xzmq_serializer::deserialize(wire_reply, *p_auth);
+            Message reply;
+            {
+                MetricsTimer timer(metric_stage::deserialize, metric_socket::STDIN);
+                reply = xzmq_serializer::deserialize(wire_reply, *p_auth);
+                timer.set_kind(reply.kind());
+            }
             Server::notify_stdin_listener(std::move(reply));
         }
         catch (std::exception& e)
@@ -100,14 +193,42 @@ namespace dwarf
 
     void ServerZmq::publish_impl(PubMessage msg, channel)
     {
-        zmq::multipart_t wire_msg = xzmq_serializer::serialize_iopub(std::move(msg), *p_auth, m_error_handler);
-        wire_msg.send(m_publisher_pub);
+        if (m_iopub_mode == iopub_mode::QUEUED)
+        {
+            p_publisher->enqueue(std::move(msg));
+            return;
+        }
+        message_kind kind = get_metric_kind(msg);
+        zmq::multipart_t wire_msg;
+        {
+            MetricsTimer timer(metric_stage::serialize, metric_socket::IOPUB, kind);
+            wire_msg = xzmq_serializer::serialize_iopub(std::move(msg), *p_auth, m_error_handler);
+        }
+        MetricsTimer timer(metric_stage::send, metric_socket::IOPUB, kind);
+        if (m_iopub_mode == iopub_mode::DIRECT)
+        {
+            p_publisher->publish(wire_msg);
+        }
+        else
+        {
+            wire_msg.send(m_publisher_pub);
+        }
     }
 
     void ServerZmq::start_impl(PubMessage message)
     {
+        get_tracer().set_thread_name("kernel");
+        p_shell->start([this](zmq::multipart_t& wire_msg) {
+            return xzmq_serializer::deserialize(wire_msg, *p_auth, m_decoding_policy);
+        }, [this](Message& msg) {
+            return Server::notify_concurrent_shell_listener(msg);
+        });
         start_publisher_thread();
         start_heartbeat_thread();
+        if (p_metrics_exporter != nullptr)
+        {
+            p_metrics_exporter->start();
+        }
 
         m_request_stop = false;
 
@@ -133,57 +254,79 @@ namespace dwarf
 
     void ServerZmq::poll(long timeout)
     {
-        zmq::pollitem_t items[]
-            = { { m_controller, 0, ZMQ_POLLIN, 0 }, { m_shell, 0, ZMQ_POLLIN, 0 } };
-
-        zmq::poll(&items[0], 2, std::chrono::milliseconds(timeout));
+        zmq::pollitem_t items[] = { { m_controller, 0, ZMQ_POLLIN, 0 } };
+        p_shell->poll(&items[0], 1, timeout);
 
-        try
+        // Control messages first, so that they keep priority over the shell
+        // requests already queued.
+        std::size_t batch_size = 0;
+        while (batch_size < m_receive_batch_size && !m_request_stop)
         {
-            if (items[0].revents & ZMQ_POLLIN)
+            if (receive_control() || dispatch_shell())
+            {
+                ++batch_size;
+            }
+            else
             {
-                zmq::multipart_t wire_msg;
-                wire_msg.recv(m_controller);
-                Message msg = xzmq_serializer::deserialize(wire_msg, *p_auth);
-                Server::notify_control_listener(std::move(msg));
+                break;
             }
+        }
+    }
 
-            if (!m_request_stop && (items[1].revents & ZMQ_POLLIN))
+    bool ServerZmq::receive_control()
+    {
+        zmq::multipart_t wire_msg;
+        if (!wire_msg.recv(m_controller, ZMQ_DONTWAIT))
+        {
+            return false;
+        }
+
+        count_wire_message(metric_socket::CONTROL, metric_direction::RECEIVED, wire_msg);
+        if (p_capture != nullptr)
+        {
+            p_capture->record(metric_socket::CONTROL, metric_direction::RECEIVED, wire_msg);
+        }
+        try
+        {
+            Message msg;
             {
-                zmq::multipart_t wire_msg;
-                wire_msg.recv(m_shell);
-                Message msg = xzmq_serializer::deserialize(wire_msg, *p_auth);
-                Server::notify_shell_listener(std::move(msg));
+                TraceSpan span("recv");
+                MetricsTimer timer(metric_stage::deserialize, metric_socket::CONTROL);
+                msg = xzmq_serializer::deserialize(wire_msg, *p_auth, m_decoding_policy);
+                timer.set_kind(msg.kind());
+                span.set_message(msg);
             }
+            Server::notify_control_listener(std::move(msg));
         }
         catch (std::exception& e)
         {
             std::cerr << e.what() << std::endl;
         }
+        return true;
     }
 
-    void ServerZmq::abort_queue_impl(const listener& l, long polling_interval)
+    bool ServerZmq::dispatch_shell()
     {
-        while (true)
+        Message msg;
+        if (!p_shell->try_pop(msg))
         {
-            zmq::multipart_t wire_msg;
-            bool msg = wire_msg.recv(m_shell, ZMQ_NOBLOCK);
-            if (!msg)
-            {
-                return;
-            }
+            return false;
+        }
 
-            try
-            {
-                Message msg = xzmq_serializer::deserialize(wire_msg, *p_auth);
-                l(std::move(msg));
-            }
-            catch (std::exception& e)
-            {
-                std::cerr << e.what() << std::endl;
-            }
-            std::this_thread::sleep_for(std::chrono::milliseconds(polling_interval));
+        try
+        {
+            Server::notify_shell_listener(std::move(msg));
+        }
+        catch (std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
         }
+        return true;
+    }
+
+    void ServerZmq::abort_queue_impl(const listener& l, long grace_period)
+    {
+        p_shell->drain_until(std::chrono::steady_clock::now() + std::chrono::milliseconds(grace_period), l);
     }
 
     void ServerZmq::stop_impl()
@@ -194,14 +337,20 @@ namespace dwarf
     void ServerZmq::update_config_impl(Configuration& config) const
     {
         config.m_control_port = get_socket_port(m_controller);
-        config.m_shell_port = get_socket_port(m_shell);
+        config.m_shell_port = p_shell->get_port();
         config.m_stdin_port = get_socket_port(m_stdin);
         config.m_iopub_port = p_publisher->get_port();
         config.m_hb_port = p_heartbeat->get_port();
+        if (p_metrics_exporter != nullptr)
+        {
+            config.m_metrics_port = p_metrics_exporter->get_port();
+        }
     }
 
     void ServerZmq::stop_channels()
     {
+        p_shell->stop();
+
         zmq::message_t stop_msg("stop", 4);
         zmq::message_t response;
 
@@ -212,6 +361,11 @@ namespace dwarf
         // Wait for heartbeat answer
         m_heartbeat_controller.send(stop_msg, zmq::send_flags::none);
         (void)m_heartbeat_controller.recv(response);
+
+        if (p_metrics_exporter != nullptr)
+        {
+            p_metrics_exporter->stop();
+        }
     }
 
     std::unique_ptr<Server> make_xserver_zmq(Context& context,
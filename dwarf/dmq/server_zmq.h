@@ -16,6 +16,10 @@
 
 #pragma once
 
+#include <functional>
+#include <mutex>
+#include <vector>
+
 #include <dwarf/zmq/zmq.hpp>
 
 #include <dwarf/core/context.h>
@@ -23,6 +27,7 @@
 #include <dwarf/core/server.h>
 
 #include <dwarf/core/config.h>
+#include <dwarf/core/histogram.h>
 #include <dwarf/dmq/authentication.h>
 #include <dwarf/dmq/thread.h>
 
@@ -31,13 +36,22 @@ namespace dwarf {
 
     class Heartbeat;
 
+    class Ingress;
+
+    class MetricsExporter;
+
     class TrivialMessenger;
 
+    class WireCapture;
+
     class DWARF_API ServerZmq : public Server {
     public:
 
         using publisher_ptr = std::unique_ptr<Publisher>;
         using heartbeat_ptr = std::unique_ptr<Heartbeat>;
+        using ingress_ptr = std::unique_ptr<Ingress>;
+        using metrics_exporter_ptr = std::unique_ptr<MetricsExporter>;
+        using capture_ptr = std::unique_ptr<WireCapture>;
 
         ServerZmq(zmq::context_t &context,
                     const Configuration &config,
@@ -47,6 +61,20 @@ namespace dwarf {
 
         using Server::notify_internal_listener;
 
+        // Number of shell requests received per wakeup of the ingress thread
+        const Histogram &receive_batch_sizes() const noexcept;
+
+        // Number of shell requests received but not dispatched yet
+        std::size_t shell_queue_depth() const noexcept;
+
+        // Time spent in the queue by the shell requests of a priority class,
+        // in microseconds, see Configuration::m_shell_priorities
+        const Histogram &shell_queue_waits(std::size_t priority) const noexcept;
+
+        // Removes the queued shell requests matching pred, in reception
+        // order. Must be called from the thread executing the requests.
+        std::vector<Message> extract_shell_requests(const std::function<bool(const Message &)> &pred);
+
     protected:
 
         ControlMessenger &get_control_messenger_impl() override;
@@ -61,7 +89,7 @@ namespace dwarf {
 
         void start_impl(PubMessage msg) override;
 
-        void abort_queue_impl(const listener &l, long polling_interval) override;
+        void abort_queue_impl(const listener &l, long grace_period) override;
 
         void stop_impl() override;
 
@@ -69,21 +97,32 @@ namespace dwarf {
 
         void poll(long timeout);
 
+        bool receive_control();
+
+        bool dispatch_shell();
+
         void start_publisher_thread();
 
         void start_heartbeat_thread();
 
         void stop_channels();
 
-        zmq::socket_t m_shell;
+        // Only created when Configuration::m_capture_path is set, declared
+        // first to outlive the threads recording in it
+        capture_ptr p_capture;
+        ingress_ptr p_shell;
         zmq::socket_t m_controller;
         zmq::socket_t m_stdin;
+        // Pairs each input request with its reply on m_stdin
+        std::mutex m_stdin_mutex;
         zmq::socket_t m_publisher_pub;
         zmq::socket_t m_publisher_controller;
         zmq::socket_t m_heartbeat_controller;
 
         publisher_ptr p_publisher;
         heartbeat_ptr p_heartbeat;
+        // Only created when Configuration::m_metrics_port is set
+        metrics_exporter_ptr p_metrics_exporter;
 
         ZmqThread m_iopub_thread;
         ZmqThread m_hb_thread;
@@ -94,6 +133,9 @@ namespace dwarf {
         using authentication_ptr = std::unique_ptr<Authentication>;
         authentication_ptr p_auth;
         nl::json::error_handler_t m_error_handler;
+        decoding_policy m_decoding_policy;
+        iopub_mode m_iopub_mode;
+        std::size_t m_receive_batch_size;
 
         bool m_request_stop;
     };
@@ -24,22 +24,41 @@
 #include <dwarf/dmq/zmq_serializer.h>
 #include <dwarf/dmq/control.h>
 #include <dwarf/dmq/heartbeat.h>
+#include <dwarf/dmq/metrics_exporter.h>
 #include <dwarf/dmq/publisher.h>
 #include <dwarf/dmq/shell.h>
+#include <dwarf/dmq/wire_capture.h>
 #include <dwarf/dmq/zmq_messenger.h>
 
 namespace dwarf {
     ServerZmqSplit::ServerZmqSplit(zmq::context_t &context,
                                    const Configuration &config,
                                    nl::json::error_handler_t eh)
-            : p_controller(new Control(context, config.m_transport, config.m_ip, config.m_control_port, this)),
+            : p_capture(config.m_capture_path.empty() ? nullptr : new WireCapture(config.m_capture_path)),
+              p_controller(new Control(context, config.m_transport, config.m_ip, config.m_control_port, this)),
               p_heartbeat(new Heartbeat(context, config.m_transport, config.m_ip, config.m_hb_port)),
               p_publisher(new Publisher(context, config.m_transport, config.m_ip, config.m_iopub_port)),
               p_shell(new Shell(context, config.m_transport, config.m_ip, config.m_shell_port, config.m_stdin_port,
-                                 this)), m_control_thread(), m_hb_thread(), m_iopub_thread(), m_shell_thread(),
-              p_auth(make_authentication(config.m_signature_scheme, config.m_key)), m_error_handler(eh),
+                                config.m_ingress_queue_capacity, config.m_receive_batch_size, this)), m_control_thread(), m_hb_thread(), m_iopub_thread(), m_shell_thread(),
+              p_auth(make_authentication(config.m_signature_scheme, config.m_key, config.m_sign_buffers)), m_error_handler(eh),
+              m_decoding_policy(config.m_decoding_policy), m_iopub_mode(config.m_iopub_mode),
               m_control_stopped(false) {
+        p_shell->set_priorities(config.m_shell_priorities,
+                                config.m_shell_default_priority,
+                                config.m_shell_max_overtakes);
+        if (!config.m_metrics_port.empty()) {
+            p_metrics_exporter.reset(new MetricsExporter(context, config.m_metrics_port));
+        }
         p_controller->connect_messenger();
+        p_controller->set_capture(p_capture.get());
+        p_shell->set_capture(p_capture.get());
+        p_publisher->set_capture(p_capture.get());
+        if (m_iopub_mode == iopub_mode::QUEUED) {
+            p_publisher->enable_queue(config.m_iopub_queue_capacity, [this](PubMessage msg) {
+                MetricsTimer timer(metric_stage::serialize, metric_socket::IOPUB, get_metric_kind(msg));
+                return xzmq_serializer::serialize_iopub(std::move(msg), *p_auth, m_error_handler);
+            });
+        }
     }
 
     // Has to be in the cpp because incomplete
@@ -47,9 +66,13 @@ namespace dwarf {
     ServerZmqSplit::~ServerZmqSplit() = default;
 
     zmq::multipart_t ServerZmqSplit::notify_internal_listener(zmq::multipart_t &wire_msg) {
-        nl::json msg = nl::json::parse(wire_msg.popstr());
+        zmq::message_t frame = wire_msg.pop();
+        const char *data = frame.data<const char>();
+        nl::json msg = nl::json::parse(data, data + frame.size());
         nl::json reply = Server::notify_internal_listener(msg);
-        return zmq::multipart_t(reply.dump(-1, ' ', false, m_error_handler));
+        zmq::multipart_t wire_reply;
+        wire_reply.add(xzmq_serializer::serialize_json(reply, m_error_handler));
+        return wire_reply;
     }
 
     void ServerZmqSplit::notify_control_stopped() {
@@ -57,7 +80,27 @@ namespace dwarf {
     }
 
     Message ServerZmqSplit::deserialize(zmq::multipart_t &wire_msg) const {
-        return xzmq_serializer::deserialize(wire_msg, *p_auth);
+        return xzmq_serializer::deserialize(wire_msg, *p_auth, m_decoding_policy);
+    }
+
+    const Histogram &ServerZmqSplit::receive_batch_sizes() const noexcept {
+        return p_shell->receive_batch_sizes();
+    }
+
+    std::size_t ServerZmqSplit::shell_queue_depth() const noexcept {
+        return p_shell->queue_depth();
+    }
+
+    const Histogram &ServerZmqSplit::shell_queue_waits(std::size_t priority) const noexcept {
+        return p_shell->queue_waits(priority);
+    }
+
+    std::vector<Message> ServerZmqSplit::extract_shell_requests(const std::function<bool(const Message &)> &pred) {
+        std::vector<Message> res = p_shell->extract_queued_requests(pred);
+        for (const Message &msg: res) {
+            notify_discarded_shell_listener(msg);
+        }
+        return res;
     }
 
     ControlMessenger &ServerZmqSplit::get_control_messenger_impl() {
@@ -65,36 +108,64 @@ namespace dwarf {
     }
 
     void ServerZmqSplit::send_shell_impl(Message msg) {
-        zmq::multipart_t wire_msg = xzmq_serializer::serialize(std::move(msg), *p_auth, m_error_handler);
+        message_kind kind = get_metric_kind(msg);
+        zmq::multipart_t wire_msg;
+        {
+            MetricsTimer timer(metric_stage::serialize, metric_socket::SHELL, kind);
+            wire_msg = xzmq_serializer::serialize(std::move(msg), *p_auth, m_error_handler);
+        }
+        // The ingress thread sends the reply, this only times the handover
+        MetricsTimer timer(metric_stage::send, metric_socket::SHELL, kind);
         p_shell->send_shell(wire_msg);
     }
 
     void ServerZmqSplit::send_control_impl(Message msg) {
-        zmq::multipart_t wire_msg = xzmq_serializer::serialize(std::move(msg), *p_auth, m_error_handler);
+        message_kind kind = get_metric_kind(msg);
+        zmq::multipart_t wire_msg;
+        {
+            MetricsTimer timer(metric_stage::serialize, metric_socket::CONTROL, kind);
+            wire_msg = xzmq_serializer::serialize(std::move(msg), *p_auth, m_error_handler);
+        }
+        MetricsTimer timer(metric_stage::send, metric_socket::CONTROL, kind);
         p_controller->send_control(wire_msg);
     }
 
     void ServerZmqSplit::send_stdin_impl(Message msg) {
-        zmq::multipart_t wire_msg = xzmq_serializer::serialize(std::move(msg), *p_auth, m_error_handler);
+        message_kind kind = get_metric_kind(msg);
+        zmq::multipart_t wire_msg;
+        {
+            MetricsTimer timer(metric_stage::serialize, metric_socket::STDIN, kind);
+            wire_msg = xzmq_serializer::serialize(std::move(msg), *p_auth, m_error_handler);
+        }
         p_shell->send_stdin(wire_msg);
     }
 
     void ServerZmqSplit::publish_impl(PubMessage msg, channel c) {
-        zmq::multipart_t wire_msg = xzmq_serializer::serialize_iopub(std::move(msg), *p_auth, m_error_handler);
-        if (c == channel::SHELL) {
-            p_shell->publish(wire_msg);
-        } else {
-            p_controller->publish(wire_msg);
+        if (m_iopub_mode == iopub_mode::QUEUED) {
+            p_publisher->enqueue(std::move(msg));
+            return;
         }
+        message_kind kind = get_metric_kind(msg);
+        zmq::multipart_t wire_msg;
+        {
+            MetricsTimer timer(metric_stage::serialize, metric_socket::IOPUB, kind);
+            wire_msg = xzmq_serializer::serialize_iopub(std::move(msg), *p_auth, m_error_handler);
+        }
+        MetricsTimer timer(metric_stage::send, metric_socket::IOPUB, kind);
+        publish_wire_msg(wire_msg, c);
     }
 
     void ServerZmqSplit::start_impl(PubMessage msg) {
         zmq::multipart_t wire_msg = xzmq_serializer::serialize_iopub(std::move(msg), *p_auth, m_error_handler);
+        // Stopped by its destructor
+        if (p_metrics_exporter != nullptr) {
+            p_metrics_exporter->start();
+        }
         start_server(wire_msg);
     }
 
-    void ServerZmqSplit::abort_queue_impl(const listener &l, long polling_interval) {
-        p_shell->abort_queue(l, polling_interval);
+    void ServerZmqSplit::abort_queue_impl(const listener &l, long grace_period) {
+        p_shell->abort_queue(l, grace_period);
     }
 
     void ServerZmqSplit::stop_impl() {
@@ -107,6 +178,9 @@ namespace dwarf {
         config.m_stdin_port = p_shell->get_stdin_port();
         config.m_iopub_port = p_publisher->get_port();
         config.m_hb_port = p_heartbeat->get_port();
+        if (p_metrics_exporter != nullptr) {
+            config.m_metrics_port = p_metrics_exporter->get_port();
+        }
     }
 
     void ServerZmqSplit::start_control_thread() {
@@ -125,6 +199,16 @@ namespace dwarf {
         m_shell_thread = std::move(ZmqThread(&Shell::run, p_shell.get()));
     }
 
+    void ServerZmqSplit::publish_wire_msg(zmq::multipart_t &wire_msg, channel c) {
+        if (m_iopub_mode != iopub_mode::RELAY) {
+            p_publisher->publish(wire_msg);
+        } else if (c == channel::SHELL) {
+            p_shell->publish(wire_msg);
+        } else {
+            p_controller->publish(wire_msg);
+        }
+    }
+
     Control &ServerZmqSplit::get_controller() {
         return *p_controller;
     }
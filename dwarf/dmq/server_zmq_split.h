@@ -17,6 +17,8 @@
 #pragma once
 
 #include <atomic>
+#include <functional>
+#include <vector>
 
 #include <dwarf/zmq/zmq_addon.hpp>
 
@@ -24,6 +26,7 @@
 #include <dwarf/core/kernel_configuration.h>
 
 #include <dwarf/core/config.h>
+#include <dwarf/core/histogram.h>
 #include <dwarf/dmq/authentication.h>
 #include <dwarf/dmq/thread.h>
 
@@ -32,10 +35,14 @@ namespace dwarf {
 
     class Heartbeat;
 
+    class MetricsExporter;
+
     class Publisher;
 
     class Shell;
 
+    class WireCapture;
+
     class DWARF_API ServerZmqSplit : public Server {
     public:
 
@@ -43,6 +50,8 @@ namespace dwarf {
         using heartbeat_ptr = std::unique_ptr<Heartbeat>;
         using publisher_ptr = std::unique_ptr<Publisher>;
         using shell_ptr = std::unique_ptr<Shell>;
+        using metrics_exporter_ptr = std::unique_ptr<MetricsExporter>;
+        using capture_ptr = std::unique_ptr<WireCapture>;
 
         ServerZmqSplit(zmq::context_t &context,
                        const Configuration &config,
@@ -54,6 +63,7 @@ namespace dwarf {
         using Server::notify_control_listener;
         // The Shell object needs to call these methods
         using Server::notify_shell_listener;
+        using Server::notify_concurrent_shell_listener;
         using Server::notify_stdin_listener;
 
         zmq::multipart_t notify_internal_listener(zmq::multipart_t &wire_msg);
@@ -62,6 +72,20 @@ namespace dwarf {
 
         Message deserialize(zmq::multipart_t &wire_msg) const;
 
+        // Number of shell requests received per wakeup of the ingress thread
+        const Histogram &receive_batch_sizes() const noexcept;
+
+        // Number of shell requests received but not dispatched yet
+        std::size_t shell_queue_depth() const noexcept;
+
+        // Time spent in the queue by the shell requests of a priority class,
+        // in microseconds, see Configuration::m_shell_priorities
+        const Histogram &shell_queue_waits(std::size_t priority) const noexcept;
+
+        // Removes the queued shell requests matching pred, in reception
+        // order. Must be called from the thread executing the requests.
+        std::vector<Message> extract_shell_requests(const std::function<bool(const Message &)> &pred);
+
     protected:
 
         ControlMessenger &get_control_messenger_impl() override;
@@ -76,7 +100,7 @@ namespace dwarf {
 
         void start_impl(PubMessage msg) override;
 
-        void abort_queue_impl(const listener &l, long polling_interval) override;
+        void abort_queue_impl(const listener &l, long grace_period) override;
 
         void stop_impl() override;
 
@@ -90,6 +114,8 @@ namespace dwarf {
 
         void start_shell_thread();
 
+        void publish_wire_msg(zmq::multipart_t &wire_msg, channel c);
+
         Control &get_controller();
 
         Shell &get_shell();
@@ -100,10 +126,15 @@ namespace dwarf {
 
         virtual void start_server(zmq::multipart_t &wire_msg) = 0;
 
+        // Only created when Configuration::m_capture_path is set, declared
+        // first to outlive the threads recording in it
+        capture_ptr p_capture;
         controller_ptr p_controller;
         heartbeat_ptr p_heartbeat;
         publisher_ptr p_publisher;
         shell_ptr p_shell;
+        // Only created when Configuration::m_metrics_port is set
+        metrics_exporter_ptr p_metrics_exporter;
 
         ZmqThread m_control_thread;
         ZmqThread m_hb_thread;
@@ -113,6 +144,8 @@ namespace dwarf {
         using authentication_ptr = std::unique_ptr<Authentication>;
         authentication_ptr p_auth;
         nl::json::error_handler_t m_error_handler;
+        decoding_policy m_decoding_policy;
+        iopub_mode m_iopub_mode;
 
         std::atomic<bool> m_control_stopped;
     };
@@ -14,13 +14,17 @@
 //
 
 
+#include <algorithm>
 #include <thread>
 #include <chrono>
 #include <iostream>
 
+#include <dwarf/core/tracer.h>
+#include <dwarf/dmq/ingress.h>
 #include <dwarf/dmq/middleware.h>
 #include <dwarf/dmq/server_zmq_split.h>
 #include <dwarf/dmq/shell.h>
+#include <dwarf/dmq/wire_capture.h>
 
 namespace dwarf {
     Shell::Shell(zmq::context_t &context,
@@ -28,11 +32,13 @@ namespace dwarf {
                  const std::string &ip,
                  const std::string &shell_port,
                  const std::string &stdin_port,
+                 std::size_t queue_capacity,
+                 std::size_t receive_batch_size,
                  ServerZmqSplit *server)
-            : m_shell(context, zmq::socket_type::router), m_stdin(context, zmq::socket_type::router),
+            : p_shell(new Ingress(context, transport, ip, shell_port, "shell", queue_capacity, receive_batch_size)),
+              m_stdin(context, zmq::socket_type::router),
               m_publisher_pub(context, zmq::socket_type::pub), m_controller(context, zmq::socket_type::rep),
-              p_server(server) {
-        init_socket(m_shell, transport, ip, shell_port);
+              p_server(server), p_capture(nullptr), m_receive_batch_size(std::max(receive_batch_size, std::size_t(1))) {
         init_socket(m_stdin, transport, ip, stdin_port);
         m_publisher_pub.set(zmq::sockopt::linger, get_socket_linger());
         m_publisher_pub.connect(get_publisher_end_point());
@@ -45,27 +51,44 @@ namespace dwarf {
     }
 
     std::string Shell::get_shell_port() const {
-        return get_socket_port(m_shell);
+        return p_shell->get_port();
     }
 
     std::string Shell::get_stdin_port() const {
         return get_socket_port(m_stdin);
     }
 
+    void Shell::set_priorities(std::map<std::string, std::size_t> priorities,
+                               std::size_t default_priority,
+                               std::size_t max_overtakes) {
+        p_shell->set_priorities(std::move(priorities), default_priority, max_overtakes);
+    }
+
+    void Shell::set_capture(WireCapture *capture) noexcept {
+        p_capture = capture;
+        p_shell->set_capture(capture);
+    }
+
     void Shell::run() {
+        get_tracer().set_thread_name("shell");
+        p_shell->start([this](zmq::multipart_t &wire_msg) {
+            return p_server->deserialize(wire_msg);
+        }, [this](Message &msg) {
+            return p_server->notify_concurrent_shell_listener(msg);
+        });
+
         zmq::pollitem_t items[] = {
-                {m_shell,      0, ZMQ_POLLIN, 0},
                 {m_controller, 0, ZMQ_POLLIN, 0}
         };
 
         while (true) {
-            zmq::poll(&items[0], 2, std::chrono::milliseconds(-1));
+            p_shell->poll(&items[0], 1, -1);
 
-            if (items[0].revents & ZMQ_POLLIN) {
-                zmq::multipart_t wire_msg;
-                wire_msg.recv(m_shell);
+            std::size_t batch_size = 0;
+            Message msg;
+            while (batch_size < m_receive_batch_size && p_shell->try_pop(msg)) {
+                ++batch_size;
                 try {
-                    Message msg = p_server->deserialize(wire_msg);
                     p_server->notify_shell_listener(std::move(msg));
                 }
                 catch (std::exception &e) {
@@ -73,12 +96,13 @@ namespace dwarf {
                 }
             }
 
-            if (items[1].revents & ZMQ_POLLIN) {
+            if (items[0].revents & ZMQ_POLLIN) {
                 // stop message
                 zmq::multipart_t wire_msg;
                 wire_msg.recv(m_controller);
                 std::string msg = wire_msg.peekstr(0);
                 if (msg == "stop") {
+                    p_shell->stop();
                     wire_msg.send(m_controller);
                     break;
                 } else {
@@ -90,15 +114,29 @@ namespace dwarf {
     }
 
     void Shell::send_shell(zmq::multipart_t &message) {
-        message.send(m_shell);
+        p_shell->send(message);
     }
 
     void Shell::send_stdin(zmq::multipart_t &message) {
+        std::lock_guard<std::mutex> lock(m_stdin_mutex);
+        count_wire_message(metric_socket::STDIN, metric_direction::SENT, message);
+        if (p_capture != nullptr) {
+            p_capture->record(metric_socket::STDIN, metric_direction::SENT, message);
+        }
         message.send(m_stdin);
         zmq::multipart_t wire_msg;
         wire_msg.recv(m_stdin);
+        count_wire_message(metric_socket::STDIN, metric_direction::RECEIVED, wire_msg);
+        if (p_capture != nullptr) {
+            p_capture->record(metric_socket::STDIN, metric_direction::RECEIVED, wire_msg);
+        }
         try {
-            Message msg = p_server->deserialize(wire_msg);
+            Message msg;
+            {
+                MetricsTimer timer(metric_stage::deserialize, metric_socket::STDIN);
+                msg = p_server->deserialize(wire_msg);
+                timer.set_kind(msg.kind());
+            }
             p_server->notify_stdin_listener(std::move(msg));
         }
         catch (std::exception &e) {
@@ -110,27 +148,28 @@ namespace dwarf {
         message.send(m_publisher_pub);
     }
 
-    void Shell::abort_queue(const listener &l, long polling_interval) {
-        while (true) {
-            zmq::multipart_t wire_msg;
-            bool received = wire_msg.recv(m_shell, ZMQ_NOBLOCK);
-            if (!received) {
-                return;
-            }
-
-            try {
-                Message msg = p_server->deserialize(wire_msg);
-                l(std::move(msg));
-            }
-            catch (std::exception &e) {
-                std::cerr << e.what() << std::endl;
-            }
-            std::this_thread::sleep_for(std::chrono::milliseconds(polling_interval));
-        }
+    void Shell::abort_queue(const listener &l, long grace_period) {
+        p_shell->drain_until(std::chrono::steady_clock::now() + std::chrono::milliseconds(grace_period), l);
     }
 
     void Shell::reply_to_controller(zmq::multipart_t &message) {
         message.send(m_controller);
     }
+
+    const Histogram &Shell::receive_batch_sizes() const noexcept {
+        return p_shell->receive_batch_sizes();
+    }
+
+    std::size_t Shell::queue_depth() const noexcept {
+        return p_shell->depth();
+    }
+
+    const Histogram &Shell::queue_waits(std::size_t priority) const noexcept {
+        return p_shell->queue_waits(priority);
+    }
+
+    std::vector<Message> Shell::extract_queued_requests(const std::function<bool(const Message &)> &pred) {
+        return p_shell->extract_if(pred);
+    }
 }
 
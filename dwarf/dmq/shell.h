@@ -17,16 +17,26 @@
 #pragma once
 
 
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include <dwarf/zmq/zmq.hpp>
 #include <dwarf/zmq/zmq_addon.hpp>
 
+#include <dwarf/core/histogram.h>
 #include <dwarf/core/message.h>
 
 namespace dwarf {
+    class Ingress;
+
     class ServerZmqSplit;
 
+    class WireCapture;
+
     class Shell {
     public:
 
@@ -37,6 +47,8 @@ namespace dwarf {
               const std::string &ip,
               const std::string &shell_port,
               const std::string &sdtin_port,
+              std::size_t queue_capacity,
+              std::size_t receive_batch_size,
               ServerZmqSplit *server);
 
         ~Shell();
@@ -45,6 +57,14 @@ namespace dwarf {
 
         std::string get_stdin_port() const;
 
+        // Must be called before run, see Ingress::set_priorities
+        void set_priorities(std::map<std::string, std::size_t> priorities,
+                            std::size_t default_priority,
+                            std::size_t max_overtakes);
+
+        // Must be called before run, capture must outlive the shell
+        void set_capture(WireCapture *capture) noexcept;
+
         void run();
 
         void send_shell(zmq::multipart_t &message);
@@ -53,16 +73,34 @@ namespace dwarf {
 
         void publish(zmq::multipart_t &message);
 
-        void abort_queue(const listener &l, long polling_interval);
+        void abort_queue(const listener &l, long grace_period);
 
         void reply_to_controller(zmq::multipart_t &message);
 
+        // Number of shell requests received per wakeup of the ingress thread
+        const Histogram &receive_batch_sizes() const noexcept;
+
+        // Number of shell requests received but not dispatched yet
+        std::size_t queue_depth() const noexcept;
+
+        // Time spent in the queue by the requests of a priority class (us)
+        const Histogram &queue_waits(std::size_t priority) const noexcept;
+
+        // Removes the queued requests matching pred, in reception order
+        std::vector<Message> extract_queued_requests(const std::function<bool(const Message &)> &pred);
+
     private:
 
-        zmq::socket_t m_shell;
+        using ingress_ptr = std::unique_ptr<Ingress>;
+
+        ingress_ptr p_shell;
         zmq::socket_t m_stdin;
+        // Pairs each input request with its reply on m_stdin
+        std::mutex m_stdin_mutex;
         zmq::socket_t m_publisher_pub;
         zmq::socket_t m_controller;
         ServerZmqSplit *p_server;
+        WireCapture *p_capture;
+        std::size_t m_receive_batch_size;
     };
 }
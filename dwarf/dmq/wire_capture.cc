@@ -0,0 +1,170 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include <dwarf/dmq/wire_capture.h>
+
+namespace dwarf {
+    namespace {
+        constexpr char CAPTURE_MAGIC[] = "DWCAP001";
+        constexpr std::size_t CAPTURE_MAGIC_SIZE = sizeof(CAPTURE_MAGIC) - 1;
+
+        void put_uint(std::string &buffer, std::uint64_t value, std::size_t size) {
+            for (std::size_t i = 0; i < size; ++i) {
+                buffer.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+            }
+        }
+
+        bool get_uint(std::istream &in, std::uint64_t &value, std::size_t size) {
+            unsigned char bytes[8];
+            if (!in.read(reinterpret_cast<char *>(bytes), static_cast<std::streamsize>(size))) {
+                return false;
+            }
+            value = 0;
+            for (std::size_t i = 0; i < size; ++i) {
+                value |= static_cast<std::uint64_t>(bytes[i]) << (8 * i);
+            }
+            return true;
+        }
+
+        void throw_truncated() {
+            throw std::runtime_error("ERROR: truncated record in wire capture");
+        }
+    }
+
+    /******************************
+     * WireCapture implementation *
+     ******************************/
+
+    WireCapture::WireCapture(const std::string &path)
+            : m_path(path), m_file(path, std::ios::binary | std::ios::trunc), m_start(clock_type::now()),
+              m_stopped(false) {
+        if (!m_file) {
+            throw std::runtime_error("ERROR: cannot open wire capture " + path);
+        }
+        m_file.write(CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE);
+        m_thread = std::thread(&WireCapture::run, this);
+    }
+
+    WireCapture::~WireCapture() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopped = true;
+        }
+        m_condition.notify_one();
+        m_thread.join();
+    }
+
+    const std::string &WireCapture::path() const noexcept {
+        return m_path;
+    }
+
+    void WireCapture::record(metric_socket socket, metric_direction direction, const zmq::multipart_t &wire_msg) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            // Taken under the lock so that the timestamps of the file are
+            // ordered, whatever the thread recording
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - m_start);
+            put_uint(m_pending, static_cast<std::uint8_t>(socket), 1);
+            put_uint(m_pending, static_cast<std::uint8_t>(direction), 1);
+            put_uint(m_pending, static_cast<std::uint64_t>(elapsed.count()), 8);
+            put_uint(m_pending, wire_msg.size(), 4);
+            for (const zmq::message_t &frame: wire_msg) {
+                put_uint(m_pending, frame.size(), 4);
+                m_pending.append(frame.data<const char>(), frame.size());
+            }
+        }
+        m_condition.notify_one();
+    }
+
+    void WireCapture::run() {
+        std::string buffer;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_condition.wait(lock, [this]() { return m_stopped || !m_pending.empty(); });
+            if (m_pending.empty()) {
+                break;
+            }
+            // Swapping keeps the capacity of both buffers, recording does
+            // not allocate once the traffic is steady
+            buffer.clear();
+            std::swap(buffer, m_pending);
+            lock.unlock();
+            m_file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            lock.lock();
+        }
+        m_file.flush();
+    }
+
+    /******************************
+     * wire_record implementation *
+     ******************************/
+
+    zmq::multipart_t wire_record::to_multipart() const {
+        zmq::multipart_t wire_msg;
+        for (const std::string &frame: m_frames) {
+            wire_msg.addstr(frame);
+        }
+        return wire_msg;
+    }
+
+    /************************************
+     * WireCaptureReader implementation *
+     ************************************/
+
+    WireCaptureReader::WireCaptureReader(const std::string &path)
+            : m_file(path, std::ios::binary) {
+        if (!m_file) {
+            throw std::runtime_error("ERROR: cannot open wire capture " + path);
+        }
+        char magic[CAPTURE_MAGIC_SIZE];
+        if (!m_file.read(magic, CAPTURE_MAGIC_SIZE) || std::memcmp(magic, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE) != 0) {
+            throw std::runtime_error("ERROR: " + path + " is not a wire capture");
+        }
+    }
+
+    bool WireCaptureReader::next(wire_record &record) {
+        std::uint64_t socket = 0;
+        if (!get_uint(m_file, socket, 1)) {
+            return false;
+        }
+        std::uint64_t direction = 0;
+        std::uint64_t frame_count = 0;
+        if (!get_uint(m_file, direction, 1) || !get_uint(m_file, record.m_timestamp, 8) ||
+            !get_uint(m_file, frame_count, 4)) {
+            throw_truncated();
+        }
+        if (socket >= metric_socket_count || direction > 1) {
+            throw std::runtime_error("ERROR: invalid record in wire capture");
+        }
+        record.m_socket = static_cast<metric_socket>(socket);
+        record.m_direction = static_cast<metric_direction>(direction);
+        record.m_frames.resize(frame_count);
+        for (std::string &frame: record.m_frames) {
+            std::uint64_t size = 0;
+            if (!get_uint(m_file, size, 4)) {
+                throw_truncated();
+            }
+            frame.resize(size);
+            if (size != 0 && !m_file.read(&frame[0], static_cast<std::streamsize>(size))) {
+                throw_truncated();
+            }
+        }
+        return true;
+    }
+}
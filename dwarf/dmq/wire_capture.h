@@ -0,0 +1,109 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dwarf/zmq/zmq_addon.hpp>
+
+#include <dwarf/core/config.h>
+#include <dwarf/core/metrics.h>
+
+namespace dwarf {
+
+    /**
+     * @class WireCapture
+     * @brief Appends the raw multiparts of the kernel sockets to a file.
+     *
+     * A record is the socket and the direction of the message, the time
+     * elapsed since the creation of the capture in nanoseconds, and the
+     * frames of the multipart, identities and delimiter included. Integers
+     * are little endian:
+     *
+     *     "DWCAP001"
+     *     u8 socket, u8 direction, u64 timestamp, u32 frame count,
+     *     frame count times (u32 size, size bytes)
+     *
+     * record can be called from any thread: the caller only encodes the
+     * message in a buffer, which is written to the file by a background
+     * thread. The pending records are written when the capture is destroyed.
+     */
+    class DWARF_API WireCapture {
+    public:
+
+        explicit WireCapture(const std::string &path);
+
+        ~WireCapture();
+
+        WireCapture(const WireCapture &) = delete;
+
+        WireCapture &operator=(const WireCapture &) = delete;
+
+        const std::string &path() const noexcept;
+
+        void record(metric_socket socket, metric_direction direction, const zmq::multipart_t &wire_msg);
+
+    private:
+
+        using clock_type = std::chrono::steady_clock;
+
+        void run();
+
+        std::string m_path;
+        std::ofstream m_file;
+        clock_type::time_point m_start;
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        std::string m_pending;
+        bool m_stopped;
+        std::thread m_thread;
+    };
+
+    struct DWARF_API wire_record {
+        metric_socket m_socket = metric_socket::SHELL;
+        metric_direction m_direction = metric_direction::RECEIVED;
+        // Nanoseconds since the creation of the capture
+        std::uint64_t m_timestamp = 0;
+        std::vector<std::string> m_frames;
+
+        zmq::multipart_t to_multipart() const;
+    };
+
+    /**
+     * @class WireCaptureReader
+     * @brief Reads the records of a file written by WireCapture.
+     */
+    class DWARF_API WireCaptureReader {
+    public:
+
+        // Throws if the file cannot be opened or is not a capture
+        explicit WireCaptureReader(const std::string &path);
+
+        // False at the end of the file, throws on a truncated record
+        bool next(wire_record &record);
+
+    private:
+
+        std::ifstream m_file;
+    };
+}
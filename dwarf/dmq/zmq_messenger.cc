@@ -17,6 +17,7 @@
 #include <collie/nlohmann/json.hpp>
 #include <dwarf/dmq/middleware.h>
 #include <dwarf/dmq/zmq_messenger.h>
+#include <dwarf/dmq/zmq_serializer.h>
 
 namespace nl = nlohmann;
 
@@ -57,11 +58,12 @@ namespace dwarf {
     }
 
     nl::json ZmqMessenger::send_to_shell_impl(const nl::json &message) {
-        zmq::multipart_t wire_msg(message.dump());
-        wire_msg.send(m_shell_controller);
-        zmq::multipart_t wire_reply;
-        wire_reply.recv(m_shell_controller);
-        return nl::json::parse(wire_reply.popstr());
+        zmq::message_t wire_msg = xzmq_serializer::serialize_json(message);
+        m_shell_controller.send(wire_msg, zmq::send_flags::none);
+        zmq::message_t wire_reply;
+        (void) m_shell_controller.recv(wire_reply);
+        const char *data = wire_reply.data<const char>();
+        return nl::json::parse(data, data + wire_reply.size());
     }
 }
 
@@ -14,96 +14,260 @@
 //
 
 
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include <dwarf/core/buffer_pool.h>
+#include <dwarf/core/tracer.h>
 #include <dwarf/dmq/zmq_serializer.h>
 
 namespace dwarf {
     namespace {
         const std::string DELIMITER = "<IDS|MSG>";
 
-        bool is_delimiter(zmq::message_t &frame) {
+        bool is_delimiter(const zmq::message_t &frame) {
             std::size_t frame_size = frame.size();
             if (frame_size != DELIMITER.size()) {
                 return false;
             }
 
-            std::string check(frame.data<const char>(), frame_size);
-            return check == DELIMITER;
+            return std::memcmp(frame.data(), DELIMITER.data(), frame_size) == 0;
+        }
+
+        // Moves the frame into a reference counted owner: the payload is
+        // shared with the returned buffer instead of being copied.
+        binary_buffer make_shared_buffer(zmq::message_t &&frame) {
+            auto owner = std::make_shared<zmq::message_t>(std::move(frame));
+            const char *data = owner->data<const char>();
+            std::size_t size = owner->size();
+            return binary_buffer(data, size, std::move(owner));
+        }
+
+        // Below this size, copying the payload is cheaper than allocating
+        // the ownership handle and going through the free callback.
+        constexpr std::size_t ZERO_COPY_THRESHOLD = 1024;
+
+        void release_shared_buffer(void * /*data*/, void *hint) {
+            delete static_cast<binary_buffer *>(hint);
+        }
+
+        // Hands the buffer memory over to zmq: the reference is released by
+        // zmq once the frame has been sent, the payload is never copied.
+        zmq::message_t make_zmq_message(binary_buffer &&buffer) {
+            if (buffer.size() < ZERO_COPY_THRESHOLD) {
+                return zmq::message_t(buffer.data(), buffer.size());
+            }
+
+            std::unique_ptr<binary_buffer> hint(new binary_buffer(std::move(buffer)));
+            void *data = const_cast<char *>(hint->data());
+            zmq::message_t frame(data, hint->size(), release_shared_buffer, hint.get());
+            hint.release();
+            return frame;
         }
 
         RawBuffer make_raw_buffer(zmq::message_t &msg) {
             return RawBuffer(msg.data<const unsigned char>(), msg.size());
         }
 
-        void parse_zmq_message(const zmq::message_t &msg, nl::json &json) {
-            const char *buf = msg.data<const char>();
-            json = nl::json::parse(buf, buf + msg.size());
+        RawBuffer make_raw_buffer(const binary_buffer &buffer) {
+            return RawBuffer(reinterpret_cast<const unsigned char *>(buffer.data()), buffer.size());
+        }
+
+        // Frames up to this size are stored inline in the zmq message,
+        // copying them is cheaper than lending the pooled buffer.
+        constexpr std::size_t INLINE_FRAME_SIZE = 32;
+
+        void release_pooled_buffer(void * /*data*/, void *hint) {
+            BufferPool::release(static_cast<PooledBuffer *>(hint));
         }
 
+        struct pooled_buffer_releaser {
+            void operator()(PooledBuffer *buffer) const noexcept {
+                BufferPool::release(buffer);
+            }
+        };
+
+        // Appends what is written to the stream to a pooled buffer
+        class pooled_streambuf : public std::streambuf {
+        public:
+
+            explicit pooled_streambuf(std::vector<char> &data) : m_data(data) {}
+
+        protected:
+
+            int_type overflow(int_type c) override {
+                if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                    m_data.push_back(traits_type::to_char_type(c));
+                }
+                return traits_type::not_eof(c);
+            }
+
+            std::streamsize xsputn(const char *s, std::streamsize n) override {
+                m_data.insert(m_data.end(), s, s + n);
+                return n;
+            }
+
+        private:
+
+            std::vector<char> &m_data;
+        };
+
+        // Dumps the json into a scratch buffer of the thread's pool, whose
+        // memory is then lent to zmq and returned to the pool once sent.
         zmq::message_t write_zmq_message(const nl::json &json, nl::json::error_handler_t error_handler) {
-            std::string buffer = json.dump(-1, ' ', false, error_handler);
-            return zmq::message_t(buffer.c_str(), buffer.size());
+            std::unique_ptr<PooledBuffer, pooled_buffer_releaser> buffer(BufferPool::local().acquire());
+            std::vector<char> &data = buffer->data();
+            // Streaming reuses the capacity of the buffer but only supports
+            // the strict error handler, the others go through an intermediate string.
+            if (error_handler == nl::json::error_handler_t::strict) {
+                pooled_streambuf streambuf(data);
+                std::ostream stream(&streambuf);
+                stream << json;
+            } else {
+                std::string dump = json.dump(-1, ' ', false, error_handler);
+                data.assign(dump.begin(), dump.end());
+            }
+
+            if (data.size() <= INLINE_FRAME_SIZE) {
+                return zmq::message_t(data.data(), data.size());
+            }
+
+            zmq::message_t frame(data.data(), data.size(), release_pooled_buffer, buffer.get());
+            buffer.release();
+            return frame;
+        }
+
+        // Sections that still hold their serialized form are sent as is,
+        // without decoding them first.
+        zmq::message_t write_zmq_message(const binary_buffer &raw) {
+            return make_zmq_message(binary_buffer(raw));
         }
 
         void serialize_message_base(MessageBase &&msg,
                                     const Authentication &auth,
                                     nl::json::error_handler_t error_handler,
                                     zmq::multipart_t &wire_msg) {
-            zmq::message_t header = write_zmq_message(msg.header(), error_handler);
-            zmq::message_t parent_header = write_zmq_message(msg.parent_header(), error_handler);
-            zmq::message_t metadata = write_zmq_message(msg.metadata(), error_handler);
-            zmq::message_t content = write_zmq_message(msg.content(), error_handler);
-            std::string sig = auth.sign(make_raw_buffer(header),
-                                        make_raw_buffer(parent_header),
-                                        make_raw_buffer(metadata),
-                                        make_raw_buffer(content));
-            zmq::message_t signature(sig.begin(), sig.end());
+            zmq::message_t header = msg.raw_header().empty()
+                                    ? write_zmq_message(msg.header(), error_handler)
+                                    : write_zmq_message(msg.raw_header());
+            zmq::message_t parent_header = msg.raw_parent_header().empty()
+                                           ? write_zmq_message(msg.parent_header(), error_handler)
+                                           : write_zmq_message(msg.raw_parent_header());
+            zmq::message_t metadata = msg.raw_metadata().empty()
+                                      ? write_zmq_message(msg.metadata(), error_handler)
+                                      : write_zmq_message(msg.raw_metadata());
+            zmq::message_t content = msg.raw_content().empty()
+                                     ? write_zmq_message(msg.content(), error_handler)
+                                     : write_zmq_message(msg.raw_content());
+
+            buffer_sequence buffers = std::move(msg).buffers();
+            std::vector<zmq::message_t> buffer_frames;
+            buffer_frames.reserve(buffers.size());
+            for (binary_buffer &buffer: buffers) {
+                buffer_frames.push_back(make_zmq_message(std::move(buffer)));
+            }
+
+            raw_buffer_sequence raw_buffers;
+            if (auth.sign_buffers()) {
+                raw_buffers.reserve(buffer_frames.size());
+                for (zmq::message_t &frame: buffer_frames) {
+                    raw_buffers.push_back(make_raw_buffer(frame));
+                }
+            }
+
+            zmq::message_t signature(auth.signature_size());
+            auth.sign_into(signature.data<char>(),
+                           make_raw_buffer(header),
+                           make_raw_buffer(parent_header),
+                           make_raw_buffer(metadata),
+                           make_raw_buffer(content),
+                           raw_buffers);
 
             wire_msg.add(std::move(signature));
             wire_msg.add(std::move(header));
             wire_msg.add(std::move(parent_header));
             wire_msg.add(std::move(metadata));
             wire_msg.add(std::move(content));
-
-            // was not const and  could only be called on rvalues.
-            for (const binary_buffer &buffer: std::move(msg).buffers()) {
-                wire_msg.add(zmq::message_t(buffer.data(), buffer.size()));
+            for (zmq::message_t &frame: buffer_frames) {
+                wire_msg.add(std::move(frame));
             }
         }
 
         MessageBaseData deserialize_message_base(zmq::multipart_t &wire_msg,
-                                                 const Authentication &auth) {
-            zmq::message_t signature = wire_msg.pop();
-            zmq::message_t header = wire_msg.pop();
-            zmq::message_t parent_header = wire_msg.pop();
-            zmq::message_t metadata = wire_msg.pop();
-            zmq::message_t content = wire_msg.pop();
+                                                 const Authentication &auth,
+                                                 decoding_policy policy) {
+            // signature, header, parent_header, metadata, content
+            if (wire_msg.size() < 5) {
+                throw std::runtime_error("ERROR: Message is missing frames");
+            }
 
-            MessageBaseData data;
-            parse_zmq_message(header, data.m_header);
-            parse_zmq_message(parent_header, data.m_parent_header);
-            parse_zmq_message(metadata, data.m_metadata);
-            parse_zmq_message(content, data.m_content);
+            zmq::message_t signature = wire_msg.pop();
+            binary_buffer header = make_shared_buffer(wire_msg.pop());
+            binary_buffer parent_header = make_shared_buffer(wire_msg.pop());
+            binary_buffer metadata = make_shared_buffer(wire_msg.pop());
+            binary_buffer content = make_shared_buffer(wire_msg.pop());
 
+            buffer_sequence buffers;
+            buffers.reserve(wire_msg.size());
             while (!wire_msg.empty()) {
-                zmq::message_t msg = wire_msg.pop();
-                const char *buf = msg.data<const char>();
-                data.m_buffers.emplace_back(buf, buf + msg.size());
+                buffers.push_back(make_shared_buffer(wire_msg.pop()));
+            }
+
+            raw_buffer_sequence raw_buffers;
+            if (auth.sign_buffers()) {
+                raw_buffers.reserve(buffers.size());
+                for (const binary_buffer &buffer: buffers) {
+                    raw_buffers.push_back(make_raw_buffer(buffer));
+                }
             }
 
-            // TODO: should we verify with buffers
+            Tracer &tracer = get_tracer();
+            std::uint64_t verify_start = tracer.enabled() ? Tracer::now() : 0;
+
+            // Nothing is decoded before the message has been authenticated
             if (!auth.verify(make_raw_buffer(signature),
                              make_raw_buffer(header),
                              make_raw_buffer(parent_header),
                              make_raw_buffer(metadata),
-                             make_raw_buffer(content))) {
+                             make_raw_buffer(content),
+                             raw_buffers)) {
                 throw std::runtime_error("ERROR: Signatures don't match");
             }
+            std::uint64_t parse_start = verify_start != 0 ? Tracer::now() : 0;
 
+            MessageBaseData data;
+            // The header is required to route the message, whatever the policy.
+            data.m_header = LazyJson(std::move(header), decoding_policy::EAGER);
+            data.m_parent_header = LazyJson(std::move(parent_header), policy);
+            data.m_metadata = LazyJson(std::move(metadata), policy);
+            data.m_content = LazyJson(std::move(content), policy);
+            data.m_buffers = std::move(buffers);
+
+            if (verify_start != 0) {
+                std::uint64_t parse_end = Tracer::now();
+                const nl::json &header = data.m_header.get();
+                const nl::json &parent = data.m_parent_header.get();
+                std::string msg_id = header.is_object() ? header.value("msg_id", "") : "";
+                std::string parent_id = parent.is_object() ? parent.value("msg_id", "") : "";
+                tracer.record("verify", verify_start, parse_start, msg_id, parent_id);
+                tracer.record("parse", parse_start, parse_end, msg_id, parent_id);
+            }
             return data;
         }
 
+        std::string peek_msg_id(const zmq::message_t &frame) {
+            const char *data = frame.data<const char>();
+            nl::json section = nl::json::parse(data, data + frame.size(), nullptr, false);
+            return section.is_object() ? section.value("msg_id", "") : "";
+        }
+
         void serialize_zmq_id(const Message &msg, zmq::multipart_t &wire_msg) {
-            auto app = [&wire_msg](const std::string &uid) {
+            auto app = [&wire_msg](const binary_buffer &uid) {
                 wire_msg.add(zmq::message_t(uid.begin(), uid.end()));
             };
             std::for_each(msg.identities().begin(), msg.identities().end(), app);
@@ -111,12 +275,16 @@ namespace dwarf {
         }
 
         Message::guid_list deserialize_zmq_id(zmq::multipart_t &wire_msg) {
+            if (wire_msg.empty()) {
+                throw std::runtime_error("ERROR: Delimiter not present in message");
+            }
+
             Message::guid_list zmq_id;
             zmq::message_t frame = wire_msg.pop();
 
             // ZMQ identites
             while (!is_delimiter(frame) && wire_msg.size() != 0) {
-                zmq_id.emplace_back(frame.data<const char>(), frame.size());
+                zmq_id.push_back(make_shared_buffer(std::move(frame)));
                 frame = wire_msg.pop();
             }
 
@@ -134,6 +302,10 @@ namespace dwarf {
         }
 
         std::string deserialize_topic(zmq::multipart_t &wire_msg) {
+            if (wire_msg.size() < 2) {
+                throw std::runtime_error("ERROR: Delimiter not present in message");
+            }
+
             zmq::message_t topic_msg = wire_msg.pop();
             std::string topic = std::string(topic_msg.data<const char>(), topic_msg.size());
             wire_msg.pop();
@@ -141,6 +313,11 @@ namespace dwarf {
         }
     }
 
+    zmq::message_t xzmq_serializer::serialize_json(const nl::json &json,
+                                                   nl::json::error_handler_t error_handler) {
+        return write_zmq_message(json, error_handler);
+    }
+
     zmq::multipart_t xzmq_serializer::serialize(Message &&msg,
                                                 const Authentication &auth,
                                                 nl::json::error_handler_t error_handler) {
@@ -151,10 +328,11 @@ namespace dwarf {
     }
 
     Message xzmq_serializer::deserialize(zmq::multipart_t &wire_msg,
-                                         const Authentication &auth) {
+                                         const Authentication &auth,
+                                         decoding_policy policy) {
         Message::guid_list zmq_id = deserialize_zmq_id(wire_msg);
-        MessageBaseData data = deserialize_message_base(wire_msg, auth);
-        return Message(zmq_id, std::move(data));
+        MessageBaseData data = deserialize_message_base(wire_msg, auth, policy);
+        return Message(std::move(zmq_id), std::move(data));
     }
 
     zmq::multipart_t xzmq_serializer::serialize_iopub(PubMessage &&msg,
@@ -167,10 +345,23 @@ namespace dwarf {
     }
 
     PubMessage xzmq_serializer::deserialize_iopub(zmq::multipart_t &wire_msg,
-                                                  const Authentication &auth) {
+                                                  const Authentication &auth,
+                                                  decoding_policy policy) {
         std::string topic = deserialize_topic(wire_msg);
-        MessageBaseData data = deserialize_message_base(wire_msg, auth);
+        MessageBaseData data = deserialize_message_base(wire_msg, auth, policy);
         return PubMessage(topic, std::move(data));
     }
-}
 
+    void xzmq_serializer::peek_ids(const zmq::multipart_t &wire_msg, std::string &msg_id, std::string &parent_id) {
+        // identities or topic, delimiter, signature, header, parent_header
+        for (std::size_t i = 0; i + 3 < wire_msg.size(); ++i) {
+            if (is_delimiter(wire_msg[i])) {
+                msg_id = peek_msg_id(wire_msg[i + 2]);
+                parent_id = peek_msg_id(wire_msg[i + 3]);
+                return;
+            }
+        }
+        msg_id.clear();
+        parent_id.clear();
+    }
+}
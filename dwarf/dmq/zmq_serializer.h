@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <string>
+
 #include <dwarf/zmq/zmq_addon.hpp>
 
 #include <dwarf/core/message.h>
@@ -27,19 +29,29 @@ namespace dwarf {
     class DWARF_API xzmq_serializer {
     public:
 
+        // Single frame holding the dump of json, written without intermediate copy.
+        static zmq::message_t serialize_json(const nl::json &json,
+                                             nl::json::error_handler_t error_handler = nl::json::error_handler_t::strict);
+
         static zmq::multipart_t serialize(Message &&msg,
                                           const Authentication &auth,
                                           nl::json::error_handler_t error_handler = nl::json::error_handler_t::strict);
 
         static Message deserialize(zmq::multipart_t &wire_msg,
-                                   const Authentication &auth);
+                                   const Authentication &auth,
+                                   decoding_policy policy = decoding_policy::EAGER);
 
         static zmq::multipart_t serialize_iopub(PubMessage &&msg,
                                                 const Authentication &auth,
                                                 nl::json::error_handler_t error_handler = nl::json::error_handler_t::strict);
 
         static PubMessage deserialize_iopub(zmq::multipart_t &wire_msg,
-                                            const Authentication &auth);
+                                            const Authentication &auth,
+                                            decoding_policy policy = decoding_policy::EAGER);
+
+        // msg_id of the header and of the parent header of a serialized
+        // message, empty when they cannot be read. Decodes both sections.
+        static void peek_ids(const zmq::multipart_t &wire_msg, std::string &msg_id, std::string &parent_id);
     };
 
 }
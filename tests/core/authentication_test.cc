@@ -0,0 +1,157 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <collie/testing/doctest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dwarf/dmq/authentication.h>
+
+namespace dwarf
+{
+    namespace
+    {
+        RawBuffer make_raw(const std::string &s)
+        {
+            return RawBuffer(reinterpret_cast<const unsigned char *>(s.data()), s.size());
+        }
+
+        const std::vector<std::string> schemes = {
+            "hmac-md5", "hmac-sha1", "hmac-sha224", "hmac-sha256", "hmac-sha384", "hmac-sha512"
+        };
+    }
+
+    TEST_SUITE("authentication")
+    {
+        TEST_CASE("sign_verify")
+        {
+            std::string header = "{\"msg_type\": \"execute_request\"}";
+            std::string empty = "{}";
+            for (const std::string &scheme : schemes)
+            {
+                auto auth = make_authentication(scheme, "key");
+                std::string sig = auth->sign(make_raw(header), make_raw(empty), make_raw(empty), make_raw(empty));
+                REQUIRE(auth->verify(make_raw(sig), make_raw(header), make_raw(empty), make_raw(empty), make_raw(empty)));
+
+                std::string tampered = "{\"msg_type\": \"shutdown_request\"}";
+                REQUIRE_FALSE(auth->verify(make_raw(sig), make_raw(tampered), make_raw(empty), make_raw(empty), make_raw(empty)));
+
+                std::string truncated = sig.substr(0, sig.size() / 2);
+                REQUIRE_FALSE(auth->verify(make_raw(truncated), make_raw(header), make_raw(empty), make_raw(empty), make_raw(empty)));
+            }
+        }
+
+        TEST_CASE("known_digest")
+        {
+            std::string message = "The quick brown fox jumps over the lazy dog";
+            std::string expected = "f7bc83f430538424b13298e6aa6fb143ef4d59a14946175997479dbc2d1a3cd8";
+            auto auth = make_authentication("hmac-sha256", "key");
+            REQUIRE_EQ(auth->signature_size(), expected.size());
+            for (int i = 0; i < 3; ++i)
+            {
+                REQUIRE_EQ(auth->sign(make_raw(message), make_raw(""), make_raw(""), make_raw("")), expected);
+            }
+
+            std::string upper = "F7BC83F430538424B13298E6AA6FB143EF4D59A14946175997479DBC2D1A3CD8";
+            REQUIRE(auth->verify(make_raw(upper), make_raw(message), make_raw(""), make_raw(""), make_raw("")));
+            std::string invalid = expected;
+            invalid[0] = 'g';
+            REQUIRE_FALSE(auth->verify(make_raw(invalid), make_raw(message), make_raw(""), make_raw(""), make_raw("")));
+        }
+
+        TEST_CASE("concurrent_sign")
+        {
+            std::string message = "The quick brown fox jumps over the lazy dog";
+            std::string expected = "f7bc83f430538424b13298e6aa6fb143ef4d59a14946175997479dbc2d1a3cd8";
+            auto auth = make_authentication("hmac-sha256", "key");
+
+            std::vector<int> failures(4, 0);
+            std::vector<std::thread> threads;
+            for (std::size_t t = 0; t < failures.size(); ++t)
+            {
+                threads.emplace_back([&, t]() {
+                    for (int i = 0; i < 1000; ++i)
+                    {
+                        std::string sig = auth->sign(make_raw(message), make_raw(""), make_raw(""), make_raw(""));
+                        bool ok = sig == expected
+                                  && auth->verify(make_raw(sig), make_raw(message), make_raw(""), make_raw(""), make_raw(""));
+                        failures[t] += ok ? 0 : 1;
+                    }
+                });
+            }
+            for (auto &thread : threads)
+            {
+                thread.join();
+            }
+            for (int failure : failures)
+            {
+                REQUIRE_EQ(failure, 0);
+            }
+        }
+
+        TEST_CASE("recreated_authentication")
+        {
+            // The contexts of the destroyed authentications are released by
+            // the threads that used them, alongside the live ones
+            std::string message = "The quick brown fox jumps over the lazy dog";
+            std::string expected = "f7bc83f430538424b13298e6aa6fb143ef4d59a14946175997479dbc2d1a3cd8";
+            auto live = make_authentication("hmac-sha256", "key");
+            for (int i = 0; i < 100; ++i)
+            {
+                auto auth = make_authentication("hmac-sha256", "key");
+                REQUIRE_EQ(auth->sign(make_raw(message), make_raw(""), make_raw(""), make_raw("")), expected);
+                REQUIRE_EQ(live->sign(make_raw(message), make_raw(""), make_raw(""), make_raw("")), expected);
+            }
+        }
+
+        TEST_CASE("sign_buffers")
+        {
+            std::string empty = "{}";
+            std::string buffer = "binary payload";
+            std::string other = "tampered payload";
+            for (const std::string &scheme : schemes)
+            {
+                auto auth = make_authentication(scheme, "key", true);
+                REQUIRE(auth->sign_buffers());
+                std::string sig = auth->sign(make_raw(empty), make_raw(empty), make_raw(empty), make_raw(empty),
+                                             { make_raw(buffer) });
+                REQUIRE(auth->verify(make_raw(sig), make_raw(empty), make_raw(empty), make_raw(empty), make_raw(empty),
+                                     { make_raw(buffer) }));
+                REQUIRE_FALSE(auth->verify(make_raw(sig), make_raw(empty), make_raw(empty), make_raw(empty),
+                                           make_raw(empty), { make_raw(other) }));
+
+                // Without the option, buffers do not contribute to the signature
+                auto plain = make_authentication(scheme, "key");
+                std::string plain_sig = plain->sign(make_raw(empty), make_raw(empty), make_raw(empty), make_raw(empty),
+                                                    { make_raw(buffer) });
+                REQUIRE(plain->verify(make_raw(plain_sig), make_raw(empty), make_raw(empty), make_raw(empty),
+                                      make_raw(empty), { make_raw(other) }));
+                REQUIRE_NE(plain_sig, sig);
+            }
+        }
+
+        TEST_CASE("no_authentication")
+        {
+            std::string empty = "{}";
+            auto auth = make_authentication("none", "", true);
+            std::string sig = auth->sign(make_raw(empty), make_raw(empty), make_raw(empty), make_raw(empty));
+            REQUIRE(sig.empty());
+            REQUIRE(auth->verify(make_raw(sig), make_raw(empty), make_raw(empty), make_raw(empty), make_raw(empty),
+                                 { make_raw(empty) }));
+        }
+    }
+}
@@ -0,0 +1,75 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <collie/testing/doctest.h>
+
+#include <thread>
+
+#include <dwarf/core/buffer_pool.h>
+
+namespace dwarf
+{
+    TEST_SUITE("buffer_pool")
+    {
+        TEST_CASE("reuse")
+        {
+            BufferPool &pool = BufferPool::local();
+            PooledBuffer *buffer = pool.acquire();
+            buffer->data().assign(100, 'a');
+            BufferPool::release(buffer);
+
+            PooledBuffer *reused = pool.acquire();
+            REQUIRE_EQ(reused, buffer);
+            REQUIRE(reused->data().empty());
+            BufferPool::release(reused);
+        }
+
+        TEST_CASE("release_from_other_thread")
+        {
+            BufferPool &pool = BufferPool::local();
+            PooledBuffer *buffer = pool.acquire();
+            std::thread t([buffer]() { BufferPool::release(buffer); });
+            t.join();
+
+            PooledBuffer *reused = pool.acquire();
+            REQUIRE_EQ(reused, buffer);
+            BufferPool::release(reused);
+        }
+
+        TEST_CASE("outlives_owner_thread")
+        {
+            PooledBuffer *buffer = nullptr;
+            std::thread t([&buffer]() { buffer = BufferPool::local().acquire(); });
+            t.join();
+            buffer->data().assign(10, 'b');
+            BufferPool::release(buffer);
+        }
+
+        TEST_CASE("sizing")
+        {
+            BufferPool &pool = BufferPool::local();
+            for (int i = 0; i < 64; ++i)
+            {
+                PooledBuffer *buffer = pool.acquire();
+                buffer->data().assign(8192, 'c');
+                BufferPool::release(buffer);
+            }
+            PooledBuffer *buffer = pool.acquire();
+            REQUIRE_GT(pool.expected_size(), std::size_t(4096));
+            REQUIRE_GE(buffer->data().capacity(), pool.expected_size());
+            BufferPool::release(buffer);
+        }
+    }
+}
@@ -0,0 +1,55 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <collie/testing/doctest.h>
+
+#include <cstdint>
+
+#include <dwarf/core/histogram.h>
+
+namespace dwarf
+{
+    TEST_SUITE("histogram")
+    {
+        TEST_CASE("buckets")
+        {
+            REQUIRE_EQ(Histogram::bucket(0), std::size_t(0));
+            REQUIRE_EQ(Histogram::bucket(1), std::size_t(1));
+            REQUIRE_EQ(Histogram::bucket(2), std::size_t(2));
+            REQUIRE_EQ(Histogram::bucket(3), std::size_t(2));
+            REQUIRE_EQ(Histogram::bucket(4), std::size_t(3));
+            REQUIRE_EQ(Histogram::bucket(UINT64_MAX), Histogram::bucket_count - 1);
+            REQUIRE_EQ(Histogram::lower_bound(0), std::uint64_t(0));
+            REQUIRE_EQ(Histogram::lower_bound(3), std::uint64_t(4));
+        }
+
+        TEST_CASE("record")
+        {
+            Histogram h;
+            REQUIRE_EQ(h.total(), std::uint64_t(0));
+            REQUIRE(h.to_string().empty());
+
+            h.record(1);
+            h.record(1);
+            h.record(5);
+            h.record(7);
+            REQUIRE_EQ(h.total(), std::uint64_t(4));
+            REQUIRE_EQ(h.sum(), std::uint64_t(14));
+            REQUIRE_EQ(h.count(1), std::uint64_t(2));
+            REQUIRE_EQ(h.count(3), std::uint64_t(2));
+            REQUIRE_EQ(h.to_string(), "1:2 4:2");
+        }
+    }
+}
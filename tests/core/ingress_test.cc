@@ -0,0 +1,306 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <collie/testing/doctest.h>
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <collie/nlohmann/json.hpp>
+
+#include <dwarf/zmq/zmq.hpp>
+#include <dwarf/zmq/zmq_addon.hpp>
+#include <dwarf/dmq/authentication.h>
+#include <dwarf/dmq/ingress.h>
+#include <dwarf/dmq/zmq_serializer.h>
+
+namespace nl = nlohmann;
+
+namespace dwarf
+{
+    namespace
+    {
+        // An ingress bound on inproc, with a DEALER client connected to it
+        struct ingress_fixture
+        {
+            ingress_fixture(const std::string& name, std::size_t batch_size = 8, std::size_t capacity = 64)
+                : p_auth(make_authentication("none", ""))
+                , m_ingress(m_context, "inproc", "ingress_test", name, name, capacity, batch_size)
+                , m_client(m_context, zmq::socket_type::dealer)
+            {
+                m_client.set(zmq::sockopt::linger, 0);
+                m_client.set(zmq::sockopt::routing_id, "client");
+                m_client.connect("inproc://ingress_test-" + name);
+            }
+
+            ~ingress_fixture()
+            {
+                m_ingress.stop();
+            }
+
+            void start()
+            {
+                m_ingress.start([this](zmq::multipart_t& wire_msg) {
+                    return xzmq_serializer::deserialize(wire_msg, *p_auth, decoding_policy::LAZY);
+                });
+            }
+
+            void send_request(const std::string& msg_type, const std::string& code)
+            {
+                nl::json content;
+                content["code"] = code;
+                Message msg(Message::guid_list(),
+                            make_header(msg_type, "user", "session"),
+                            nl::json::object(),
+                            nl::json::object(),
+                            std::move(content),
+                            buffer_sequence());
+                zmq::multipart_t wire_msg = xzmq_serializer::serialize(std::move(msg), *p_auth);
+                wire_msg.send(m_client);
+            }
+
+            // Waits until count requests are queued
+            void wait_depth(std::size_t count)
+            {
+                while (m_ingress.depth() < count)
+                {
+                    m_ingress.poll(nullptr, 0, 10);
+                }
+            }
+
+            // Codes of the next count requests, in the order they are served
+            std::vector<std::string> pop_codes(std::size_t count)
+            {
+                std::vector<std::string> res;
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    res.push_back(pop().content()["code"]);
+                }
+                return res;
+            }
+
+            Message pop()
+            {
+                Message msg;
+                while (!m_ingress.try_pop(msg))
+                {
+                    m_ingress.poll(nullptr, 0, 100);
+                }
+                return msg;
+            }
+
+            zmq::context_t m_context;
+            std::unique_ptr<Authentication> p_auth;
+            Ingress m_ingress;
+            zmq::socket_t m_client;
+        };
+    }
+
+    TEST_SUITE("ingress")
+    {
+        TEST_CASE("request_reply_order")
+        {
+            ingress_fixture f("order");
+            f.start();
+            const std::size_t count = 32;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                f.send_request("execute_request", std::to_string(i));
+            }
+
+            // Requests are served in order of reception, and their sections
+            // left to the executor are decoded on access.
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                Message request = f.pop();
+                REQUIRE(request.kind() == message_kind::execute_request);
+                REQUIRE_EQ(request.content()["code"], std::to_string(i));
+
+                nl::json content;
+                content["code"] = request.content()["code"];
+                Message reply(request.identities(),
+                              make_header("execute_reply", "user", "session"),
+                              request.header(),
+                              nl::json::object(),
+                              std::move(content),
+                              buffer_sequence());
+                zmq::multipart_t wire_reply = xzmq_serializer::serialize(std::move(reply), *f.p_auth);
+                f.m_ingress.send(wire_reply);
+            }
+
+            // The replies are sent in the order they were queued
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                zmq::multipart_t wire_reply;
+                REQUIRE(wire_reply.recv(f.m_client));
+                Message reply = xzmq_serializer::deserialize(wire_reply, *f.p_auth);
+                REQUIRE_EQ(reply.content()["code"], std::to_string(i));
+            }
+            REQUIRE_EQ(f.m_ingress.depth(), std::size_t(0));
+        }
+
+        TEST_CASE("priority_classes")
+        {
+            ingress_fixture f("classes");
+            f.m_ingress.set_priorities({{"complete_request", 0}, {"custom_request", 0}}, 1, 16);
+            f.start();
+            f.send_request("execute_request", "a");
+            f.send_request("complete_request", "b");
+            f.send_request("kernel_info_request", "c");
+            f.send_request("custom_request", "d");
+            f.send_request("other_request", "e");
+            f.send_request("complete_request", "f");
+            f.wait_depth(6);
+
+            // Class 0 first, then the default class, each in reception order
+            std::vector<std::string> expected = {"b", "d", "f", "a", "c", "e"};
+            REQUIRE(f.pop_codes(6) == expected);
+        }
+
+        TEST_CASE("max_overtakes")
+        {
+            ingress_fixture f("overtakes");
+            f.m_ingress.set_priorities({{"complete_request", 0}}, 1, 2);
+            f.start();
+            f.send_request("execute_request", "x1");
+            f.send_request("execute_request", "x2");
+            for (std::size_t i = 1; i <= 4; ++i)
+            {
+                f.send_request("complete_request", "c" + std::to_string(i));
+            }
+            f.wait_depth(6);
+
+            // The head of the execution class is served after being overtaken twice
+            std::vector<std::string> expected = {"c1", "c2", "x1", "c3", "c4", "x2"};
+            REQUIRE(f.pop_codes(6) == expected);
+        }
+
+        TEST_CASE("burst_behind_execution")
+        {
+            // A reconnecting frontend asks for the kernel info while a burst
+            // of executions has been waiting for a long time
+            ingress_fixture f("burst");
+            f.m_ingress.set_priorities({{"kernel_info_request", 0}}, 1, 16);
+            f.start();
+            for (std::size_t i = 0; i < 8; ++i)
+            {
+                f.send_request("execute_request", std::to_string(i));
+            }
+            f.wait_depth(8);
+            std::this_thread::sleep_for(std::chrono::milliseconds(150));
+            f.send_request("kernel_info_request", "info");
+            f.wait_depth(9);
+
+            std::vector<std::string> expected = {"info", "0", "1"};
+            REQUIRE(f.pop_codes(3) == expected);
+        }
+
+        TEST_CASE("same_class_fifo")
+        {
+            // Without priorities, every request is in the same class
+            ingress_fixture f("fifo");
+            f.start();
+            const char* types[] = {"execute_request", "complete_request", "kernel_info_request", "other_request"};
+            std::vector<std::string> expected;
+            for (std::size_t i = 0; i < 16; ++i)
+            {
+                expected.push_back(std::to_string(i));
+                f.send_request(types[i % 4], expected.back());
+            }
+            f.wait_depth(16);
+            REQUIRE(f.pop_codes(16) == expected);
+        }
+
+        TEST_CASE("drain_until")
+        {
+            ingress_fixture f("drain");
+            f.start();
+            f.send_request("execute_request", "queued");
+            f.wait_depth(1);
+
+            std::vector<std::string> codes;
+            auto consumer = [&codes](Message msg) { codes.push_back(msg.content()["code"]); };
+            std::thread sender([&f]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                f.send_request("execute_request", "in_time");
+            });
+            auto start = std::chrono::steady_clock::now();
+            f.m_ingress.drain_until(start + std::chrono::milliseconds(100), consumer);
+            sender.join();
+            REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(100));
+
+            // Requests received after the deadline stay queued
+            f.send_request("execute_request", "late");
+            f.wait_depth(1);
+            std::vector<std::string> expected = {"queued", "in_time"};
+            REQUIRE(codes == expected);
+            REQUIRE(f.pop_codes(1) == std::vector<std::string>{"late"});
+        }
+
+        TEST_CASE("full_queue")
+        {
+            ingress_fixture f("full", 8, 2);
+            f.m_client.set(zmq::sockopt::rcvtimeo, 1000);
+            f.start();
+            std::vector<std::string> expected;
+            for (std::size_t i = 0; i < 8; ++i)
+            {
+                expected.push_back(std::to_string(i));
+                f.send_request("execute_request", expected.back());
+            }
+            // Two requests queued, one kept aside, the others left to zmq
+            f.wait_depth(3);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            REQUIRE_EQ(f.m_ingress.depth(), std::size_t(3));
+
+            // Replies are still sent while the queue is full
+            Message reply(Message::guid_list({binary_buffer(std::string("client"))}),
+                          make_header("execute_reply", "user", "session"),
+                          nl::json::object(),
+                          nl::json::object(),
+                          nl::json::object(),
+                          buffer_sequence());
+            zmq::multipart_t wire_reply = xzmq_serializer::serialize(std::move(reply), *f.p_auth);
+            f.m_ingress.send(wire_reply);
+            zmq::multipart_t wire_msg;
+            REQUIRE(wire_msg.recv(f.m_client));
+
+            // Collecting the queued requests resumes the reception
+            REQUIRE(f.pop_codes(8) == expected);
+
+            // Stops with a full queue
+            for (std::size_t i = 0; i < 8; ++i)
+            {
+                f.send_request("execute_request", std::to_string(i));
+            }
+            f.wait_depth(3);
+        }
+
+        TEST_CASE("zero_batch_size")
+        {
+            // Receives one request per wakeup instead of none
+            ingress_fixture f("zero_batch", 0);
+            f.start();
+            f.send_request("execute_request", "a");
+            f.send_request("execute_request", "b");
+            std::vector<std::string> expected = {"a", "b"};
+            REQUIRE(f.pop_codes(2) == expected);
+        }
+    }
+}
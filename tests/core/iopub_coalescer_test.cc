@@ -0,0 +1,249 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <collie/testing/doctest.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <collie/nlohmann/json.hpp>
+
+#include <dwarf/core/iopub_coalescer.h>
+#include <dwarf/core/message.h>
+
+namespace nl = nlohmann;
+
+namespace dwarf
+{
+    namespace
+    {
+        struct coalescer_fixture
+        {
+            coalescer_fixture()
+                : m_coalescer([this](PubMessage msg, channel) {
+                                  std::lock_guard<std::mutex> lock(m_mutex);
+                                  m_published.push_back(std::move(msg));
+                              },
+                              [](const std::string &name, std::string text, LazyJson parent_header, channel) {
+                                  nl::json content;
+                                  content["name"] = name;
+                                  content["text"] = std::move(text);
+                                  return PubMessage("stream",
+                                                    make_header("stream", "user", "session"),
+                                                    std::move(parent_header),
+                                                    nl::json::object(),
+                                                    std::move(content),
+                                                    buffer_sequence());
+                              })
+            {
+            }
+
+            std::size_t published()
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                return m_published.size();
+            }
+
+            std::mutex m_mutex;
+            std::vector<PubMessage> m_published;
+            IOPubCoalescer m_coalescer;
+        };
+
+        PubMessage make_pub_message(const std::string &msg_type, LazyJson parent_header, nl::json content)
+        {
+            return PubMessage(msg_type,
+                              make_header(msg_type, "user", "session"),
+                              std::move(parent_header),
+                              nl::json::object(),
+                              std::move(content),
+                              buffer_sequence());
+        }
+
+        PubMessage make_status(LazyJson parent_header)
+        {
+            nl::json content;
+            content["execution_state"] = "idle";
+            return make_pub_message("status", std::move(parent_header), std::move(content));
+        }
+
+        PubMessage make_update(LazyJson parent_header, const std::string &display_id, int value)
+        {
+            nl::json content;
+            content["data"]["text/plain"] = std::to_string(value);
+            content["metadata"] = nl::json::object();
+            content["transient"]["display_id"] = display_id;
+            return make_pub_message("update_display_data", std::move(parent_header), std::move(content));
+        }
+
+        PubMessage make_clear_output(LazyJson parent_header, bool wait)
+        {
+            nl::json content;
+            content["wait"] = wait;
+            return make_pub_message("clear_output", std::move(parent_header), std::move(content));
+        }
+
+        LazyJson make_parent(const std::string &msg_id)
+        {
+            nl::json header = make_header("execute_request", "user", "session");
+            header["msg_id"] = msg_id;
+            return LazyJson(binary_buffer(header.dump()), decoding_policy::LAZY);
+        }
+    }
+
+    TEST_SUITE("iopub_coalescer")
+    {
+        TEST_CASE("merge_consecutive_writes")
+        {
+            coalescer_fixture f;
+            f.m_coalescer.configure(std::chrono::hours(1), 1 << 20);
+            LazyJson parent = make_parent("a");
+            f.m_coalescer.write_stream("stdout", "a\n", parent, channel::SHELL);
+            f.m_coalescer.write_stream("stdout", "b\n", parent, channel::SHELL);
+            f.m_coalescer.write_stream("stderr", "c\n", parent, channel::SHELL);
+            f.m_coalescer.write_stream("stderr", "d\n", make_parent("b"), channel::SHELL);
+            f.m_coalescer.publish("status", make_status(parent), channel::SHELL);
+
+            REQUIRE_EQ(f.m_published.size(), std::size_t(4));
+            REQUIRE_EQ(f.m_published[0].content()["text"], "a\nb\n");
+            REQUIRE_EQ(f.m_published[1].content()["text"], "c\n");
+            REQUIRE_EQ(f.m_published[2].content()["text"], "d\n");
+            REQUIRE_EQ(f.m_published[3].header()["msg_type"], "status");
+
+            IOPubCoalescer::stats_type stats = f.m_coalescer.stats();
+            REQUIRE_EQ(stats.m_writes, std::size_t(4));
+            REQUIRE_EQ(stats.m_messages, std::size_t(3));
+            REQUIRE_EQ(stats.m_messages_saved, std::size_t(1));
+            REQUIRE_GT(stats.m_bytes_saved, std::size_t(0));
+        }
+
+        TEST_CASE("flush_on_size")
+        {
+            coalescer_fixture f;
+            f.m_coalescer.configure(std::chrono::hours(1), 8);
+            LazyJson parent = make_parent("a");
+            f.m_coalescer.write_stream("stdout", "1234", parent, channel::SHELL);
+            REQUIRE_EQ(f.published(), std::size_t(0));
+            f.m_coalescer.write_stream("stdout", "5678", parent, channel::SHELL);
+            REQUIRE_EQ(f.published(), std::size_t(1));
+            REQUIRE_EQ(f.m_published[0].content()["text"], "12345678");
+        }
+
+        TEST_CASE("flush_on_window")
+        {
+            coalescer_fixture f;
+            f.m_coalescer.configure(std::chrono::milliseconds(50), 1 << 20);
+            LazyJson parent = make_parent("a");
+            f.m_coalescer.write_stream("stdout", "a", parent, channel::SHELL);
+            f.m_coalescer.write_stream("stdout", "b", parent, channel::SHELL);
+            for (int i = 0; i < 1000 && f.published() == 0; ++i)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            REQUIRE_EQ(f.published(), std::size_t(1));
+            REQUIRE_EQ(f.m_published[0].content()["text"], "ab");
+        }
+
+        TEST_CASE("disabled")
+        {
+            coalescer_fixture f;
+            LazyJson parent = make_parent("a");
+            f.m_coalescer.write_stream("stdout", "a", parent, channel::SHELL);
+            f.m_coalescer.write_stream("stdout", "b", parent, channel::SHELL);
+            REQUIRE_EQ(f.m_published.size(), std::size_t(2));
+            REQUIRE_EQ(f.m_coalescer.stats().m_messages_saved, std::size_t(0));
+        }
+
+        TEST_CASE("latest_update_wins")
+        {
+            coalescer_fixture f;
+            f.m_coalescer.configure(std::chrono::hours(1), 1 << 20);
+            LazyJson parent = make_parent("a");
+            f.m_coalescer.publish("update_display_data", make_update(parent, "bar", 1), channel::SHELL);
+            f.m_coalescer.write_stream("stdout", "a", parent, channel::SHELL);
+            f.m_coalescer.publish("update_display_data", make_update(parent, "plot", 1), channel::SHELL);
+            f.m_coalescer.publish("update_display_data", make_update(parent, "bar", 2), channel::SHELL);
+            f.m_coalescer.publish("update_display_data", make_update(parent, "bar", 3), channel::SHELL);
+            f.m_coalescer.flush();
+
+            REQUIRE_EQ(f.m_published.size(), std::size_t(3));
+            REQUIRE_EQ(f.m_published[0].content()["data"]["text/plain"], "3");
+            REQUIRE_EQ(f.m_published[1].content()["text"], "a");
+            REQUIRE_EQ(f.m_published[2].content()["transient"]["display_id"], "plot");
+            REQUIRE_EQ(f.m_coalescer.stats().m_messages_saved, std::size_t(2));
+        }
+
+        TEST_CASE("clear_output_folding")
+        {
+            coalescer_fixture f;
+            f.m_coalescer.configure(std::chrono::hours(1), 1 << 20);
+            LazyJson parent = make_parent("a");
+            for (int i = 0; i < 3; ++i)
+            {
+                f.m_coalescer.publish("clear_output", make_clear_output(parent, true), channel::SHELL);
+                f.m_coalescer.write_stream("stdout", std::to_string(i), parent, channel::SHELL);
+            }
+            f.m_coalescer.publish("status", make_status(parent), channel::SHELL);
+
+            REQUIRE_EQ(f.m_published.size(), std::size_t(3));
+            REQUIRE_EQ(f.m_published[0].content()["wait"], true);
+            REQUIRE_EQ(f.m_published[1].content()["text"], "2");
+            REQUIRE_EQ(f.m_published[2].header()["msg_type"], "status");
+            REQUIRE_EQ(f.m_coalescer.stats().m_messages_saved, std::size_t(4));
+        }
+
+        TEST_CASE("clear_output_keeps_displays_with_id")
+        {
+            coalescer_fixture f;
+            f.m_coalescer.configure(std::chrono::hours(1), 1 << 20);
+            LazyJson parent = make_parent("a");
+            nl::json content;
+            content["data"]["text/plain"] = "0";
+            content["metadata"] = nl::json::object();
+            content["transient"]["display_id"] = "bar";
+            f.m_coalescer.publish("display_data", make_pub_message("display_data", parent, content), channel::SHELL);
+            f.m_coalescer.write_stream("stdout", "a", parent, channel::SHELL);
+            f.m_coalescer.publish("clear_output", make_clear_output(parent, false), channel::SHELL);
+            f.m_coalescer.publish("update_display_data", make_update(parent, "bar", 1), channel::SHELL);
+            f.m_coalescer.flush();
+
+            REQUIRE_EQ(f.m_published.size(), std::size_t(3));
+            REQUIRE_EQ(f.m_published[0].header()["msg_type"], "display_data");
+            REQUIRE_EQ(f.m_published[1].header()["msg_type"], "clear_output");
+            REQUIRE_EQ(f.m_published[2].header()["msg_type"], "update_display_data");
+            REQUIRE_EQ(f.m_published[2].content()["data"]["text/plain"], "1");
+        }
+
+        TEST_CASE("waiting_clear_output_is_held")
+        {
+            coalescer_fixture f;
+            f.m_coalescer.configure(std::chrono::milliseconds(1), 1 << 20);
+            LazyJson parent = make_parent("a");
+            f.m_coalescer.publish("clear_output", make_clear_output(parent, true), channel::SHELL);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            REQUIRE_EQ(f.published(), std::size_t(0));
+
+            f.m_coalescer.publish("update_display_data", make_update(parent, "bar", 1), channel::SHELL);
+            for (int i = 0; i < 1000 && f.published() == 0; ++i)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            REQUIRE_EQ(f.published(), std::size_t(2));
+            REQUIRE_EQ(f.m_published[0].header()["msg_type"], "clear_output");
+        }
+    }
+}
@@ -0,0 +1,489 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <collie/testing/doctest.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <collie/nlohmann/json.hpp>
+
+#include "mock_interpreter.h"
+#include "mock_server.h"
+
+#include <dwarf/core/history_manager.h>
+#include <dwarf/core/kernel_configuration.h>
+#include <dwarf/core/kernel_core.h>
+#include <dwarf/core/logger_impl.h>
+#include <dwarf/dmq/authentication.h>
+#include <dwarf/dmq/zmq_serializer.h>
+
+namespace nl = nlohmann;
+
+namespace dwarf
+{
+    namespace
+    {
+        struct kernel_core_fixture
+        {
+            kernel_core_fixture()
+                : p_history(make_in_memory_history_manager())
+                , m_core("kernel", "user", "session", &m_logger, &m_server, &m_interpreter,
+                         p_history.get(), nullptr, nl::json::error_handler_t::strict)
+            {
+                m_interpreter.configure();
+            }
+
+            LoggerNolog m_logger;
+            xmock_server m_server;
+            MockInterpreter m_interpreter;
+            std::unique_ptr<HistoryManager> p_history;
+            KernelCore m_core;
+        };
+
+        // Goes through the wire format so that the request holds its raw frames,
+        // as it would when received by a real server.
+        Message make_request(const std::string &msg_type, nl::json content,
+                             const std::string &subshell_id = std::string(),
+                             const std::string &identity = "client")
+        {
+            auto auth = make_authentication("none", "");
+            nl::json header = make_header(msg_type, "user", "session");
+            if (!subshell_id.empty())
+            {
+                header["subshell_id"] = subshell_id;
+            }
+            Message msg(Message::guid_list{ binary_buffer(identity) },
+                        std::move(header),
+                        nl::json::object(),
+                        nl::json::object(),
+                        std::move(content),
+                        buffer_sequence());
+            zmq::multipart_t wire_msg = xzmq_serializer::serialize(std::move(msg), *auth);
+            return xzmq_serializer::deserialize(wire_msg, *auth);
+        }
+
+        // Waits for the replies sent from the subshell threads
+        void wait_shell(const xmock_server &server, std::size_t size)
+        {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while (server.shell_size() < size && std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            REQUIRE_GE(server.shell_size(), size);
+        }
+
+        // Waits for a cell to start executing on a subshell thread
+        void wait_execute_input(xmock_server &server)
+        {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while (std::chrono::steady_clock::now() < deadline)
+            {
+                if (server.iopub_size() == 0)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                else if (server.read_iopub().header()["msg_type"] == "execute_input")
+                {
+                    return;
+                }
+            }
+            REQUIRE(false);
+        }
+
+        std::string create_subshell(kernel_core_fixture &f)
+        {
+            f.m_server.receive_shell(make_request("create_subshell_request", nl::json::object()));
+            Message reply = f.m_server.read_shell();
+            REQUIRE_EQ(reply.content()["status"], "ok");
+            return reply.content()["subshell_id"];
+        }
+    }
+
+    TEST_SUITE("kernel_core")
+    {
+        TEST_CASE("parent_header_is_shared")
+        {
+            kernel_core_fixture f;
+            nl::json content;
+            content["code"] = "hello, world";
+            Message request = make_request("execute_request", std::move(content));
+            const char *raw_header = request.raw_header().data();
+            std::string msg_id = request.header()["msg_id"];
+
+            f.m_server.receive_shell(std::move(request));
+
+            REQUIRE_EQ(f.m_server.shell_size(), std::size_t(1));
+            Message reply = f.m_server.read_shell();
+            REQUIRE_EQ(reply.header()["msg_type"], "execute_reply");
+            REQUIRE_EQ(reply.raw_parent_header().data(), raw_header);
+            REQUIRE_EQ(reply.parent_header()["msg_id"], msg_id);
+
+            // busy, execute_input, stream, execute_result, idle
+            REQUIRE_EQ(f.m_server.iopub_size(), std::size_t(5));
+            while (f.m_server.iopub_size() != 0)
+            {
+                PubMessage msg = f.m_server.read_iopub();
+                REQUIRE_EQ(msg.raw_parent_header().data(), raw_header);
+                REQUIRE_EQ(msg.parent_header()["msg_id"], msg_id);
+            }
+        }
+
+        TEST_CASE("interrupt_execute_request")
+        {
+            kernel_core_fixture f;
+            nl::json content;
+            content["code"] = "loop";
+            Message request = make_request("execute_request", std::move(content));
+
+            // The shell thread runs the cell while the control channel, as
+            // in the split server, interrupts it.
+            std::chrono::steady_clock::time_point idle_time;
+            std::thread shell([&f, &request, &idle_time]() {
+                f.m_server.receive_shell(std::move(request));
+                idle_time = std::chrono::steady_clock::now();
+            });
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+            auto interrupt_time = std::chrono::steady_clock::now();
+            f.m_server.receive_control(make_request("interrupt_request", nl::json::object()));
+            shell.join();
+
+            auto latency = std::chrono::duration_cast<std::chrono::microseconds>(idle_time - interrupt_time);
+            MESSAGE("interrupt to idle latency: " << latency.count() << " us");
+            REQUIRE_LT(latency.count(), 1000000);
+
+            REQUIRE_EQ(f.m_server.control_size(), std::size_t(1));
+            REQUIRE_EQ(f.m_server.read_control().header()["msg_type"], "interrupt_reply");
+            REQUIRE_EQ(f.m_server.shell_size(), std::size_t(1));
+            Message reply = f.m_server.read_shell();
+            REQUIRE_EQ(reply.content()["status"], "error");
+            REQUIRE_EQ(reply.content()["ename"], "KeyboardInterrupt");
+
+            // The token is reset by the next execution
+            nl::json next;
+            next["code"] = "hello, world";
+            f.m_server.receive_shell(make_request("execute_request", std::move(next)));
+            REQUIRE_FALSE(f.m_interpreter.is_interrupted());
+            REQUIRE_EQ(f.m_server.read_shell().content()["status"], "ok");
+        }
+
+        TEST_CASE("stale_complete_request")
+        {
+            kernel_core_fixture f;
+            nl::json content;
+            content["code"] = "a.te";
+            content["cursor_pos"] = 4;
+            f.m_server.queue_shell(make_request("complete_request", content));
+            f.m_server.queue_shell(make_request("complete_request", content));
+            f.m_server.dispatch_shell();
+
+            REQUIRE_EQ(f.m_server.shell_size(), std::size_t(2));
+            Message stale = f.m_server.read_shell();
+            REQUIRE_EQ(stale.content()["status"], "ok");
+            REQUIRE(stale.content()["matches"].empty());
+            REQUIRE_EQ(stale.content()["cursor_start"], 4);
+            Message latest = f.m_server.read_shell();
+            REQUIRE_EQ(latest.content()["matches"].size(), std::size_t(2));
+
+            // The latest request of a key does not supersede the next one
+            f.m_server.queue_shell(make_request("complete_request", content));
+            f.m_server.dispatch_shell();
+            REQUIRE_EQ(f.m_server.read_shell().content()["matches"].size(), std::size_t(2));
+        }
+
+        TEST_CASE("abort_queue_deadline")
+        {
+            kernel_core_fixture f;
+            Configuration config;
+            config.m_abort_grace_period = 200;
+            f.m_core.configure(config);
+
+            nl::json failing;
+            failing["code"] = "raise";
+            failing["stop_on_error"] = true;
+            nl::json queued;
+            queued["code"] = "hello, world";
+            f.m_server.queue_shell(make_request("execute_request", std::move(failing)));
+            f.m_server.queue_shell(make_request("execute_request", std::move(queued)));
+
+            // The request queued behind the failing cell is aborted without
+            // waiting for the grace period.
+            auto start = std::chrono::steady_clock::now();
+            f.m_server.dispatch_shell();
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start);
+            REQUIRE_LT(elapsed.count(), 200);
+
+            REQUIRE_EQ(f.m_server.shell_size(), std::size_t(2));
+            REQUIRE_EQ(f.m_server.read_shell().content()["ename"], "RuntimeError");
+            Message aborted = f.m_server.read_shell();
+            REQUIRE_EQ(aborted.header()["msg_type"], "execute_reply");
+            REQUIRE_EQ(aborted.content()["status"], "error");
+            REQUIRE_FALSE(aborted.content().contains("ename"));
+
+            // So is a request arriving before the deadline
+            nl::json early;
+            early["code"] = "hello, world";
+            f.m_server.queue_shell(make_request("execute_request", std::move(early)));
+            REQUIRE_EQ(f.m_server.shell_size(), std::size_t(1));
+            REQUIRE_EQ(f.m_server.read_shell().content()["status"], "error");
+
+            // A request arriving after the deadline runs normally
+            std::this_thread::sleep_until(start + std::chrono::milliseconds(250));
+            nl::json next;
+            next["code"] = "hello, world";
+            f.m_server.queue_shell(make_request("execute_request", std::move(next)));
+            f.m_server.dispatch_shell();
+            REQUIRE_EQ(f.m_server.shell_size(), std::size_t(1));
+            REQUIRE_EQ(f.m_server.read_shell().content()["status"], "ok");
+        }
+
+        TEST_CASE("subshell_routing")
+        {
+            kernel_core_fixture f;
+            std::string subshell_id = create_subshell(f);
+
+            f.m_server.receive_shell(make_request("list_subshell_request", nl::json::object()));
+            nl::json ids = f.m_server.read_shell().content()["subshell_id"];
+            REQUIRE_EQ(ids.size(), std::size_t(1));
+            REQUIRE_EQ(ids[0], subshell_id);
+
+            // Taken over by the subshell instead of being queued
+            nl::json content;
+            content["code"] = "hello, world";
+            Message request = make_request("execute_request", std::move(content), subshell_id);
+            std::string msg_id = request.header()["msg_id"];
+            f.m_server.queue_shell(std::move(request));
+            wait_shell(f.m_server, 1);
+            Message reply = f.m_server.read_shell();
+            REQUIRE_EQ(reply.parent_header()["msg_id"], msg_id);
+            REQUIRE_EQ(reply.content()["status"], "ok");
+
+            // Requests for an unknown subshell fall back to the main shell
+            nl::json unknown;
+            unknown["code"] = "hello, world";
+            f.m_server.queue_shell(make_request("execute_request", std::move(unknown), "unknown"));
+            REQUIRE_EQ(f.m_server.shell_size(), std::size_t(0));
+            f.m_server.dispatch_shell();
+            REQUIRE_EQ(f.m_server.read_shell().content()["status"], "ok");
+
+            nl::json deleted;
+            deleted["subshell_id"] = subshell_id;
+            f.m_server.receive_shell(make_request("delete_subshell_request", std::move(deleted)));
+            REQUIRE_EQ(f.m_server.read_shell().content()["status"], "ok");
+            f.m_server.receive_shell(make_request("list_subshell_request", nl::json::object()));
+            REQUIRE(f.m_server.read_shell().content()["subshell_id"].empty());
+        }
+
+        TEST_CASE("subshell_delete_while_busy")
+        {
+            kernel_core_fixture f;
+            std::string subshell_id = create_subshell(f);
+
+            nl::json content;
+            content["code"] = "sleep";
+            f.m_server.queue_shell(make_request("execute_request", std::move(content), subshell_id));
+
+            // The deletion waits for the execution running on the subshell
+            nl::json deleted;
+            deleted["subshell_id"] = subshell_id;
+            f.m_server.receive_shell(make_request("delete_subshell_request", std::move(deleted)));
+            REQUIRE_EQ(f.m_server.shell_size(), std::size_t(2));
+            Message execute_reply = f.m_server.read_shell();
+            REQUIRE_EQ(execute_reply.header()["msg_type"], "execute_reply");
+            REQUIRE_EQ(execute_reply.content()["status"], "ok");
+            Message delete_reply = f.m_server.read_shell();
+            REQUIRE_EQ(delete_reply.header()["msg_type"], "delete_subshell_reply");
+            REQUIRE_EQ(delete_reply.content()["status"], "ok");
+
+            nl::json late;
+            late["code"] = "hello, world";
+            f.m_server.queue_shell(make_request("execute_request", std::move(late), subshell_id));
+            f.m_server.dispatch_shell();
+            REQUIRE_EQ(f.m_server.read_shell().content()["status"], "ok");
+        }
+
+        TEST_CASE("subshell_does_not_block_main_shell")
+        {
+            kernel_core_fixture f;
+            std::string subshell_id = create_subshell(f);
+
+            nl::json loop;
+            loop["code"] = "loop";
+            f.m_server.queue_shell(make_request("execute_request", std::move(loop), subshell_id));
+            wait_execute_input(f.m_server);
+
+            // The main shell executes while the subshell is busy
+            nl::json content;
+            content["code"] = "hello, world";
+            f.m_server.receive_shell(make_request("execute_request", std::move(content)));
+            REQUIRE_EQ(f.m_server.shell_size(), std::size_t(1));
+            REQUIRE_EQ(f.m_server.read_shell().content()["status"], "ok");
+
+            f.m_server.receive_control(make_request("interrupt_request", nl::json::object()));
+            wait_shell(f.m_server, 1);
+            REQUIRE_EQ(f.m_server.read_shell().content()["ename"], "KeyboardInterrupt");
+        }
+
+        TEST_CASE("subshell_comms_on_main_shell")
+        {
+            kernel_core_fixture f;
+            std::string subshell_id = create_subshell(f);
+
+            std::thread::id opened_on;
+            f.m_interpreter.comm_manager().register_comm_target(
+                "thread_target", [&opened_on](Comm &&, const Message &) {
+                    opened_on = std::this_thread::get_id();
+                });
+
+            nl::json content;
+            content["comm_id"] = std::string(new_guid());
+            content["target_name"] = "thread_target";
+            content["data"] = nl::json::object();
+            f.m_server.queue_shell(make_request("comm_open", std::move(content), subshell_id));
+            f.m_server.dispatch_shell();
+            REQUIRE(opened_on == std::this_thread::get_id());
+        }
+
+        TEST_CASE("read_only_requests_during_execution")
+        {
+            kernel_core_fixture f;
+            f.m_core.configure(Configuration());
+
+            nl::json sleep;
+            sleep["code"] = "sleep";
+            Message execute = make_request("execute_request", std::move(sleep), std::string(), "executor");
+            std::string execute_id = execute.header()["msg_id"];
+            std::thread shell([&f, &execute]() { f.m_server.receive_shell(std::move(execute)); });
+            wait_execute_input(f.m_server);
+
+            // Sent while the cell runs, answered by the workers
+            nl::json complete;
+            complete["code"] = "a.te";
+            complete["cursor_pos"] = 4;
+            nl::json is_complete;
+            is_complete["code"] = "incomplete";
+            std::vector<Message> requests;
+            requests.push_back(make_request("complete_request", std::move(complete), std::string(), "completer"));
+            requests.push_back(make_request("is_complete_request", std::move(is_complete), std::string(), "checker"));
+            requests.push_back(make_request("kernel_info_request", nl::json::object(), std::string(), "info"));
+            std::map<std::string, std::pair<std::string, std::string>> expected;
+            for (Message &request: requests)
+            {
+                std::string reply_type = request.header()["msg_type"].get<std::string>();
+                reply_type.replace(reply_type.size() - 7, 7, "reply");
+                expected[request.header()["msg_id"]] = std::make_pair(reply_type, request.identities()[0].to_string());
+                f.m_server.queue_shell(std::move(request));
+            }
+
+            // Their replies come first, each with its own parent and identities
+            wait_shell(f.m_server, 3);
+            for (std::size_t i = 0; i < 3; ++i)
+            {
+                Message reply = f.m_server.read_shell();
+                auto iter = expected.find(reply.parent_header()["msg_id"]);
+                REQUIRE(iter != expected.end());
+                REQUIRE_EQ(reply.header()["msg_type"], iter->second.first);
+                REQUIRE_EQ(reply.identities().size(), std::size_t(1));
+                REQUIRE_EQ(reply.identities()[0].to_string(), iter->second.second);
+                expected.erase(iter);
+            }
+
+            shell.join();
+            Message reply = f.m_server.read_shell();
+            REQUIRE_EQ(reply.header()["msg_type"], "execute_reply");
+            REQUIRE_EQ(reply.parent_header()["msg_id"], execute_id);
+            REQUIRE_EQ(reply.identities()[0].to_string(), "executor");
+        }
+
+        TEST_CASE("comm_handler_does_not_hold_the_registry")
+        {
+            kernel_core_fixture f;
+            CommManager &manager = f.m_interpreter.comm_manager();
+            std::unique_ptr<Comm> opened;
+            manager.register_comm_target(
+                "lock_target", [&opened](Comm &&comm, const Message &) {
+                    opened.reset(new Comm(std::move(comm)));
+                });
+
+            std::string comm_id = std::string(new_guid());
+            nl::json open_content;
+            open_content["comm_id"] = comm_id;
+            open_content["target_name"] = "lock_target";
+            open_content["data"] = nl::json::object();
+            f.m_server.receive_shell(make_request("comm_open", std::move(open_content)));
+            REQUIRE(opened != nullptr);
+
+            // While the handler runs, another thread opens a comm and lists
+            // the comms, e.g. a subshell cell and a comm_info_request
+            std::atomic<bool> done(false);
+            opened->on_message([&manager, &done](Message) {
+                std::thread([&manager, &done]() {
+                    Comm other(manager.target("lock_target"));
+                    manager.comm_info("");
+                    done = true;
+                }).detach();
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+                while (!done && std::chrono::steady_clock::now() < deadline)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            });
+
+            nl::json msg_content;
+            msg_content["comm_id"] = comm_id;
+            msg_content["data"] = nl::json::object();
+            f.m_server.receive_shell(make_request("comm_msg", std::move(msg_content)));
+            REQUIRE(done);
+            REQUIRE_EQ(manager.comm_info("")["comms"].size(), std::size_t(1));
+        }
+
+        TEST_CASE("interrupt_concurrent_executions")
+        {
+            kernel_core_fixture f;
+            std::string first = create_subshell(f);
+            std::string second = create_subshell(f);
+
+            // "sleep" does not poll its token and outlives the interrupt
+            nl::json sleep;
+            sleep["code"] = "sleep";
+            f.m_server.queue_shell(make_request("execute_request", std::move(sleep), second));
+            wait_execute_input(f.m_server);
+            f.m_server.receive_control(make_request("interrupt_request", nl::json::object()));
+            REQUIRE_EQ(f.m_server.read_control().header()["msg_type"], "interrupt_reply");
+
+            // An execution started after the interrupt is not cancelled by it,
+            // even though another execution is still in progress
+            nl::json loop;
+            loop["code"] = "loop";
+            f.m_server.queue_shell(make_request("execute_request", std::move(loop), first));
+            wait_execute_input(f.m_server);
+            wait_shell(f.m_server, 1);
+            REQUIRE_EQ(f.m_server.read_shell().content()["status"], "ok");
+            REQUIRE_EQ(f.m_server.shell_size(), std::size_t(0));
+
+            f.m_server.receive_control(make_request("interrupt_request", nl::json::object()));
+            wait_shell(f.m_server, 1);
+            REQUIRE_EQ(f.m_server.read_shell().content()["ename"], "KeyboardInterrupt");
+        }
+    }
+}
@@ -0,0 +1,112 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <collie/testing/doctest.h>
+
+#include <set>
+#include <string>
+
+#include <collie/nlohmann/json.hpp>
+
+#include <dwarf/core/header_factory.h>
+#include <dwarf/core/message.h>
+#include <dwarf/core/message_kind.h>
+
+namespace nl = nlohmann;
+
+namespace dwarf
+{
+    TEST_SUITE("message")
+    {
+        TEST_CASE("iso8601_now")
+        {
+            for (int i = 0; i < 1000; ++i)
+            {
+                std::string now = iso8601_now();
+                REQUIRE_EQ(now.size(), std::size_t(27));
+                REQUIRE_EQ(now[10], 'T');
+                REQUIRE_EQ(now[19], '.');
+                REQUIRE_EQ(now.back(), 'Z');
+                REQUIRE_EQ(now.find_first_not_of("0123456789", 20), std::size_t(26));
+            }
+        }
+
+        TEST_CASE("header_factory")
+        {
+            HeaderFactory factory("user \"quoted\"", "session");
+            binary_buffer raw = factory.make_raw_header("execute_reply");
+            nl::json header = nl::json::parse(raw.begin(), raw.end());
+            nl::json expected = make_header("execute_reply", "user \"quoted\"", "session");
+
+            REQUIRE_EQ(header.size(), expected.size());
+            REQUIRE_EQ(header["msg_type"], expected["msg_type"]);
+            REQUIRE_EQ(header["username"], expected["username"]);
+            REQUIRE_EQ(header["session"], expected["session"]);
+            REQUIRE_EQ(header["version"], expected["version"]);
+            REQUIRE_EQ(header["date"].get<std::string>().size(), std::size_t(27));
+
+            // Same layout as the dump of a json header
+            header["date"] = "";
+            header["msg_id"] = "";
+            expected["date"] = "";
+            expected["msg_id"] = "";
+            REQUIRE_EQ(header.dump(), expected.dump());
+            LazyJson lazy = factory.make_header("status");
+            REQUIRE_EQ(lazy.get()["msg_type"], "status");
+        }
+
+        TEST_CASE("message_id")
+        {
+            std::set<std::string> ids;
+            for (int i = 0; i < 1000; ++i)
+            {
+                ids.insert(new_message_id());
+            }
+            REQUIRE_EQ(ids.size(), std::size_t(1000));
+            REQUIRE_EQ(ids.begin()->size(), std::size_t(32));
+        }
+
+        TEST_CASE("message_kind")
+        {
+            for (std::size_t i = 1; i < message_kind_count; ++i)
+            {
+                message_kind kind = static_cast<message_kind>(i);
+                REQUIRE_EQ(to_message_kind(to_string(kind)), kind);
+            }
+            REQUIRE_EQ(to_message_kind("custom_request"), message_kind::unknown);
+            REQUIRE_EQ(to_message_kind(""), message_kind::unknown);
+            REQUIRE_EQ(reply_kind(message_kind::kernel_info_request), message_kind::kernel_info_reply);
+            REQUIRE_EQ(reply_kind(message_kind::comm_msg), message_kind::unknown);
+
+            Message known(Message::guid_list(),
+                          make_header("comm_msg", "user", "session"),
+                          nl::json::object(),
+                          nl::json::object(),
+                          nl::json::object(),
+                          buffer_sequence());
+            REQUIRE_EQ(known.kind(), message_kind::comm_msg);
+            REQUIRE_EQ(known.msg_type(), "comm_msg");
+
+            Message custom(Message::guid_list(),
+                           make_header("custom_request", "user", "session"),
+                           nl::json::object(),
+                           nl::json::object(),
+                           nl::json::object(),
+                           buffer_sequence());
+            REQUIRE_EQ(custom.kind(), message_kind::unknown);
+            REQUIRE_EQ(custom.msg_type(), "custom_request");
+        }
+    }
+}
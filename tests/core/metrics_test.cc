@@ -0,0 +1,111 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <collie/testing/doctest.h>
+
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include <dwarf/core/metrics.h>
+
+namespace dwarf
+{
+    TEST_SUITE("metrics")
+    {
+        TEST_CASE("latency_buckets")
+        {
+            REQUIRE_EQ(LatencyHistogram::bucket(7), std::size_t(7));
+            REQUIRE_EQ(LatencyHistogram::bucket(8), std::size_t(8));
+            REQUIRE_EQ(LatencyHistogram::bucket(16), std::size_t(16));
+            REQUIRE_EQ(LatencyHistogram::bucket(17), std::size_t(16));
+            REQUIRE_EQ(LatencyHistogram::bucket(18), std::size_t(17));
+            REQUIRE_EQ(LatencyHistogram::bucket(UINT64_MAX), LatencyHistogram::bucket_count - 1);
+            for (std::uint64_t value : {9ull, 100ull, 1000ull, 123456ull, 987654321ull})
+            {
+                std::size_t bucket = LatencyHistogram::bucket(value);
+                REQUIRE_LE(LatencyHistogram::lower_bound(bucket), value);
+                REQUIRE_GT(LatencyHistogram::lower_bound(bucket + 1), value);
+            }
+        }
+
+        TEST_CASE("disabled")
+        {
+            Metrics metrics;
+            metrics.record(metric_stage::handler, metric_socket::SHELL, message_kind::execute_request, 10);
+            metrics.count(metric_socket::SHELL, metric_direction::RECEIVED, 10);
+            nl::json res = metrics.to_json();
+            REQUIRE_FALSE(res["enabled"].get<bool>());
+            REQUIRE(res["latencies"].empty());
+            REQUIRE_EQ(res["sockets"]["shell"]["received_messages"].get<std::uint64_t>(), std::uint64_t(0));
+        }
+
+        TEST_CASE("record")
+        {
+            Metrics metrics;
+            metrics.set_enabled(true);
+            for (std::uint64_t i = 1; i <= 100; ++i)
+            {
+                metrics.record(metric_stage::handler, metric_socket::SHELL, message_kind::execute_request, i * 1000);
+            }
+            // Other threads record in their own shard
+            std::thread t([&metrics]() {
+                metrics.record(metric_stage::handler, metric_socket::SHELL, message_kind::execute_request, 1000);
+                metrics.count(metric_socket::IOPUB, metric_direction::SENT, 42);
+            });
+            t.join();
+            metrics.count(metric_socket::IOPUB, metric_direction::SENT, 8);
+
+            nl::json res = metrics.to_json();
+            REQUIRE_EQ(res["latencies"].size(), std::size_t(1));
+            const nl::json& latency = res["latencies"][0];
+            REQUIRE_EQ(latency["msg_type"].get<std::string>(), "execute_request");
+            REQUIRE_EQ(latency["socket"].get<std::string>(), "shell");
+            REQUIRE_EQ(latency["stage"].get<std::string>(), "handler");
+            REQUIRE_EQ(latency["count"].get<std::uint64_t>(), std::uint64_t(101));
+            REQUIRE_EQ(latency["max_ns"].get<std::uint64_t>(), std::uint64_t(100000));
+            // At most one sub-bucket off
+            std::uint64_t p50 = latency["p50_ns"].get<std::uint64_t>();
+            REQUIRE_GE(p50, std::uint64_t(50000));
+            REQUIRE_LE(p50, std::uint64_t(57000));
+
+            const nl::json& iopub = res["sockets"]["iopub"];
+            REQUIRE_EQ(iopub["sent_messages"].get<std::uint64_t>(), std::uint64_t(2));
+            REQUIRE_EQ(iopub["sent_bytes"].get<std::uint64_t>(), std::uint64_t(50));
+
+            std::string text = metrics.to_prometheus();
+            REQUIRE_NE(text.find("dwarf_message_latency_seconds_count{msg_type=\"execute_request\","
+                                 "socket=\"shell\",stage=\"handler\"} 101"), std::string::npos);
+            REQUIRE_NE(text.find("dwarf_socket_bytes_total{socket=\"iopub\",direction=\"sent\"} 50"),
+                       std::string::npos);
+        }
+
+        TEST_CASE("metrics_request")
+        {
+            nl::json request;
+            request["dwarf_request"] = "metrics";
+            REQUIRE(is_metrics_request(request));
+            REQUIRE_FALSE(is_metrics_request(nl::json::object()));
+            REQUIRE_FALSE(is_metrics_request(nl::json(3)));
+
+            nl::json reply = metrics_reply(request);
+            REQUIRE_EQ(reply["status"].get<std::string>(), "ok");
+            REQUIRE(reply["metrics"].contains("sockets"));
+
+            request["format"] = "prometheus";
+            reply = metrics_reply(request);
+            REQUIRE(reply["text"].is_string());
+        }
+    }
+}
@@ -14,7 +14,9 @@
 //
 
 
+#include <chrono>
 #include <iostream>
+#include <thread>
 
 #include <collie/nlohmann/json.hpp>
 
@@ -54,6 +56,25 @@ namespace dwarf
             publish_stream("stderr", code);
         }
 
+        if (code.compare("sleep") == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        if (code.compare("raise") == 0)
+        {
+            return dwarf::create_error_reply("raised", "RuntimeError");
+        }
+
+        if (code.compare("loop") == 0)
+        {
+            while (!is_interrupted())
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return dwarf::create_error_reply("interrupted", "KeyboardInterrupt");
+        }
+
         if (code.compare("?") == 0)
         {
             std::string html_content = R"(<iframe class="xpyt-iframe-pager" src="
@@ -120,4 +141,9 @@ namespace dwarf
     void MockInterpreter::shutdown_request_impl()
     {
     }
+
+    bool MockInterpreter::supports_concurrent_requests_impl() const
+    {
+        return true;
+    }
 }
@@ -52,6 +52,8 @@ namespace dwarf
         nl::json kernel_info_request_impl() override;
 
         void shutdown_request_impl() override;
+
+        bool supports_concurrent_requests_impl() const override;
     };
 }
 
@@ -36,64 +36,92 @@ xmock_server::xmock_server()
 
 void xmock_server::receive_shell(Message message)
 {
-    m_shell_messages.push(std::move(message));
+    notify_shell_listener(std::move(message));
+}
+
+void xmock_server::queue_shell(Message message)
+{
+    if (m_abort_listener && std::chrono::steady_clock::now() < m_abort_deadline)
+    {
+        m_abort_listener(std::move(message));
+    }
+    else if (!notify_concurrent_shell_listener(message))
+    {
+        m_queued_shell_messages.push(std::move(message));
+    }
+}
+
+void xmock_server::dispatch_shell()
+{
+    while (!m_queued_shell_messages.empty())
+    {
+        notify_shell_listener(read_impl(m_queued_shell_messages));
+    }
 }
 
 void xmock_server::receive_control(Message message)
 {
-    m_control_messages.push(std::move(message));
+    notify_control_listener(std::move(message));
 }
 
 void xmock_server::receive_stdin(Message message)
 {
-    m_stdin_messages.push(std::move(message));
+    notify_stdin_listener(std::move(message));
 }
 
 std::size_t xmock_server::shell_size() const
 {
+    std::lock_guard<std::mutex> lock(m_mutex);
     return m_shell_messages.size();
 }
 
 Message xmock_server::read_shell()
 {
+    std::lock_guard<std::mutex> lock(m_mutex);
     return read_impl(m_shell_messages);
 }
 
 std::size_t xmock_server::control_size() const
 {
+    std::lock_guard<std::mutex> lock(m_mutex);
     return m_control_messages.size();
 }
 
 Message xmock_server::read_control()
 {
+    std::lock_guard<std::mutex> lock(m_mutex);
     return read_impl(m_control_messages);
 }
 
 std::size_t xmock_server::stdin_size() const
 {
+    std::lock_guard<std::mutex> lock(m_mutex);
     return m_stdin_messages.size();
 }
 
 Message xmock_server::read_stdin()
 {
+    std::lock_guard<std::mutex> lock(m_mutex);
     return read_impl(m_stdin_messages);
 }
 
 std::size_t xmock_server::iopub_size() const
 {
+    std::lock_guard<std::mutex> lock(m_mutex);
     return m_iopub_messages.size();
 }
 
 PubMessage xmock_server::read_iopub()
 {
-    PubMessage res = std::move(m_iopub_messages.back());
+    std::lock_guard<std::mutex> lock(m_mutex);
+    PubMessage res = std::move(m_iopub_messages.front());
     m_iopub_messages.pop();
     return res;
 }
 
 Message xmock_server::read_impl(message_queue& q)
 {
-    Message res = std::move(q.back());
+    Message res = std::move(q.front());
     q.pop();
     return res;
 }
@@ -105,31 +133,44 @@ ControlMessenger& xmock_server::get_control_messenger_impl()
 
 void xmock_server::send_shell_impl(Message message)
 {
+    std::lock_guard<std::mutex> lock(m_mutex);
     m_shell_messages.push(std::move(message));
 }
 
 void xmock_server::send_control_impl(Message message)
 {
+    std::lock_guard<std::mutex> lock(m_mutex);
     m_control_messages.push(std::move(message));
 }
 
 void xmock_server::send_stdin_impl(Message message)
 {
+    std::lock_guard<std::mutex> lock(m_mutex);
     m_stdin_messages.push(std::move(message));
 }
 
 void xmock_server::publish_impl(PubMessage message, channel)
 {
+    std::lock_guard<std::mutex> lock(m_mutex);
     m_iopub_messages.push(std::move(message));
 }
 
 void xmock_server::start_impl(PubMessage message)
 {
+    std::lock_guard<std::mutex> lock(m_mutex);
     m_iopub_messages.push(std::move(message));
 }
 
-void xmock_server::abort_queue_impl(const listener&, long)
+void xmock_server::abort_queue_impl(const listener& l, long grace_period)
 {
+    // Does not block until the deadline like the real servers, the messages
+    // queued before it are aborted by queue_shell instead.
+    m_abort_listener = l;
+    m_abort_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(grace_period);
+    while (!m_queued_shell_messages.empty())
+    {
+        m_abort_listener(read_impl(m_queued_shell_messages));
+    }
 }
 
 void xmock_server::stop_impl()
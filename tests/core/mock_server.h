@@ -16,8 +16,10 @@
 
 #pragma once
 
+#include <chrono>
 #include <cstddef>
 #include <memory>
+#include <mutex>
 #include <queue>
 
 #include <dwarf/core/control_messenger.h>
@@ -42,6 +44,9 @@ namespace dwarf
         xmock_server* p_server;
     };
 
+    // The replies and published messages can be sent from the subshell
+    // and worker threads, the other methods must be called from a single
+    // thread.
     class xmock_server : public Server
     {
     public:
@@ -56,6 +61,11 @@ namespace dwarf
         xmock_server& operator=(xmock_server&&) = delete;
 
         void receive_shell(Message message);
+        // Queues the message the way a real server does before dispatching
+        // it, and dispatches it when dispatch_shell is called. Messages
+        // queued before the deadline of the last abort_queue are aborted.
+        void queue_shell(Message message);
+        void dispatch_shell();
         void receive_control(Message message);
         void receive_stdin(Message message);
 
@@ -83,7 +93,7 @@ namespace dwarf
         void publish_impl(PubMessage message, channel c) override;
 
         void start_impl(PubMessage message) override;
-        void abort_queue_impl(const listener& l, long polling_interval) override;
+        void abort_queue_impl(const listener& l, long grace_period) override;
         void stop_impl() override;
         void update_config_impl(Configuration& config) const override;
 
@@ -92,6 +102,12 @@ namespace dwarf
 
         xmock_messenger m_messenger;
 
+        listener m_abort_listener;
+        std::chrono::steady_clock::time_point m_abort_deadline;
+
+        message_queue m_queued_shell_messages;
+        // Guards the queues below
+        mutable std::mutex m_mutex;
         message_queue m_shell_messages;
         message_queue m_control_messages;
         message_queue m_stdin_messages;
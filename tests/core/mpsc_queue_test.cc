@@ -0,0 +1,99 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <collie/testing/doctest.h>
+
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <dwarf/core/mpsc_queue.h>
+
+namespace dwarf
+{
+    TEST_SUITE("mpsc_queue")
+    {
+        TEST_CASE("push_pop")
+        {
+            MpscQueue<std::unique_ptr<int>> queue(3);
+            REQUIRE_EQ(queue.capacity(), std::size_t(4));
+            REQUIRE(queue.empty());
+
+            for (int i = 0; i < 4; ++i)
+            {
+                std::unique_ptr<int> value(new int(i));
+                REQUIRE(queue.try_push(value));
+                REQUIRE(value == nullptr);
+            }
+            std::unique_ptr<int> extra(new int(4));
+            REQUIRE_FALSE(queue.try_push(extra));
+            REQUIRE(extra != nullptr);
+
+            std::unique_ptr<int> value;
+            for (int i = 0; i < 4; ++i)
+            {
+                REQUIRE(queue.try_pop(value));
+                REQUIRE_EQ(*value, i);
+            }
+            REQUIRE_FALSE(queue.try_pop(value));
+            REQUIRE(queue.empty());
+            REQUIRE(queue.try_push(extra));
+        }
+
+        TEST_CASE("concurrent_producers")
+        {
+            const int nb_producers = 4;
+            const int nb_values = 20000;
+            MpscQueue<int> queue(64);
+
+            std::vector<std::thread> producers;
+            for (int p = 0; p < nb_producers; ++p)
+            {
+                producers.emplace_back([&queue, p, nb_values]() {
+                    for (int i = 0; i < nb_values; ++i)
+                    {
+                        int value = p * nb_values + i;
+                        while (!queue.try_push(value))
+                        {
+                            std::this_thread::yield();
+                        }
+                    }
+                });
+            }
+
+            // Values of each producer come out in order
+            std::vector<int> next(nb_producers, 0);
+            int received = 0;
+            int value = 0;
+            while (received != nb_producers * nb_values)
+            {
+                if (queue.try_pop(value))
+                {
+                    int p = value / nb_values;
+                    REQUIRE_EQ(value % nb_values, next[p]);
+                    ++next[p];
+                    ++received;
+                }
+            }
+
+            for (auto &producer : producers)
+            {
+                producer.join();
+            }
+            REQUIRE(queue.empty());
+        }
+    }
+}
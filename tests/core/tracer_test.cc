@@ -0,0 +1,82 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <collie/testing/doctest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include <dwarf/core/tracer.h>
+
+namespace dwarf
+{
+    TEST_SUITE("tracer")
+    {
+        TEST_CASE("disabled")
+        {
+            Tracer tracer;
+            REQUIRE_FALSE(tracer.enabled());
+            tracer.record("recv", 1, 2, "id", "parent");
+            REQUIRE(tracer.to_chrome_trace()["traceEvents"].empty());
+        }
+
+        TEST_CASE("chrome_trace")
+        {
+            Tracer tracer("tracer_test.json", 4);
+            tracer.set_thread_name("main");
+            for (int i = 0; i < 6; ++i)
+            {
+                tracer.record("dispatch", 1000 * i, 1000 * i + 500, "id" + std::to_string(i), "parent");
+            }
+            std::thread t([&tracer]() { tracer.record("relay", 1000, 3000, "other", ""); });
+            t.join();
+
+            nl::json events = tracer.to_chrome_trace()["traceEvents"];
+            // Thread name, the last 4 spans of the main thread, the span of t
+            REQUIRE_EQ(events.size(), std::size_t(6));
+            REQUIRE_EQ(events[0]["ph"].get<std::string>(), "M");
+            REQUIRE_EQ(events[0]["args"]["name"].get<std::string>(), "main");
+            REQUIRE_EQ(events[1]["name"].get<std::string>(), "dispatch");
+            REQUIRE_EQ(events[1]["args"]["msg_id"].get<std::string>(), "id2");
+            REQUIRE_EQ(events[1]["args"]["parent_msg_id"].get<std::string>(), "parent");
+            REQUIRE_EQ(events[1]["ts"].get<double>(), 2.);
+            REQUIRE_EQ(events[1]["dur"].get<double>(), 0.5);
+            REQUIRE_EQ(events[5]["name"].get<std::string>(), "relay");
+            REQUIRE_NE(events[5]["tid"], events[1]["tid"]);
+        }
+
+        TEST_CASE("dump_at_exit")
+        {
+            {
+                Tracer tracer("tracer_test.json");
+                tracer.record("publish", 1000, 2000, "id", "parent");
+            }
+            std::ifstream ifs("tracer_test.json");
+            nl::json trace = nl::json::parse(ifs);
+            REQUIRE_EQ(trace["traceEvents"].size(), std::size_t(1));
+            ifs.close();
+            std::remove("tracer_test.json");
+        }
+
+        TEST_CASE("trace_request")
+        {
+            nl::json request;
+            request["dwarf_request"] = "trace";
+            REQUIRE(is_trace_request(request));
+            REQUIRE_FALSE(is_trace_request(nl::json::object()));
+        }
+    }
+}
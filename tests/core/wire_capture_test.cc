@@ -0,0 +1,86 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <collie/testing/doctest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <dwarf/zmq/zmq_addon.hpp>
+#include <dwarf/dmq/wire_capture.h>
+
+namespace dwarf
+{
+    TEST_SUITE("wire_capture")
+    {
+        TEST_CASE("round_trip")
+        {
+            const std::string path = "wire_capture_test.bin";
+            {
+                WireCapture capture(path);
+                zmq::multipart_t request;
+                request.addstr("client");
+                request.addstr("<IDS|MSG>");
+                request.addstr("");
+                request.addstr(std::string("\0binary\0", 8));
+                capture.record(metric_socket::SHELL, metric_direction::RECEIVED, request);
+
+                std::thread t([&capture]() {
+                    zmq::multipart_t status;
+                    status.addstr("status");
+                    capture.record(metric_socket::IOPUB, metric_direction::SENT, status);
+                });
+                t.join();
+            }
+
+            WireCaptureReader reader(path);
+            wire_record record;
+            REQUIRE(reader.next(record));
+            REQUIRE(record.m_socket == metric_socket::SHELL);
+            REQUIRE(record.m_direction == metric_direction::RECEIVED);
+            REQUIRE_EQ(record.m_frames.size(), std::size_t(4));
+            REQUIRE_EQ(record.m_frames[1], "<IDS|MSG>");
+            REQUIRE(record.m_frames[2].empty());
+            REQUIRE_EQ(record.m_frames[3], std::string("\0binary\0", 8));
+            std::uint64_t first = record.m_timestamp;
+
+            REQUIRE(reader.next(record));
+            REQUIRE(record.m_socket == metric_socket::IOPUB);
+            REQUIRE(record.m_direction == metric_direction::SENT);
+            REQUIRE_GE(record.m_timestamp, first);
+            zmq::multipart_t status = record.to_multipart();
+            REQUIRE_EQ(status.size(), std::size_t(1));
+            REQUIRE_EQ(status.peekstr(0), "status");
+
+            REQUIRE_FALSE(reader.next(record));
+            std::remove(path.c_str());
+        }
+
+        TEST_CASE("invalid_file")
+        {
+            const std::string path = "wire_capture_test.txt";
+            {
+                std::ofstream out(path);
+                out << "not a capture";
+            }
+            REQUIRE_THROWS_AS(WireCaptureReader(path), std::runtime_error);
+            std::remove(path.c_str());
+        }
+    }
+}
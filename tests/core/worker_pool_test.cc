@@ -0,0 +1,78 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <collie/testing/doctest.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+
+#include <dwarf/core/worker_pool.h>
+
+namespace dwarf
+{
+    TEST_SUITE("worker_pool")
+    {
+        TEST_CASE("runs_posted_tasks")
+        {
+            std::atomic<int> count(0);
+            {
+                WorkerPool pool(2);
+                REQUIRE_EQ(pool.size(), std::size_t(2));
+                for (int i = 0; i < 100; ++i)
+                {
+                    pool.post([&count]() { ++count; });
+                }
+            }
+            // The destructor runs the tasks already posted
+            REQUIRE_EQ(count.load(), 100);
+        }
+
+        TEST_CASE("tasks_run_concurrently")
+        {
+            // The first task only completes once the second one has run
+            std::mutex mutex;
+            std::condition_variable condition;
+            bool second_done = false;
+            bool first_done = false;
+            {
+                WorkerPool pool(2);
+                pool.post([&]() {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    condition.wait(lock, [&]() { return second_done; });
+                    first_done = true;
+                });
+                pool.post([&]() {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    second_done = true;
+                    condition.notify_all();
+                });
+            }
+            REQUIRE(first_done);
+        }
+
+        TEST_CASE("survives_throwing_task")
+        {
+            std::atomic<int> count(0);
+            {
+                WorkerPool pool(1);
+                pool.post([]() { throw std::runtime_error("task error"); });
+                pool.post([&count]() { ++count; });
+            }
+            REQUIRE_EQ(count.load(), 1);
+        }
+    }
+}
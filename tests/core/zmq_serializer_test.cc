@@ -0,0 +1,191 @@
+// Copyright 2024 The EA Authors.
+// part of Elastic AI Search
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include <collie/testing/doctest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <collie/nlohmann/json.hpp>
+
+#include <dwarf/core/message.h>
+#include <dwarf/dmq/authentication.h>
+#include <dwarf/dmq/zmq_serializer.h>
+
+namespace nl = nlohmann;
+
+namespace dwarf
+{
+    namespace
+    {
+        Message make_test_message(buffer_sequence buffers)
+        {
+            nl::json content;
+            content["comm_id"] = "comm";
+            content["data"] = nl::json::object();
+            Message::guid_list ids = { binary_buffer(std::string("client-identity")) };
+            return Message(std::move(ids),
+                           make_header("comm_msg", "user", "session"),
+                           nl::json::object(),
+                           nl::json::object(),
+                           std::move(content),
+                           std::move(buffers));
+        }
+    }
+
+    TEST_SUITE("zmq_serializer")
+    {
+        TEST_CASE("round_trip")
+        {
+            auto auth = make_authentication("hmac-sha256", "secret");
+            buffer_sequence buffers = { std::vector<char>(1024, 'a'), std::vector<char>(3, 'b') };
+            zmq::multipart_t wire_msg = xzmq_serializer::serialize(make_test_message(std::move(buffers)), *auth);
+
+            Message msg = xzmq_serializer::deserialize(wire_msg, *auth);
+            REQUIRE_EQ(msg.identities().size(), std::size_t(1));
+            REQUIRE_EQ(msg.identities()[0].to_string(), "client-identity");
+            REQUIRE_EQ(msg.header()["msg_type"], "comm_msg");
+            REQUIRE_EQ(msg.content()["comm_id"], "comm");
+            REQUIRE_EQ(msg.buffers().size(), std::size_t(2));
+            REQUIRE_EQ(msg.buffers()[0].size(), std::size_t(1024));
+            REQUIRE_EQ(msg.buffers()[0][1023], 'a');
+            REQUIRE_EQ(msg.buffers()[1].to_string(), "bbb");
+        }
+
+        TEST_CASE("received_buffers_are_not_copied")
+        {
+            auto auth = make_authentication("hmac-sha256", "secret");
+            buffer_sequence buffers = { std::vector<char>(1 << 20, 'x') };
+            zmq::multipart_t wire_msg = xzmq_serializer::serialize(make_test_message(std::move(buffers)), *auth);
+            const void *frame_data = wire_msg[wire_msg.size() - 1].data();
+
+            Message msg = xzmq_serializer::deserialize(wire_msg, *auth);
+            REQUIRE_EQ(static_cast<const void *>(msg.buffers()[0].data()), frame_data);
+
+            buffer_sequence shared = msg.buffers();
+            REQUIRE_EQ(shared[0].data(), msg.buffers()[0].data());
+        }
+
+        TEST_CASE("sent_buffers_are_not_copied")
+        {
+            auto auth = make_authentication("hmac-sha256", "secret");
+            binary_buffer buffer(std::vector<char>(1 << 20, 'y'));
+            const char *buffer_data = buffer.data();
+            std::weak_ptr<const void> owner = buffer.owner();
+
+            buffer_sequence buffers = { std::move(buffer) };
+            zmq::multipart_t wire_msg = xzmq_serializer::serialize(make_test_message(std::move(buffers)), *auth);
+            REQUIRE_EQ(wire_msg[wire_msg.size() - 1].data(), static_cast<const void *>(buffer_data));
+            REQUIRE_FALSE(owner.expired());
+
+            wire_msg.clear();
+            REQUIRE(owner.expired());
+        }
+
+        TEST_CASE("lazy_decoding")
+        {
+            auto auth = make_authentication("hmac-sha256", "secret");
+            std::string header = make_header("execute_request", "user", "session").dump();
+            std::string parent_header = "{}";
+            std::string metadata = "{}";
+            std::string content = "{\"code\": ";
+
+            auto raw = [](const std::string &s) {
+                return RawBuffer(reinterpret_cast<const unsigned char *>(s.data()), s.size());
+            };
+            std::string sig = auth->sign(raw(header), raw(parent_header), raw(metadata), raw(content));
+
+            zmq::multipart_t wire_msg;
+            wire_msg.addstr("client-identity");
+            wire_msg.addstr("<IDS|MSG>");
+            wire_msg.addstr(sig);
+            wire_msg.addstr(header);
+            wire_msg.addstr(parent_header);
+            wire_msg.addstr(metadata);
+            wire_msg.addstr(content);
+
+            Message msg = xzmq_serializer::deserialize(wire_msg, *auth, decoding_policy::LAZY);
+            REQUIRE_EQ(msg.header()["msg_type"], "execute_request");
+            REQUIRE_EQ(msg.raw_content().to_string(), content);
+            REQUIRE(msg.metadata().empty());
+            REQUIRE_THROWS(msg.content());
+
+            // Undecoded sections are sent back as they were received
+            zmq::multipart_t resent = xzmq_serializer::serialize(std::move(msg), *auth);
+            REQUIRE_EQ(resent.peekstr(resent.size() - 1), content);
+        }
+
+        TEST_CASE("error_handler")
+        {
+            auto auth = make_authentication("hmac-sha256", "secret");
+            auto make_invalid_message = []() {
+                nl::json content;
+                content["text"] = std::string("bad \xFF ") + std::string(256, 'c');
+                return Message(Message::guid_list(),
+                               make_header("stream", "user", "session"),
+                               nl::json::object(),
+                               nl::json::object(),
+                               std::move(content),
+                               buffer_sequence());
+            };
+
+            REQUIRE_THROWS(xzmq_serializer::serialize(make_invalid_message(), *auth));
+
+            zmq::multipart_t wire_msg = xzmq_serializer::serialize(make_invalid_message(),
+                                                                   *auth,
+                                                                   nl::json::error_handler_t::replace);
+            Message msg = xzmq_serializer::deserialize(wire_msg, *auth);
+            REQUIRE_EQ(msg.content()["text"], "bad \xEF\xBF\xBD " + std::string(256, 'c'));
+        }
+
+        TEST_CASE("bad_signature")
+        {
+            auto auth = make_authentication("hmac-sha256", "secret");
+            auto other = make_authentication("hmac-sha256", "other");
+            zmq::multipart_t wire_msg = xzmq_serializer::serialize(make_test_message(buffer_sequence()), *other);
+            REQUIRE_THROWS(xzmq_serializer::deserialize(wire_msg, *auth));
+        }
+
+        TEST_CASE("missing_frames")
+        {
+            auto auth = make_authentication("hmac-sha256", "secret");
+            zmq::multipart_t wire_msg;
+            wire_msg.addstr("client-identity");
+            wire_msg.addstr("<IDS|MSG>");
+            wire_msg.addstr("signature");
+            REQUIRE_THROWS(xzmq_serializer::deserialize(wire_msg, *auth));
+
+            zmq::multipart_t empty_msg;
+            REQUIRE_THROWS(xzmq_serializer::deserialize(empty_msg, *auth));
+        }
+
+        TEST_CASE("signed_buffers")
+        {
+            auto auth = make_authentication("hmac-sha256", "secret", true);
+            buffer_sequence buffers = { std::vector<char>(2048, 'z') };
+            zmq::multipart_t wire_msg = xzmq_serializer::serialize(make_test_message(std::move(buffers)), *auth);
+            zmq::multipart_t tampered = wire_msg.clone();
+
+            Message msg = xzmq_serializer::deserialize(wire_msg, *auth);
+            REQUIRE_EQ(msg.buffers()[0].size(), std::size_t(2048));
+
+            tampered.remove();
+            tampered.addstr("not the signed payload");
+            REQUIRE_THROWS(xzmq_serializer::deserialize(tampered, *auth));
+        }
+    }
+}